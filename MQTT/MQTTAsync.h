@@ -17,591 +17,326 @@
 #if !defined(MQTTASYNC_H)
 #define MQTTASYNC_H
 
-#include "FP.h"
-#include "MQTTPacket.h"
-#include "stdio.h"
+#include "MQTTClient.h"
 
-namespace MQTT
-{
-
-
-enum QoS { QOS0, QOS1, QOS2 };
+#if !defined(MQTTASYNC_YIELD_MS)
+    #define MQTTASYNC_YIELD_MS 1    // the longest the receive thread holds the client at a time, waiting for packets
+#endif
+#if !defined(MQTTASYNC_POLL_MS)
+    #define MQTTASYNC_POLL_MS 100   // how often the receive thread reads the network without a sigio, as not every
+                                    // stack signals data
+#endif
 
-
-struct Message
+namespace MQTT
 {
-    enum QoS qos;
-    bool retained;
-    bool dup;
-    unsigned short id;
-    void *payload;
-    size_t payloadlen;
-};
-
 
-class PacketId
+/**
+ * @class Async
+ * @brief thread-safe MQTT client API, with a thread of its own to receive packets and complete publishes
+ *
+ * The protocol work is done by a Client, which any number of application threads can use through this at
+ * once: each call holds a mutex.  The receive thread waits outside it for the network's sigio, or for
+ * MQTTASYNC_POLL_MS, then takes it to read the network for up to MQTTASYNC_YIELD_MS, so keepalives and
+ * acks are handled without a read every few milliseconds.  The ISM43362 driver does not signal data, so
+ * with it packets are read every MQTTASYNC_POLL_MS, and by the calls which wait for acks.  Publishes at
+ * QoS 1 and 2 return once sent, and complete when their acks arrive.
+ * Connect, subscribe, unsubscribe and disconnect wait for their acks, so complete before returning.  Result
+ * and message handlers are called with the mutex held, from the receive thread or the calling thread, and
+ * must not call the client.
+ * @param Network a network class with read, write and sigio(obj, method), as MQTTSocket, and connect and
+ * disconnect for setAutoReconnect
+ * @param Timer a timer class with countdown, countdown_ms, left_ms and expired, such as Countdown
+ * @param Thread a thread class with start(callback), join, signal_set(signals) and static
+ * signal_wait(signals, ms), such as rtos's
+ * @param Mutex a mutex class with lock and unlock, such as rtos's
+ */
+template<class Network, class Timer, class Thread, class Mutex, int MAX_MQTT_PACKET_SIZE = 100, int MAX_MESSAGE_HANDLERS = 5>
+class Async
 {
 public:
-    PacketId();
-    
-    int getNext();
-   
-private:
-    static const int MAX_PACKET_ID = 65535;
-    int next;
-};
-
-typedef void (*messageHandler)(Message*);
 
-typedef struct limits
-{
-	int MAX_MQTT_PACKET_SIZE; // 
-	int MAX_MESSAGE_HANDLERS;  // each subscription requires a message handler
-	int MAX_CONCURRENT_OPERATIONS;  // each command which runs concurrently can have a result handler, when we are in multi-threaded mode
-	int command_timeout_ms;
-		
-	limits()
-	{
-		MAX_MQTT_PACKET_SIZE = 100;
-		MAX_MESSAGE_HANDLERS = 5;
-		MAX_CONCURRENT_OPERATIONS = 1; // 1 indicates single-threaded mode - set to >1 for multithreaded mode
-		command_timeout_ms = 30000;
-	}
-} Limits;
-  
+    typedef Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS> SyncClient;
+    typedef typename SyncClient::messageHandler messageHandler;
 
-/**
- * @class Async
- * @brief non-blocking, threaded MQTT client API
- * @param Network a network class which supports send, receive
- * @param Timer a timer class with the methods: 
- */ 
-template<class Network, class Timer, class Thread, class Mutex> class Async
-{
-    
-public:    
-
-	struct Result
-	{
-    	/* success or failure result data */
-    	Async<Network, Timer, Thread, Mutex>* client;
-		int rc;
-	};
-
-	typedef void (*resultHandler)(Result*);	
-   
-    Async(Network* network, const Limits limits = Limits()); 
-        
-    typedef struct
+    struct Result
     {
         Async* client;
-        Network* network;
-    } connectionLostInfo;
-    
-    typedef int (*connectionLostHandlers)(connectionLostInfo*);
-    
-    /** Set the connection lost callback - called whenever the connection is lost and we should be connected
-     *  @param clh - pointer to the callback function
+        void* context;          // as passed with the operation
+        unsigned short id;      // the packet id of a publish
+        int rc;                 // success code, or the connack return code of a connect, or the granted QoS of a subscribe
+    };
+
+    typedef void (*resultHandler)(Result&);
+
+    /** Construct the client
+     *  @param network - the network to use - must be connected to the endpoint before calling connect
+     *  @param command_timeout_ms - how long to wait for the acks of each operation
      */
-    void setConnectionLostHandler(connectionLostHandlers clh)
+    Async(Network& network, unsigned int command_timeout_ms = 30000) : client(network, command_timeout_ms),
+        network(network)
     {
-        connectionLostHandler.attach(clh);
+        thread = 0;
+        running = false;
+        reconnecting = false;
+#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+        for (int i = 0; i < MAX_INFLIGHT_MESSAGES; ++i)
+            operations[i].id = 0;
+#endif
     }
-    
+
+    ~Async()
+    {
+        stop();
+    }
+
     /** Set the default message handling callback - used for any message which does not match a subscription message handler
-     *  @param mh - pointer to the callback function
+     *  @param mh - pointer to the callback function.  Set to 0 to remove.
      */
     void setDefaultMessageHandler(messageHandler mh)
     {
-        defaultMessageHandler.attach(mh);
+        mutex.lock();
+        client.setDefaultMessageHandler(mh);
+        mutex.unlock();
     }
-           
-    int connect(resultHandler fn, MQTTPacket_connectData* options = 0);
-    
-     template<class T>
-    int connect(void(T::*method)(Result *), MQTTPacket_connectData* options = 0, T *item = 0);  // alternative to pass in pointer to member function
-        
-    int publish(resultHandler rh, const char* topic, Message* message);
-    
-    int subscribe(resultHandler rh, const char* topicFilter, enum QoS qos, messageHandler mh);
-    
-    int unsubscribe(resultHandler rh, const char* topicFilter);
-    
-    int disconnect(resultHandler rh);
-    
-private:
 
-    void run(void const *argument);
-    int cycle(int timeout);
-    int waitfor(int packet_type, Timer& atimer);
-	int keepalive();
-	int findFreeOperation();
-
-    int decodePacket(int* value, int timeout);
-    int readPacket(int timeout);
-    int sendPacket(int length, int timeout);
-	int deliverMessage(MQTTString* topic, Message* message);
-    
-    Thread* thread;
-    Network* ipstack;
-    
-    Limits limits;
-    
-    char* buf;  
-    char* readbuf;
-
-    Timer ping_timer, connect_timer;
-    unsigned int keepAliveInterval;
-	bool ping_outstanding;
-    
-    PacketId packetid;
-    
-    typedef FP<void, Result*> resultHandlerFP;    
-    resultHandlerFP connectHandler; 
-    
-    typedef FP<void, Message*> messageHandlerFP;
-    struct MessageHandlers
-    {
-    	const char* topic;
-    	messageHandlerFP fp;
-    } *messageHandlers;      // Message handlers are indexed by subscription topic
-    
-    // how many concurrent operations should we allow?  Each one will require a function pointer
-    struct Operations
+    /** Reconnect automatically when the connection is lost, as Client::setAutoReconnect, from the receive thread
+     *  @param hostname - of the server, passed to the network's connect, or 0 to stop reconnecting
+     *  @param port - of the server
+     *  @param seed - for the random delays, something unique to the device such as its MAC address, or 0
+     */
+    void setAutoReconnect(const char* hostname, int port, unsigned int seed = 0)
     {
-    	unsigned short id;
-    	resultHandlerFP fp;
-    	const char* topic;         // if this is a publish, store topic name in case republishing is required
-    	Message* message;    // for publish, 
-    	Timer timer;         // to check if the command has timed out
-    } *operations;           // result handlers are indexed by packet ids
-
-	static void threadfn(void* arg);
-	
-	messageHandlerFP defaultMessageHandler;
-    
-    typedef FP<int, connectionLostInfo*> connectionLostFP;
-    
-    connectionLostFP connectionLostHandler;
-    
-};
-
-}
-
-
-template<class Network, class Timer, class Thread, class Mutex> void MQTT::Async<Network, Timer, Thread, Mutex>::threadfn(void* arg)
-{
-    ((Async<Network, Timer, Thread, Mutex>*) arg)->run(NULL);
-}
-
-
-template<class Network, class Timer, class Thread, class Mutex> MQTT::Async<Network, Timer, Thread, Mutex>::Async(Network* network, Limits limits)  : limits(limits), packetid()
-{
-	this->thread = 0;
-	this->ipstack = network;
-	this->ping_timer = Timer();
-	this->ping_outstanding = 0;
-	   
-	// How to make these memory allocations portable?  I was hoping to avoid the heap
-	buf = new char[limits.MAX_MQTT_PACKET_SIZE];
-	readbuf = new char[limits.MAX_MQTT_PACKET_SIZE];
-	this->operations = new struct Operations[limits.MAX_CONCURRENT_OPERATIONS];
-	for (int i = 0; i < limits.MAX_CONCURRENT_OPERATIONS; ++i)
-		operations[i].id = 0;
-	this->messageHandlers = new struct MessageHandlers[limits.MAX_MESSAGE_HANDLERS];
-	for (int i = 0; i < limits.MAX_MESSAGE_HANDLERS; ++i)
-		messageHandlers[i].topic = 0;
-}
-
-
-template<class Network, class Timer, class Thread, class Mutex> int MQTT::Async<Network, Timer, Thread, Mutex>::sendPacket(int length, int timeout)
-{
-    int sent = 0;
-    
-    while (sent < length)
-        sent += ipstack->write(&buf[sent], length, timeout);
-	if (sent == length)
-	    ping_timer.countdown(this->keepAliveInterval); // record the fact that we have successfully sent the packet    
-    return sent;
-}
-
-
-template<class Network, class Timer, class Thread, class Mutex> int MQTT::Async<Network, Timer, Thread, Mutex>::decodePacket(int* value, int timeout)
-{
-    char c;
-    int multiplier = 1;
-    int len = 0;
-	const int MAX_NO_OF_REMAINING_LENGTH_BYTES = 4;
+        mutex.lock();
+        client.setAutoReconnect(hostname, port, seed);
+        reconnecting = (hostname != 0);
+        mutex.unlock();
+    }
 
-    *value = 0;
-    do
+    /** MQTT Connect - send an MQTT connect packet and wait for the connack, then start the receive thread
+     *  @param options - connect options
+     *  @param rh - called with the connack return code, or 0
+     *  @param context - passed to rh
+     *  @return success code -
+     */
+    int connect(MQTTPacket_connectData& options, resultHandler rh = 0, void* context = 0)
     {
-        int rc = MQTTPACKET_READ_ERROR;
+        connackData data;
+        int rc = FAILURE;
+
+        mutex.lock();
+        if ((rc = client.connect(options, data)) == SUCCESS)
+            rc = start();
+        complete(rh, context, 0, rc);
+        mutex.unlock();
+        return rc;
+    }
 
-        if (++len > MAX_NO_OF_REMAINING_LENGTH_BYTES)
+    /** MQTT Publish - send an MQTT publish packet.  At QoS 1 or 2, this returns without waiting for the acks,
+     *  once there is room for another publish in flight, and the payload must stay valid until rh is called.
+     *  @param topicName - the topic to publish to
+     *  @param message - the message to send - its id is set to the packet id used
+     *  @param rh - called when the publish completes, or 0
+     *  @param context - passed to rh
+     *  @return success code - of sending the publish
+     */
+    int publish(const char* topicName, Message& message, resultHandler rh = 0, void* context = 0)
+    {
+        int rc = FAILURE;
+        unsigned short id = 0;
+
+        mutex.lock();
+#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+        rc = client.publishAsync(topicName, message.payload, message.payloadlen, id, message.qos, message.retained,
+                                 this, &Async::published);
+        Operation* op = (message.qos != QOS0 && client.isInflight(id)) ? findOperation(0) : 0;
+        if (op)
         {
-            rc = MQTTPACKET_READ_ERROR; /* bad data */
-            goto exit;
+            op->id = id;    // complete when the acks arrive, or the client gives up on it
+            op->rh = rh;
+            op->context = context;
         }
-        rc = ipstack->read(&c, 1, timeout);
-        if (rc != 1)
-            goto exit;
-        *value += (c & 127) * multiplier;
-        multiplier *= 128;
-    } while ((c & 128) != 0);
-exit:
-    return len;
-}
-
-
-/**
- * If any read fails in this method, then we should disconnect from the network, as on reconnect
- * the packets can be retried. 
- * @param timeout the max time to wait for the packet read to complete, in milliseconds
- * @return the MQTT packet type, or -1 if none
- */
-template<class Network, class Timer, class Thread, class Mutex> int MQTT::Async<Network, Timer, Thread, Mutex>::readPacket(int timeout) 
-{
-    int rc = -1;
-    MQTTHeader header = {0};
-    int len = 0;
-    int rem_len = 0;
-
-    /* 1. read the header byte.  This has the packet type in it */
-    if (ipstack->read(readbuf, 1, timeout) != 1)
-        goto exit;
-
-    len = 1;
-    /* 2. read the remaining length.  This is variable in itself */
-    decodePacket(&rem_len, timeout);
-    len += MQTTPacket_encode(readbuf + 1, rem_len); /* put the original remaining length back into the buffer */
-
-    /* 3. read the rest of the buffer using a callback to supply the rest of the data */
-    if (ipstack->read(readbuf + len, rem_len, timeout) != rem_len)
-        goto exit;
-
-    header.byte = readbuf[0];
-    rc = header.bits.type;
-exit:
-    return rc;
-}
-
-
-template<class Network, class Timer, class Thread, class Mutex> int MQTT::Async<Network, Timer, Thread, Mutex>::deliverMessage(MQTTString* topic, Message* message)
-{
-	int rc = -1;
-
-	// we have to find the right message handler - indexed by topic
-	for (int i = 0; i < limits.MAX_MESSAGE_HANDLERS; ++i)
-	{
-		if (messageHandlers[i].topic != 0 && MQTTPacket_equals(topic, (char*)messageHandlers[i].topic))
-		{
-			messageHandlers[i].fp(message);
-			rc = 0;
-			break;
-		}
-	}
-	
-	return rc;
-}
-
-
-
-template<class Network, class Timer, class Thread, class Mutex> int MQTT::Async<Network, Timer, Thread, Mutex>::cycle(int timeout)
-{
-    /* get one piece of work off the wire and one pass through */
+        else
+            complete(rh, context, id, rc);
+#else
+        rc = client.publish(topicName, message.payload, message.payloadlen, message.qos, message.retained);
+        complete(rh, context, id, rc);
+#endif
+        message.id = id;
+        mutex.unlock();
+        return rc;
+    }
 
-    // read the socket, see what work is due
-    int packet_type = readPacket(timeout);
-    
-	int len, rc;
-    switch (packet_type)
+    /** MQTT Subscribe - send an MQTT subscribe packet and wait for the suback
+     *  @param topicFilter - a topic pattern which can include wildcards
+     *  @param qos - the MQTT QoS to subscribe at
+     *  @param mh - the callback function to be invoked when a message is received for this subscription
+     *  @param rh - called with the granted QoS, or 0
+     *  @param context - passed to rh
+     *  @return success code -
+     */
+    int subscribe(const char* topicFilter, enum QoS qos, messageHandler mh, resultHandler rh = 0, void* context = 0)
     {
-        case CONNACK:
-			if (this->thread)
-			{
-				Result res = {this, 0};
-            	if (MQTTDeserialize_connack(&res.rc, readbuf, limits.MAX_MQTT_PACKET_SIZE) == 1)
-                	;
-				connectHandler(&res);
-				connectHandler.detach(); // only invoke the callback once
-			}
-			break;
-        case PUBACK:
-        	if (this->thread)
-        		; //call resultHandler
-        case SUBACK:
-            break;
-        case PUBLISH:
-			MQTTString topicName;
-			Message msg;
-			rc = MQTTDeserialize_publish((int*)&msg.dup, (int*)&msg.qos, (int*)&msg.retained, (int*)&msg.id, &topicName,
-								 (char**)&msg.payload, (int*)&msg.payloadlen, readbuf, limits.MAX_MQTT_PACKET_SIZE);;
-			if (msg.qos == QOS0)
-				deliverMessage(&topicName, &msg);
-            break;
-        case PUBREC:
-   	        int type, dup, mypacketid;
-   	        if (MQTTDeserialize_ack(&type, &dup, &mypacketid, readbuf, limits.MAX_MQTT_PACKET_SIZE) == 1)
-   	            ; 
-   	        // must lock this access against the application thread, if we are multi-threaded
-			len = MQTTSerialize_ack(buf, limits.MAX_MQTT_PACKET_SIZE, PUBREL, 0, mypacketid);
-		    rc = sendPacket(len, timeout); // send the PUBREL packet
-			if (rc != len) 
-				goto exit; // there was a problem
-
-            break;
-        case PUBCOMP:
-            break;
-        case PINGRESP:
-			ping_outstanding = false;
-            break;
+        subackData data;
+        int rc = FAILURE;
+
+        mutex.lock();
+        rc = client.subscribe(topicFilter, qos, mh, data);
+        complete(rh, context, 0, (rc == SUCCESS) ? data.grantedQoS : rc);
+        mutex.unlock();
+        return rc;
     }
-	keepalive();
-exit:
-    return packet_type;
-}
-
-
-template<class Network, class Timer, class Thread, class Mutex> int MQTT::Async<Network, Timer, Thread, Mutex>::keepalive()
-{
-	int rc = 0;
-
-	if (keepAliveInterval == 0)
-		goto exit;
-
-	if (ping_timer.expired())
-	{
-		if (ping_outstanding)
-			rc = -1;
-		else
-		{
-			int len = MQTTSerialize_pingreq(buf, limits.MAX_MQTT_PACKET_SIZE);
-			rc = sendPacket(len, 1000); // send the ping packet
-			if (rc != len) 
-				rc = -1; // indicate there's a problem
-			else
-				ping_outstanding = true;
-		}
-	}
-
-exit:
-	return rc;
-}
-
 
-template<class Network, class Timer, class Thread, class Mutex> void MQTT::Async<Network, Timer, Thread, Mutex>::run(void const *argument)
-{
-	while (true)
-		cycle(ping_timer.left_ms());
-}
-
-
-// only used in single-threaded mode where one command at a time is in process
-template<class Network, class Timer, class Thread, class Mutex> int MQTT::Async<Network, Timer, Thread, Mutex>::waitfor(int packet_type, Timer& atimer)
-{
-	int rc = -1;
-	
-	do
+    /** MQTT Unsubscribe - send an MQTT unsubscribe packet and wait for the unsuback
+     *  @param topicFilter - a topic pattern which can include wildcards
+     *  @param rh - called when the unsubscribe completes, or 0
+     *  @param context - passed to rh
+     *  @return success code -
+     */
+    int unsubscribe(const char* topicFilter, resultHandler rh = 0, void* context = 0)
     {
-		if (atimer.expired()) 
-			break; // we timed out
-	}
-	while ((rc = cycle(atimer.left_ms())) != packet_type);	
-	
-	return rc;
-}
+        int rc = FAILURE;
 
+        mutex.lock();
+        rc = client.unsubscribe(topicFilter);
+        complete(rh, context, 0, rc);
+        mutex.unlock();
+        return rc;
+    }
 
-template<class Network, class Timer, class Thread, class Mutex> int MQTT::Async<Network, Timer, Thread, Mutex>::connect(resultHandler resultHandler, MQTTPacket_connectData* options)
-{
-	connect_timer.countdown(limits.command_timeout_ms);
-
-    MQTTPacket_connectData default_options = MQTTPacket_connectData_initializer;
-    if (options == 0)
-        options = &default_options; // set default options if none were supplied
-    
-    this->keepAliveInterval = options->keepAliveInterval;
-	ping_timer.countdown(this->keepAliveInterval);
-    int len = MQTTSerialize_connect(buf, limits.MAX_MQTT_PACKET_SIZE, options);
-    int rc = sendPacket(len, connect_timer.left_ms()); // send the connect packet
-	if (rc != len) 
-		goto exit; // there was a problem
-    
-    if (resultHandler == 0)     // wait until the connack is received 
+    /** MQTT Disconnect - send an MQTT disconnect packet, and stop the receive thread.  Not to be called from a
+     *  handler, which runs on that thread.
+     *  @param rh - called when the disconnect completes, or 0
+     *  @param context - passed to rh
+     *  @return success code -
+     */
+    int disconnect(resultHandler rh = 0, void* context = 0)
     {
-        // this will be a blocking call, wait for the connack
-		if (waitfor(CONNACK, connect_timer) == CONNACK)
-		{
-        	int connack_rc = -1;
-        	if (MQTTDeserialize_connack(&connack_rc, readbuf, limits.MAX_MQTT_PACKET_SIZE) == 1)
-	        	rc = connack_rc;
-	    }
+        int rc = FAILURE;
+
+        mutex.lock();
+        reconnecting = false;
+        rc = client.disconnect();
+        complete(rh, context, 0, rc);
+        mutex.unlock();
+        stop();
+        return rc;
     }
-    else
+
+    /** Is the client connected?
+     *  @return flag - is the client connected or not?
+     */
+    bool isConnected()
     {
-        // set connect response callback function
-        connectHandler.attach(resultHandler);
-        
-        // start background thread            
-        this->thread = new Thread((void (*)(void const *argument))&MQTT::Async<Network, Timer, Thread, Mutex>::threadfn, (void*)this);
+        mutex.lock();
+        bool rc = client.isConnected();
+        mutex.unlock();
+        return rc;
     }
-    
-exit:
-    return rc;
-}
 
+private:
 
-template<class Network, class Timer, class Thread, class Mutex> int MQTT::Async<Network, Timer, Thread, Mutex>::findFreeOperation()
-{
-	int found = -1;
-	for (int i = 0; i < limits.MAX_CONCURRENT_OPERATIONS; ++i)
-	{
-		if (operations[i].id == 0)
-		{
-			found = i;
-			break;
-		}
-	}
-	return found;
-}
+    SyncClient client;
+    Network& network;
+    Mutex mutex;            // held by each call into the client
+    Thread* thread;         // receiving, 0 until the first connect
+    volatile bool running;
+    bool reconnecting;
 
+#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+    struct Operation
+    {
+        unsigned short id;  // of the publish, 0 if the slot is free
+        resultHandler rh;
+        void* context;
+    } operations[MAX_INFLIGHT_MESSAGES];    // one for each publish the client can have in flight
 
-template<class Network, class Timer, class Thread, class Mutex> int MQTT::Async<Network, Timer, Thread, Mutex>::subscribe(resultHandler resultHandler, const char* topicFilter, enum QoS qos, messageHandler messageHandler)
-{
-	int index = 0;
-	if (this->thread)
-		index = findFreeOperation();	
-	Timer& atimer = operations[index].timer;
-	
-	atimer.countdown(limits.command_timeout_ms);
-    MQTTString topic = {(char*)topicFilter, 0, 0};
-    
-    int len = MQTTSerialize_subscribe(buf, limits.MAX_MQTT_PACKET_SIZE, 0, packetid.getNext(), 1, &topic, (int*)&qos);
-    int rc = sendPacket(len, atimer.left_ms()); // send the subscribe packet
-	if (rc != len) 
-		goto exit; // there was a problem
-    
-    /* wait for suback */
-    if (resultHandler == 0)
+    Operation* findOperation(unsigned short id)
     {
-        // this will block
-        if (waitfor(SUBACK, atimer) == SUBACK)
+        for (int i = 0; i < MAX_INFLIGHT_MESSAGES; ++i)
         {
-            int count = 0, grantedQoS = -1, mypacketid;
-            if (MQTTDeserialize_suback(&mypacketid, 1, &count, &grantedQoS, readbuf, limits.MAX_MQTT_PACKET_SIZE) == 1)
-                rc = grantedQoS; // 0, 1, 2 or 0x80 
-            if (rc != 0x80)
-            {
-            	for (int i = 0; i < limits.MAX_MESSAGE_HANDLERS; ++i)
-				{
-					if (messageHandlers[i].topic == 0)
-					{
-						messageHandlers[i].topic = topicFilter;
-						messageHandlers[i].fp.attach(messageHandler);
-						rc = 0;
-						break;
-					}
-				}
-            }
+            if (operations[i].id == id)
+                return &operations[i];
         }
+        return 0;
     }
-    else
+
+    // called by the client when a publish completes
+    void published(publishData& data)
     {
-        // set subscribe response callback function
-        
-    }
-    
-exit:
-    return rc;
-}
+        Operation* op = (data.id != 0) ? findOperation(data.id) : 0;
 
+        if (op)
+        {
+            op->id = 0;
+            complete(op->rh, op->context, data.id, data.rc);
+        }
+    }
+#endif
 
-template<class Network, class Timer, class Thread, class Mutex> int MQTT::Async<Network, Timer, Thread, Mutex>::unsubscribe(resultHandler resultHandler, const char* topicFilter)
-{
-	int index = 0;
-	if (this->thread)
-		index = findFreeOperation();	
-	Timer& atimer = operations[index].timer;
-
-	atimer.countdown(limits.command_timeout_ms);
-    MQTTString topic = {(char*)topicFilter, 0, 0};
-    
-    int len = MQTTSerialize_unsubscribe(buf, limits.MAX_MQTT_PACKET_SIZE, 0, packetid.getNext(), 1, &topic);
-    int rc = sendPacket(len, atimer.left_ms()); // send the subscribe packet
-	if (rc != len) 
-		goto exit; // there was a problem
-    
-    // set unsubscribe response callback function
-        
-    
-exit:
-    return rc;
-}
+    void complete(resultHandler rh, void* context, unsigned short id, int rc)
+    {
+        if (rh != 0)
+        {
+            Result result = {this, context, id, rc};
+            rh(result);
+        }
+    }
 
+    enum { READABLE = 1 };      // the signal of the receive thread set by the network's sigio
 
-   
-template<class Network, class Timer, class Thread, class Mutex> int MQTT::Async<Network, Timer, Thread, Mutex>::publish(resultHandler resultHandler, const char* topicName, Message* message)
-{
-	int index = 0;
-	if (this->thread)
-		index = findFreeOperation();	
-	Timer& atimer = operations[index].timer;
-
-	atimer.countdown(limits.command_timeout_ms);
-    MQTTString topic = {(char*)topicName, 0, 0};
-
-	if (message->qos == QOS1 || message->qos == QOS2)
-		message->id = packetid.getNext();
-    
-	int len = MQTTSerialize_publish(buf, limits.MAX_MQTT_PACKET_SIZE, 0, message->qos, message->retained, message->id, topic, (char*)message->payload, message->payloadlen);
-    int rc = sendPacket(len, atimer.left_ms()); // send the subscribe packet
-	if (rc != len) 
-		goto exit; // there was a problem
-    
-    /* wait for acks */
-    if (resultHandler == 0)
+    int start()
     {
- 		if (message->qos == QOS1)
-		{
-	        if (waitfor(PUBACK, atimer) == PUBACK)
-    	    {
-    	        int type, dup, mypacketid;
-    	        if (MQTTDeserialize_ack(&type, &dup, &mypacketid, readbuf, limits.MAX_MQTT_PACKET_SIZE) == 1)
-    	            rc = 0; 
-    	    }
-		}
-		else if (message->qos == QOS2)
-		{
-	        if (waitfor(PUBCOMP, atimer) == PUBCOMP)
-	   	    {
-	   	    	int type, dup, mypacketid;
-            	if (MQTTDeserialize_ack(&type, &dup, &mypacketid, readbuf, limits.MAX_MQTT_PACKET_SIZE) == 1)
-    	           	rc = 0; 
-			}
-
-		}
+        if (thread)
+            return SUCCESS;
+        thread = new Thread();
+        running = true;
+        if (thread->start(callback(this, &Async::run)) != osOK)
+        {
+            running = false;
+            delete thread;
+            thread = 0;
+            return FAILURE;
+        }
+        network.sigio(this, &Async::readable);
+        return SUCCESS;
     }
-    else
+
+    void stop()
     {
-        // set publish response callback function
-        
+        if (!thread)
+            return;
+        network.sigio((Async*)0, &Async::readable);
+        mutex.lock();
+        running = false;
+        mutex.unlock();
+        thread->signal_set(READABLE);
+        thread->join();
+        delete thread;
+        thread = 0;
     }
-    
-exit:
-    return rc;
-}
 
+    // called from the network's sigio, which can be in interrupt context
+    void readable()
+    {
+        thread->signal_set(READABLE);
+    }
 
-template<class Network, class Timer, class Thread, class Mutex> int MQTT::Async<Network, Timer, Thread, Mutex>::disconnect(resultHandler resultHandler)
-{  
-    Timer timer = Timer(limits.command_timeout_ms);     // we might wait for incomplete incoming publishes to complete
-    int len = MQTTSerialize_disconnect(buf, limits.MAX_MQTT_PACKET_SIZE);
-    int rc = sendPacket(len, timer.left_ms());   // send the disconnect packet
-    
-    return (rc == len) ? 0 : -1;
-}
+    void run()
+    {
+        bool more = true;
 
+        while (more)
+        {
+            Thread::signal_wait(READABLE, MQTTASYNC_POLL_MS);     // without the mutex, so the module is not kept busy
+            mutex.lock();
+            more = running;
+            if (more && (client.isConnected() || reconnecting))
+                client.yield(MQTTASYNC_YIELD_MS);
+            mutex.unlock();
+        }
+    }
+};
 
+}
 
-#endif
\ No newline at end of file
+#endif
@@ -27,7 +27,9 @@
 #include "FP.h"
 #include "MQTTPacket.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include "MQTTLogging.h"
+#include "MQTTTopicTrie.h"
 
 #if !defined(MQTTCLIENT_QOS1)
     #define MQTTCLIENT_QOS1 1
@@ -35,6 +37,30 @@
 #if !defined(MQTTCLIENT_QOS2)
     #define MQTTCLIENT_QOS2 0
 #endif
+#if !defined(MAX_INCOMING_QOS2_MESSAGES)
+    #define MAX_INCOMING_QOS2_MESSAGES 10
+#endif
+#if !defined(MQTTCLIENT_TOPIC_LEVELS)
+    #define MQTTCLIENT_TOPIC_LEVELS 8   // topic filter levels per message handler, to size the topic index
+#endif
+#if !defined(MQTTCLIENT_RECONNECT_MIN_MS)
+    #define MQTTCLIENT_RECONNECT_MIN_MS 1000    // first automatic reconnect delay, doubled on each failure
+#endif
+#if !defined(MQTTCLIENT_RECONNECT_MAX_MS)
+    #define MQTTCLIENT_RECONNECT_MAX_MS 60000
+#endif
+#if !defined(MQTTCLIENT_SLEEP_MS)
+    #define MQTTCLIENT_SLEEP_MS(ms) wait_ms(ms)     // how yield waits for the next reconnect attempt
+#endif
+#if !defined(MQTTCLIENT_TOPIC_ALIASES)
+    #define MQTTCLIENT_TOPIC_ALIASES 4  // MQTT 5 topic aliases for prepared topics, if the server allows as many
+#endif
+#if !defined(MQTTCLIENT_CONNACK_PROPERTIES)
+    #define MQTTCLIENT_CONNACK_PROPERTIES 8 // MQTT 5 CONNACK properties looked at, the rest being skipped
+#endif
+#if !defined(MQTTCLIENT_TX_BUFFER)
+    #define MQTTCLIENT_TX_BUFFER 256    // bytes of acks, pings and QoS 0 publishes gathered to be sent in one network write
+#endif
 
 namespace MQTT
 {
@@ -57,19 +83,49 @@ struct Message
 };
 
 
+struct PooledMessage;
+
+
 struct MessageData
 {
-    MessageData(MQTTString &aTopicName, struct Message &aMessage)  : message(aMessage), topicName(aTopicName)
+    MessageData(MQTTString &aTopicName, struct Message &aMessage, PooledMessage *aPooled = 0)
+        : message(aMessage), topicName(aTopicName), pooled(aPooled)
     { }
 
+    /** Take the message, if it was received into a MessagePool, to pass it on without copying it, such as
+     *  to another thread.  It is then the caller's, to release to the pool once done with, and any other
+     *  handlers for it are passed the copy in the client's read buffer instead.
+     *  @return the message, or 0 if it is not in a pool or was taken by another handler
+     */
+    PooledMessage *take()
+    {
+        PooledMessage *pm = pooled;
+        pooled = 0;
+        return pm;
+    }
+
     struct Message &message;
     MQTTString &topicName;
+    PooledMessage *pooled;      // released by the client once the handlers return, unless taken
+};
+
+
+struct MessageChunkData
+{
+    MessageChunkData(MQTTString &aTopicName, struct Message &aMessage, size_t aOffset, size_t aTotal)
+        : message(aMessage), topicName(aTopicName), offset(aOffset), total(aTotal)
+    { }
+
+    struct Message &message;    // payload and payloadlen are those of this chunk
+    MQTTString &topicName;
+    size_t offset;              // of this chunk in the whole payload
+    size_t total;               // length of the whole payload
 };
 
 
 struct connackData
 {
-    int rc;
+    int rc;     // the return code, or with MQTT 5 the reason code
     bool sessionPresent;
 };
 
@@ -80,6 +136,13 @@ struct subackData
 };
 
 
+struct publishData
+{
+    unsigned short id;
+    int rc;     // SUCCESS when acknowledged, FAILURE if dropped with the session
+};
+
+
 class PacketId
 {
 public:
@@ -115,6 +178,8 @@ class Client
 public:
 
     typedef void (*messageHandler)(MessageData&);
+    typedef void (*streamHandler)(MessageChunkData&);
+    typedef void (*publishHandler)(publishData&);
 
     /** Construct the client
      *  @param network - pointer to an instance of the Network class - must be connected to the endpoint
@@ -123,6 +188,15 @@ public:
      */
     Client(Network& network, unsigned int command_timeout_ms = 30000);
 
+    ~Client()
+    {
+        if (keepalive_queue)
+        {
+            keepalive_post(this, -1);
+            read_post(this, false);
+        }
+    }
+
     /** Set the default message handling callback - used for any message which does not match a subscription message handler
      *  @param mh - pointer to the callback function.  Set to 0 to remove.
      */
@@ -140,6 +214,55 @@ public:
      */
     int setMessageHandler(const char* topicFilter, messageHandler mh);
 
+    /** Set a streaming message handling callback.  The payload of each matching message is passed to it
+     *  in chunks as it is read, so messages too large for the read buffer can be received, as long as
+     *  their topic fits.  This replaces any message handling callback for the same topic filter.  A QoS 1
+     *  or 2 message too large for the read buffer which no stream handler takes is not acknowledged, so the
+     *  server sends it again when the session is resumed.
+     *  @param topicFilter - a topic pattern which can include wildcards
+     *  @param sh - pointer to the callback function. If 0, removes the callback if any
+     */
+    int setStreamHandler(const char* topicFilter, streamHandler sh);
+
+    /** Receive messages into the blocks of a pool, so that message handlers can take them with
+     *  MessageData::take rather than copy them.  Messages which do not fit in a block, or arrive when
+     *  none is free, are passed in the read buffer as without a pool, and streamed ones are not pooled.
+     *  @param pool - an MQTT::MessagePool, or 0 to stop using one
+     */
+    template<class Pool>
+    void setMessagePool(Pool* pool)
+    {
+        message_pool = pool;
+        pool_alloc = &Client::allocPooled<Pool>;
+        pool_release = &Client::releasePooled<Pool>;
+    }
+
+    /** Reconnect automatically when the connection is lost, after a delay doubled from
+     *  MQTTCLIENT_RECONNECT_MIN_MS up to MQTTCLIENT_RECONNECT_MAX_MS on each failed attempt, and randomized
+     *  down to half so that clients cut off together do not all come back at once.  The randomness is
+     *  seeded from the client id of the last connect, or from seed, so each device picks its own delays
+     *  rather than following the same sequence as the rest of a fleet.  The attempts are made by yield,
+     *  which sleeps until the next is due or its timeout ends rather than returning at once, or by the
+     *  keepalive events if setKeepaliveQueue is used, and other operations fail until one succeeds.  The
+     *  network is connected again, then the client with the options of the last connect, so the strings
+     *  they point to must stay valid.  Unacknowledged QoS 1 and 2 publishes are sent again if cleansession
+     *  is off, and the handlers are kept and, unless the server still has the session, subscribed to again
+     *  in as few SUBSCRIBE packets as fit in the packet buffer.
+     *  @param hostname - of the server, passed to the network's connect, or 0 to stop reconnecting
+     *  @param port - of the server
+     *  @param seed - for the random delays, something unique to the device such as its MAC address, or 0
+     */
+    void setAutoReconnect(const char* hostname, int port, unsigned int seed = 0)
+    {
+        if (seed != 0)
+            jitter = seed;
+        reconnect_hostname = hostname;
+        reconnect_port = port;
+        reconnect_network = &Client::reconnectNetwork;
+        reconnect_session = (hostname != 0 && (isconnected || reconnect_session));
+        scheduleKeepalive();
+    }
+
     /** MQTT Connect - send an MQTT connect packet down the network and wait for a Connack
      *  The nework object must be connected to the network endpoint before calling this
      *  Default connect options are used
@@ -165,7 +288,7 @@ public:
     /** MQTT Publish - send an MQTT publish packet and wait for all acks to complete for all QoSs
      *  @param topic - the topic to publish to
      *  @param message - the message to send
-     *  @return success code -
+     *  @return success code - FAILURE too if an MQTT 5 server refuses the publish with its reason code
      */
     int publish(const char* topicName, Message& message);
 
@@ -180,6 +303,9 @@ public:
     int publish(const char* topicName, void* payload, size_t payloadlen, enum QoS qos = QOS0, bool retained = false);
 
     /** MQTT Publish - send an MQTT publish packet and wait for all acks to complete for all QoSs
+     *  A payload which does not fit in the packet buffer with its topic is written to the network straight
+     *  from the caller's memory.  With cleansession off, an unacknowledged QoS 1 or 2 publish is sent again
+     *  by the next connect from the same topic and payload memory, so it must still be valid then.
      *  @param topic - the topic to publish to
      *  @param payload - the data to send
      *  @param payloadlen - the length of the data
@@ -190,11 +316,74 @@ public:
      */
     int publish(const char* topicName, void* payload, size_t payloadlen, unsigned short& id, enum QoS qos = QOS1, bool retained = false);
 
+    /** MQTT Publish - send an MQTT publish packet and wait for all acks to complete for all QoSs, to a topic
+     *  prepared once with MQTTSerialize_prepareTopic, so that only the flags, lengths and packet id are
+     *  worked out for each publish to it.  With MQTT 5, the topic name is replaced by a topic alias after
+     *  the first publish to it on each connection, if the server allows enough aliases.
+     *  @param topic - the prepared topic to publish to, which must stay valid while connected
+     *  @param payload - the data to send
+     *  @param payloadlen - the length of the data
+     *  @param qos - the QoS to send the publish at
+     *  @param retained - whether the message should be retained
+     *  @return success code -
+     */
+    int publish(MQTTPreparedTopic& topic, void* payload, size_t payloadlen, enum QoS qos = QOS0, bool retained = false);
+
+    /** MQTT Publish at QoS 0 without waiting - the publish is serialized into the transmit buffer, behind any
+     *  acks queued there, and written with them by the next cycle, yield or packet sent.  No timer is started
+     *  unless the buffer is full, when what is queued is sent first, or the publish does not fit in it.
+     *  The topic and payload are copied, so need not stay valid after it returns.
+     *  @param topic - the topic to publish to
+     *  @param payload - the data to send
+     *  @param payloadlen - the length of the data
+     *  @param retained - whether the message should be retained
+     *  @return success code -
+     */
+    int publishQoS0(const char* topicName, void* payload, size_t payloadlen, bool retained = false);
+
+    /** MQTT Publish at QoS 0 without waiting, as above, to a prepared topic
+     *  @param topic - the prepared topic to publish to, which must stay valid while connected
+     */
+    int publishQoS0(MQTTPreparedTopic& topic, void* payload, size_t payloadlen, bool retained = false);
+
+    /** MQTT Publish - send an MQTT publish packet without waiting for its acks.  Up to MAX_INFLIGHT_MESSAGES
+     *  QoS 1 and 2 publishes, or fewer if an MQTT 5 server's Receive Maximum is lower, can be in flight at
+     *  once, acknowledged in any order; when that many are, this first waits for one of them to complete.
+     *  The topic and payload are not copied, and must stay valid until the publish completes.
+     *  @param topic - the topic to publish to
+     *  @param payload - the data to send
+     *  @param payloadlen - the length of the data
+     *  @param id - the packet id used - returned
+     *  @param qos - the QoS to send the publish at
+     *  @param retained - whether the message should be retained
+     *  @param ph - called when the publish completes, or 0.  It is called from within the client, by yield
+     *      or any other method, and must not call the client itself.
+     *  @return success code - of sending the publish
+     */
+    int publishAsync(const char* topicName, void* payload, size_t payloadlen, unsigned short& id, enum QoS qos, bool retained,
+                     publishHandler ph);
+
+    /** MQTT Publish - send an MQTT publish packet without waiting for its acks, as above, calling a member
+     *  function when it completes
+     *  @param item - the object to call the member function on
+     *  @param method - called when the publish completes, from within the client
+     */
+    template<class T>
+    int publishAsync(const char* topicName, void* payload, size_t payloadlen, unsigned short& id, enum QoS qos, bool retained,
+                     T* item, void (T::*method)(publishData&))
+    {
+        Timer timer(command_timeout_ms);
+        FP<void, publishData&> fp;
+
+        fp.attach(item, method);
+        return startPublish(topicName, payload, payloadlen, id, qos, retained, fp, timer);
+    }
+
     /** MQTT Subscribe - send an MQTT subscribe packet and wait for the suback
      *  @param topicFilter - a topic pattern which can include wildcards
      *  @param qos - the MQTT QoS to subscribe at
      *  @param mh - the callback function to be invoked when a message is received for this subscription
-     *  @return success code -
+     *  @return success code - FAILURE, with nothing sent, if there is no room for the handler
      */
     int subscribe(const char* topicFilter, enum QoS qos, messageHandler mh);
 
@@ -207,18 +396,48 @@ public:
      */
     int subscribe(const char* topicFilter, enum QoS qos, messageHandler mh, subackData &data);
 
+    /** MQTT Subscribe - send an MQTT subscribe packet and wait for the suback, then deliver the payload
+     *  of each message received for this subscription in chunks
+     *  @param topicFilter - a topic pattern which can include wildcards
+     *  @param qos - the MQTT QoS to subscribe at
+     *  @param sh - the callback function to be invoked with each chunk of a message received
+     *  @return success code -
+     */
+    int subscribeStream(const char* topicFilter, enum QoS qos, streamHandler sh);
+
+    /** MQTT Subscribe - subscribe to several topic filters with one subscribe packet, or as few as fit
+     *  in the packet buffer, and set the handler of each filter the server grants
+     *  @param count - the number of topic filters, up to MAX_MESSAGE_HANDLERS
+     *  @param topicFilters - topic patterns which can include wildcards
+     *  @param qos - the MQTT QoS to subscribe to each at
+     *  @param mhs - the callback function for each subscription
+     *  @param grantedQoSs - filled with the QoS granted for each, 0x80 or with MQTT 5 another reason code from
+     *      0x80 on if refused, or 0
+     *  @return success code - FAILURE, with nothing sent, if there is no room for all the handlers
+     */
+    int subscribe(int count, const char** topicFilters, enum QoS* qos, messageHandler* mhs, int* grantedQoSs = 0);
+
     /** MQTT Unsubscribe - send an MQTT unsubscribe packet and wait for the unsuback
      *  @param topicFilter - a topic pattern which can include wildcards
      *  @return success code -
      */
     int unsubscribe(const char* topicFilter);
 
+    /** MQTT Unsubscribe - unsubscribe from several topic filters with one unsubscribe packet, or as few as
+     *  fit in the packet buffer, and remove their handlers
+     *  @param count - the number of topic filters, up to MAX_MESSAGE_HANDLERS
+     *  @param topicFilters - topic patterns which can include wildcards
+     *  @return success code -
+     */
+    int unsubscribe(int count, const char** topicFilters);
+
     /** MQTT Disconnect - send an MQTT disconnect packet, and clean up any state
      *  @return success code -
      */
     int disconnect();
 
-    /** A call to this API must be made within the keepAlive interval to keep the MQTT connection alive
+    /** A call to this API must be made within the keepAlive interval to keep the MQTT connection alive,
+     *  unless the keepalive is run from a queue by setKeepaliveQueue.
      *  yield can be called if no other MQTT operation is needed.  This will also allow messages to be
      *  received.
      *  @param timeout_ms the time to wait, in milliseconds
@@ -226,6 +445,32 @@ public:
      */
     int yield(unsigned long timeout_ms = 1000L);
 
+    /** Run the keepalive from events posted to a queue for when the next ping is due, instead of from
+     *  calls to yield.  Each event also handles any packets already received, as does an event posted
+     *  from the Network's sigio(obj, method) callback, such as MQTTSocket's, when data arrives.  Where
+     *  the network stack does not signal received data, as the ISM43362 driver does not, packets are
+     *  only read at the keepalive events, so the application should still call yield to receive
+     *  messages promptly.  The client is not thread-safe, so the queue must be dispatched by the thread
+     *  which uses the client.
+     *  @param queue - an event queue with call_in(ms, obj, method), call(obj, method) and cancel(id),
+     *      such as mbed's EventQueue.  Set to 0 to go back to calling yield.
+     */
+    template<class Queue>
+    void setKeepaliveQueue(Queue* queue)
+    {
+        if (keepalive_queue)
+        {
+            keepalive_post(this, -1);
+            read_post(this, false);
+        }
+        keepalive_queue = queue;
+        keepalive_post = &Client::postKeepalive<Queue>;
+        read_post = &Client::postRead<Queue>;
+        if (queue)
+            ipstack.sigio(this, &Client::readable);
+        scheduleKeepalive();
+    }
+
     /** Is the client connected?
      *  @return flag - is the client connected or not?
      */
@@ -234,57 +479,200 @@ public:
         return isconnected;
     }
 
+#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+    /** Is a QoS 1 or 2 publish still awaiting its acks?  After a failed publish, this means it is sent again
+     *  by the next connect, from the same topic and payload memory.
+     *  @param id - the packet id of the publish
+     *  @return flag - is the publish in flight?
+     */
+    bool isInflight(unsigned short id)
+    {
+        return id != 0 && findInflight(id) != 0;
+    }
+#endif
+
+#if MQTTCLIENT_QOS2
+    /** Are MAX_INCOMING_QOS2_MESSAGES incoming QoS 2 messages awaiting their PUBREL?  With MQTT 5 the
+     *  CONNECT sets the server's Receive Maximum to that many, so a server which sends another anyway is
+     *  disconnected with reason code 0x93.  MQTT 3 has no such limit, and a server only sends a publish
+     *  again on reconnect, so one arriving while the window is full is delivered and acknowledged without
+     *  being recorded; should the server send it again before the PUBREL, it is delivered twice.
+     *  @return flag - is the incoming QoS 2 window full?
+     */
+    bool isQoS2WindowFull()
+    {
+        return incomingQoS2count == MAX_INCOMING_QOS2_MESSAGES;
+    }
+#endif
+
 private:
 
     void closeSession();
-    void cleanSession();
+    void cleanSession(bool handlers = true);
+    void backoff();
+    int reconnect();
+    int resubscribe(Timer& timer);
     int cycle(Timer& timer);
     int waitfor(int packet_type, Timer& timer);
     int keepalive();
-    int publish(int len, Timer& timer, enum QoS qos);
-
-    int decodePacket(int* value, int timeout);
+    void scheduleKeepalive();
+    void keepaliveEvent();
+    void readable();
+    void readEvent();
+    int startPublish(const char* topicName, void* payload, size_t payloadlen, unsigned short& id, enum QoS qos, bool retained,
+                     FP<void, publishData&>& fp, Timer& timer, MQTTPreparedTopic* prepared = 0);
+    int serializePublish(unsigned char dup, enum QoS qos, bool retained, unsigned short id, const char* topicName,
+                         void* payload, size_t payloadlen, size_t& streamlen, MQTTPreparedTopic* prepared = 0);
+    int topicAlias(MQTTPreparedTopic* prepared, MQTTString& topicName);
+    int queuePublish(const char* topicName, void* payload, size_t payloadlen, bool retained, MQTTPreparedTopic* prepared);
+    int deserializeConnack(connackData& data);
+
+    int decodePacket(int* value);
     int readPacket(Timer& timer);
-    int sendPacket(int length, Timer& timer);
+    int sendPacket(int length, Timer& timer, void* payload = 0, size_t payloadlen = 0);
+    int queuePacket(int length, Timer& timer);
+    int flushPackets(Timer& timer);
+    bool packetWaiting();
+    int sendBytes(unsigned char* buf, int length, Timer& timer);
     int deliverMessage(MQTTString& topicName, Message& message);
-    bool isTopicMatched(char* topicFilter, MQTTString& topicName);
+    int readPayload(MQTTString* topicName, Message* message);
+    int handlerSlot(const char* topicFilter);
+    int setHandler(const char* topicFilter, messageHandler mh, streamHandler sh);
+    bool indexHandlers();
+    bool handlersFit(int count, const char** topicFilters);
+    int sendSubscribe(const char* topicFilter, enum QoS qos, subackData& data);
+    int sendSubscribes(int count, MQTTString* topics, int* qoss, int* granted, Timer& timer);
+    int sendUnsubscribes(int count, MQTTString* topics, Timer& timer);
 
     Network& ipstack;
     unsigned long command_timeout_ms;
 
     unsigned char sendbuf[MAX_MQTT_PACKET_SIZE];
     unsigned char readbuf[MAX_MQTT_PACKET_SIZE];
+    unsigned char txbuf[MQTTCLIENT_TX_BUFFER];  // packets queued to be sent together, ahead of the next one sent
+    int txbuf_len;
+    int readbuf_len;    // bytes held in readbuf, including any read ahead of the current packet
+    int packet_len;     // length of the packet at the start of readbuf, dropped by the next readPacket
+    int stream_left;    // payload bytes of a streamed PUBLISH still to be read, -1 if reading them failed
 
-    Timer last_sent, last_received;
+    Timer last_sent, last_received, ping_sent;
     unsigned int keepAliveInterval;
     bool ping_outstanding;
     bool cleansession;
 
+    void* keepalive_queue;      // running keepaliveEvent, 0 if the application calls yield instead
+    int keepalive_event;        // id of the keepaliveEvent pending on the queue, 0 if none
+    void (*keepalive_post)(Client* client, int delay_ms);   // post keepaliveEvent, or only cancel it if delay_ms < 0
+    volatile int read_event;    // id of the readEvent pending on the queue, 0 if none
+    void (*read_post)(Client* client, bool post);   // post readEvent, or cancel it and leave the Network's sigio
+
+    template<class Queue>
+    static void postKeepalive(Client* client, int delay_ms)
+    {
+        Queue* queue = static_cast<Queue*>(client->keepalive_queue);
+        if (client->keepalive_event != 0)
+            queue->cancel(client->keepalive_event);
+        client->keepalive_event = (delay_ms < 0) ? 0 : queue->call_in(delay_ms, client, &Client::keepaliveEvent);
+    }
+
+    // only instantiated by setKeepaliveQueue, so that the Network needs no sigio otherwise
+    template<class Queue>
+    static void postRead(Client* client, bool post)
+    {
+        Queue* queue = static_cast<Queue*>(client->keepalive_queue);
+        if (post)
+        {
+            if (client->read_event == 0)
+                client->read_event = queue->call(client, &Client::readEvent);
+            return;
+        }
+        client->ipstack.sigio((Client*)0, &Client::readable);
+        if (client->read_event != 0)
+            queue->cancel(client->read_event);
+        client->read_event = 0;
+    }
+
     PacketId packetid;
 
     struct MessageHandlers
     {
         const char* topicFilter;
         FP<void, MessageData&> fp;
+        FP<void, MessageChunkData&> sfp;
+        int qos;    // subscribed at by this client, to subscribe again on reconnect, or -1
     } messageHandlers[MAX_MESSAGE_HANDLERS];      // Message handlers are indexed by subscription topic
 
+    TopicTrie<MAX_MESSAGE_HANDLERS * MQTTCLIENT_TOPIC_LEVELS + 1> topicTrie; // topic filters, to the index of their handler
+
     FP<void, MessageData&> defaultMessageHandler;
 
+    void* message_pool;         // received messages are copied into for the handlers to take, 0 if none
+    PooledMessage* (*pool_alloc)(void* pool, MQTTString& topicName, Message& message);
+    void (*pool_release)(void* pool, PooledMessage* pm);
+
+    template<class Pool>
+    static PooledMessage* allocPooled(void* pool, MQTTString& topicName, Message& message)
+    {
+        return static_cast<Pool*>(pool)->alloc(topicName, message);
+    }
+
+    template<class Pool>
+    static void releasePooled(void* pool, PooledMessage* pm)
+    {
+        static_cast<Pool*>(pool)->release(pm);
+    }
+
     bool isconnected;
+    unsigned char mqtt_version;                 // of the last connect, 5 for MQTT 5 packets
+    int topic_alias_max;                        // allowed by the server, up to MQTTCLIENT_TOPIC_ALIASES
+    int receive_max;                            // QoS 1 and 2 publishes the server accepts in flight at once
+    unsigned int max_packet_size;               // the largest packet the server accepts, 0 for no limit
+    MQTTPreparedTopic* topic_aliases[MQTTCLIENT_TOPIC_ALIASES + 1];    // the topic of each alias, from 1, on this connection
+
+    MQTTPacket_connectData connect_options;    // of the last connect, to reconnect with
+    const char* reconnect_hostname;            // 0 if not reconnecting automatically
+    int reconnect_port;
+    bool reconnect_session;                    // connected, or to be reconnected, until disconnect
+    int reconnect_attempts;                    // failed since the connection was lost
+    Timer reconnect_timer;                     // until the next attempt
+    unsigned int jitter;                       // random state for the reconnect delays, 0 until seeded
+    int (*reconnect_network)(Client* client);
+
+    // only instantiated by setAutoReconnect, so that the Network needs no connect or disconnect otherwise
+    static int reconnectNetwork(Client* client)
+    {
+        client->ipstack.disconnect();
+        return client->ipstack.connect((char*)client->reconnect_hostname, client->reconnect_port);
+    }
 
 #if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
-    unsigned char pubbuf[MAX_MQTT_PACKET_SIZE];  // store the last publish for sending on reconnect
-    int inflightLen;
-    unsigned short inflightMsgid;
-    enum QoS inflightQoS;
+    #if !defined(MAX_INFLIGHT_MESSAGES)
+        #define MAX_INFLIGHT_MESSAGES 4
+    #endif
+    struct InflightMessage
+    {
+        unsigned short msgid;   // 0 if the slot is free
+        enum QoS qos;
+        bool pubrel;            // QoS 2, PUBREC received
+        bool retained;
+        const char* topicName;  // topic and payload are not copied, but read again to resend on reconnect
+        void* payload;
+        size_t payloadlen;
+        FP<void, publishData&> fp;
+        int rc;                 // how the last publish in the slot completed
+    } inflight[MAX_INFLIGHT_MESSAGES];
+    InflightMessage* findInflight(unsigned short id);
+    int inflightCount();
+    void completeInflight(InflightMessage* msg, int rc);
+    int resendInflight(Timer& timer);
+    int waitforInflight(unsigned short id, Timer& timer);
 #endif
 
 #if MQTTCLIENT_QOS2
-    bool pubrel;
-    #if !defined(MAX_INCOMING_QOS2_MESSAGES)
-        #define MAX_INCOMING_QOS2_MESSAGES 10
-    #endif
-    unsigned short incomingQoS2messages[MAX_INCOMING_QOS2_MESSAGES];
+    // packet ids awaiting PUBREL, hashed with linear probing into a table kept at most half full
+    unsigned short incomingQoS2messages[2 * MAX_INCOMING_QOS2_MESSAGES];
+    int incomingQoS2count;
+    int findQoS2msgid(unsigned short id);
     bool isQoS2msgidFree(unsigned short id);
     bool useQoS2msgid(unsigned short id);
     void freeQoS2msgid(unsigned short id);
@@ -296,20 +684,27 @@ private:
 
 
 template<class Network, class Timer, int a, int MAX_MESSAGE_HANDLERS>
-void MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::cleanSession()
+void MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::cleanSession(bool handlers)
 {
-    for (int i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
-        messageHandlers[i].topicFilter = 0;
+    if (handlers)
+    {
+        for (int i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
+            messageHandlers[i].topicFilter = 0;
+        topicTrie.clear();
+    }
 
 #if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
-    inflightMsgid = 0;
-    inflightQoS = QOS0;
+    for (int i = 0; i < MAX_INFLIGHT_MESSAGES; ++i)
+    {
+        if (inflight[i].msgid != 0)
+            completeInflight(&inflight[i], FAILURE);
+    }
 #endif
 
 #if MQTTCLIENT_QOS2
-    pubrel = false;
-    for (int i = 0; i < MAX_INCOMING_QOS2_MESSAGES; ++i)
+    for (int i = 0; i < 2 * MAX_INCOMING_QOS2_MESSAGES; ++i)
         incomingQoS2messages[i] = 0;
+    incomingQoS2count = 0;
 #endif
 }
 
@@ -319,8 +714,39 @@ void MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::closeSession()
 {
     ping_outstanding = false;
     isconnected = false;
+    readbuf_len = packet_len = stream_left = 0;
+    txbuf_len = 0;
     if (cleansession)
-        cleanSession();
+        cleanSession(!reconnect_session);   // handlers are kept to subscribe again on reconnect
+    if (reconnect_session)
+        backoff();
+    scheduleKeepalive();
+}
+
+
+// set the time of the next reconnect attempt
+template<class Network, class Timer, int a, int b>
+void MQTT::Client<Network, Timer, a, b>::backoff()
+{
+    int delay_ms = MQTTCLIENT_RECONNECT_MAX_MS;
+
+    if (reconnect_attempts < 16 && (MQTTCLIENT_RECONNECT_MIN_MS << reconnect_attempts) < delay_ms)
+        delay_ms = MQTTCLIENT_RECONNECT_MIN_MS << reconnect_attempts;
+    ++reconnect_attempts;
+    if (jitter == 0)
+    {
+        // FNV-1a of the client id, which is unique to the device
+        const char* id = connect_options.clientID.cstring;
+        int len = (id) ? strlen(id) : connect_options.clientID.lenstring.len;
+
+        if (!id)
+            id = connect_options.clientID.lenstring.data;
+        jitter = 2166136261U;
+        for (int i = 0; i < len; ++i)
+            jitter = (jitter ^ (unsigned char)id[i]) * 16777619U;
+    }
+    jitter = jitter * 1103515245U + 12345U;
+    reconnect_timer.countdown_ms(delay_ms / 2 + (jitter >> 16) % (delay_ms / 2 + 1));
 }
 
 
@@ -329,88 +755,301 @@ MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::Client(Network& network,
 {
     this->command_timeout_ms = command_timeout_ms;
     cleansession = true;
+    keepalive_queue = 0;
+    keepalive_event = 0;
+    read_event = 0;
+    message_pool = 0;
+    mqtt_version = 4;
+    topic_alias_max = 0;
+    receive_max = 65535;
+    max_packet_size = 0;
+    reconnect_hostname = 0;
+    reconnect_port = 0;
+    reconnect_session = false;
+    reconnect_attempts = 0;
+    jitter = 0;
+#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+    for (int i = 0; i < MAX_INFLIGHT_MESSAGES; ++i)
+        inflight[i].msgid = 0;
+#endif
       closeSession();
 }
 
 
-#if MQTTCLIENT_QOS2
+#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+// the in-flight publish with this packet id, or a free slot for id 0
 template<class Network, class Timer, int a, int b>
-bool MQTT::Client<Network, Timer, a, b>::isQoS2msgidFree(unsigned short id)
+typename MQTT::Client<Network, Timer, a, b>::InflightMessage* MQTT::Client<Network, Timer, a, b>::findInflight(unsigned short id)
 {
-    for (int i = 0; i < MAX_INCOMING_QOS2_MESSAGES; ++i)
+    for (int i = 0; i < MAX_INFLIGHT_MESSAGES; ++i)
     {
-        if (incomingQoS2messages[i] == id)
-            return false;
+        if (inflight[i].msgid == id)
+            return &inflight[i];
     }
-    return true;
+    return 0;
 }
 
 
 template<class Network, class Timer, int a, int b>
-bool MQTT::Client<Network, Timer, a, b>::useQoS2msgid(unsigned short id)
+int MQTT::Client<Network, Timer, a, b>::inflightCount()
+{
+    int count = 0;
+
+    for (int i = 0; i < MAX_INFLIGHT_MESSAGES; ++i)
+    {
+        if (inflight[i].msgid != 0)
+            ++count;
+    }
+    return count;
+}
+
+
+template<class Network, class Timer, int a, int b>
+void MQTT::Client<Network, Timer, a, b>::completeInflight(InflightMessage* msg, int rc)
+{
+    publishData data;
+
+    data.id = msg->msgid;
+    data.rc = rc;
+    msg->rc = rc;
+    msg->msgid = 0;
+    if (msg->fp.attached())
+        msg->fp(data);
+    msg->fp.detach();
+}
+
+
+// send all in-flight publishes again, with the dup flag set, or their PUBREL if already received
+template<class Network, class Timer, int a, int b>
+int MQTT::Client<Network, Timer, a, b>::resendInflight(Timer& timer)
+{
+    int rc = SUCCESS;
+
+    for (int i = 0; rc == SUCCESS && i < MAX_INFLIGHT_MESSAGES; ++i)
+    {
+        InflightMessage* msg = &inflight[i];
+        size_t streamlen = 0;
+        int len;
+
+        if (msg->msgid == 0)
+            continue;
+        if (msg->pubrel)
+            len = MQTTSerialize_ack(sendbuf, a, PUBREL, 0, msg->msgid);
+        else
+            len = serializePublish(1, msg->qos, msg->retained, msg->msgid, msg->topicName, msg->payload, msg->payloadlen, streamlen);
+        if (len <= 0)
+            rc = FAILURE;
+        else
+            rc = sendPacket(len, timer, msg->payload, streamlen);
+    }
+    return rc;
+}
+
+
+// process incoming packets until the in-flight publish with this packet id completes, returning how it did
+template<class Network, class Timer, int a, int b>
+int MQTT::Client<Network, Timer, a, b>::waitforInflight(unsigned short id, Timer& timer)
 {
-    for (int i = 0; i < MAX_INCOMING_QOS2_MESSAGES; ++i)
+    int rc = SUCCESS;
+    InflightMessage* msg = findInflight(id);
+
+    while (msg && msg->msgid == id)
     {
-        if (incomingQoS2messages[i] == 0)
+        if (timer.expired() || cycle(timer) < 0)
         {
-            incomingQoS2messages[i] = id;
-            return true;
+            rc = FAILURE;
+            break;
         }
     }
-    return false;
+    if (rc == SUCCESS && msg)
+        rc = msg->rc;   // FAILURE if the server refused it
+    if (rc == SUCCESS && flushPackets(timer) != SUCCESS) // acks for packets read on the way
+    {
+        closeSession();
+        rc = FAILURE;
+    }
+    return rc;
+}
+#endif
+
+
+#if MQTTCLIENT_QOS2
+// the slot holding this packet id, or else the empty slot ending its probe sequence
+template<class Network, class Timer, int a, int b>
+int MQTT::Client<Network, Timer, a, b>::findQoS2msgid(unsigned short id)
+{
+    const int size = 2 * MAX_INCOMING_QOS2_MESSAGES;
+    int i = (id * 40503U) % size;
+
+    while (incomingQoS2messages[i] != 0 && incomingQoS2messages[i] != id)
+        i = (i + 1) % size;
+    return i;
+}
+
+
+template<class Network, class Timer, int a, int b>
+bool MQTT::Client<Network, Timer, a, b>::isQoS2msgidFree(unsigned short id)
+{
+    return incomingQoS2messages[findQoS2msgid(id)] == 0;
+}
+
+
+template<class Network, class Timer, int a, int b>
+bool MQTT::Client<Network, Timer, a, b>::useQoS2msgid(unsigned short id)
+{
+    int i = findQoS2msgid(id);
+
+    if (incomingQoS2messages[i] == 0)
+    {
+        if (incomingQoS2count == MAX_INCOMING_QOS2_MESSAGES)
+            return false;
+        incomingQoS2messages[i] = id;
+        ++incomingQoS2count;
+    }
+    return true;
 }
 
 
 template<class Network, class Timer, int a, int b>
 void MQTT::Client<Network, Timer, a, b>::freeQoS2msgid(unsigned short id)
 {
-    for (int i = 0; i < MAX_INCOMING_QOS2_MESSAGES; ++i)
+    const int size = 2 * MAX_INCOMING_QOS2_MESSAGES;
+    int i = findQoS2msgid(id);
+
+    if (incomingQoS2messages[i] == 0)
+        return;
+    --incomingQoS2count;
+    // move back any later id of the same probe sequence into the gap, so that it can still be found
+    for (int j = (i + 1) % size; incomingQoS2messages[j] != 0; j = (j + 1) % size)
     {
-        if (incomingQoS2messages[i] == id)
+        int home = (incomingQoS2messages[j] * 40503U) % size;
+        if ((i < j) ? (home <= i || home > j) : (home <= i && home > j))
         {
-            incomingQoS2messages[i] = 0;
-            return;
+            incomingQoS2messages[i] = incomingQoS2messages[j];
+            i = j;
         }
     }
+    incomingQoS2messages[i] = 0;
 }
 #endif
 
 
 template<class Network, class Timer, int a, int b>
-int MQTT::Client<Network, Timer, a, b>::sendPacket(int length, Timer& timer)
+int MQTT::Client<Network, Timer, a, b>::sendBytes(unsigned char* buf, int length, Timer& timer)
 {
     int rc = FAILURE,
         sent = 0;
 
     while (sent < length)
     {
-        rc = ipstack.write(&sendbuf[sent], length - sent, timer.left_ms());
+        rc = ipstack.write(&buf[sent], length - sent, timer.left_ms());
         if (rc < 0)  // there was an error writing the data
             break;
         sent += rc;
         if (timer.expired()) // only check expiry after at least one attempt to write
             break;
     }
-    if (sent == length)
+    return (sent == length) ? SUCCESS : FAILURE;
+}
+
+
+/**
+ * Send the packet in sendbuf, followed by payloadlen bytes of payload when the packet was
+ * serialized without it.  Any packets queued in txbuf go first, in the same write if it fits.
+ */
+template<class Network, class Timer, int a, int b>
+int MQTT::Client<Network, Timer, a, b>::sendPacket(int length, Timer& timer, void* payload, size_t payloadlen)
+{
+    int rc = SUCCESS;
+
+    if (txbuf_len > 0 && txbuf_len + length <= MQTTCLIENT_TX_BUFFER)
+    {
+        memcpy(&txbuf[txbuf_len], sendbuf, length);
+        rc = sendBytes(txbuf, txbuf_len + length, timer);
+        txbuf_len = 0;
+    }
+    else if ((rc = flushPackets(timer)) == SUCCESS)
+        rc = sendBytes(sendbuf, length, timer);
+
+    if (rc == SUCCESS && payloadlen > 0)
+        rc = sendBytes((unsigned char*)payload, payloadlen, timer);
+    if (rc == SUCCESS)
     {
         if (this->keepAliveInterval > 0)
             last_sent.countdown(this->keepAliveInterval); // record the fact that we have successfully sent the packet
-        rc = SUCCESS;
     }
+
+#if defined(MQTT_DEBUG)
+    char printbuf[150];
+    if (payloadlen > 0)
+        DEBUG("Rc %d from sending publish of %d bytes with %d bytes of payload\r\n", rc, length, (int)payloadlen)
     else
-        rc = FAILURE;
+        DEBUG("Rc %d from sending packet %s\r\n", rc, 
+            MQTTFormat_toServerString(printbuf, sizeof(printbuf), sendbuf, length));
+#endif
+    return rc;
+}
+
+
+/**
+ * Queue the packet in sendbuf in txbuf, to be sent with any others by flushPackets or the next sendPacket.
+ * A packet which does not fit is sent straight away, after those queued.
+ */
+template<class Network, class Timer, int a, int b>
+int MQTT::Client<Network, Timer, a, b>::queuePacket(int length, Timer& timer)
+{
+    int rc = SUCCESS;
+
+    if (txbuf_len + length > MQTTCLIENT_TX_BUFFER && (rc = flushPackets(timer)) != SUCCESS)
+        return rc;
+    if (length > MQTTCLIENT_TX_BUFFER)
+        return sendPacket(length, timer);
+    memcpy(&txbuf[txbuf_len], sendbuf, length);
+    txbuf_len += length;
 
 #if defined(MQTT_DEBUG)
     char printbuf[150];
-    DEBUG("Rc %d from sending packet %s\r\n", rc, 
-        MQTTFormat_toServerString(printbuf, sizeof(printbuf), sendbuf, length));
+    DEBUG("Queued packet %s\r\n", MQTTFormat_toServerString(printbuf, sizeof(printbuf), sendbuf, length));
 #endif
     return rc;
 }
 
 
+// send the packets queued in txbuf, in one write
+template<class Network, class Timer, int a, int b>
+int MQTT::Client<Network, Timer, a, b>::flushPackets(Timer& timer)
+{
+    int rc = SUCCESS;
+
+    if (txbuf_len == 0)
+        return rc;
+    rc = sendBytes(txbuf, txbuf_len, timer);
+    txbuf_len = 0;
+    if (rc == SUCCESS && this->keepAliveInterval > 0)
+        last_sent.countdown(this->keepAliveInterval);
+    return rc;
+}
+
+
+// whether the packet after the current one is already complete in readbuf, so the next readPacket needs no read
+template<class Network, class Timer, int a, int b>
+bool MQTT::Client<Network, Timer, a, b>::packetWaiting()
+{
+    int left = readbuf_len - packet_len;
+    int rem_len = 0;
+    int n = (left > 1) ? MQTTPacket_decodeLen(&readbuf[packet_len + 1], left - 1, &rem_len) : 0;
+
+    return n > 0 && 1 + n + rem_len <= left;
+}
+
+
+/**
+ * Decode the remaining length of the packet at the start of readbuf, from the bytes read so far
+ * @param value the decoded remaining length
+ * @return the number of remaining length bytes, 0 if more must be read, -1 if they are invalid
+ */
 template<class Network, class Timer, int a, int b>
-int MQTT::Client<Network, Timer, a, b>::decodePacket(int* value, int timeout)
+int MQTT::Client<Network, Timer, a, b>::decodePacket(int* value)
 {
     unsigned char c;
     int multiplier = 1;
@@ -420,16 +1059,17 @@ int MQTT::Client<Network, Timer, a, b>::decodePacket(int* value, int timeout)
     *value = 0;
     do
     {
-        int rc = MQTTPACKET_READ_ERROR;
-
         if (++len > MAX_NO_OF_REMAINING_LENGTH_BYTES)
         {
-            rc = MQTTPACKET_READ_ERROR; /* bad data */
+            len = MQTTPACKET_READ_ERROR; /* bad data */
             goto exit;
         }
-        rc = ipstack.read(&c, 1, timeout);
-        if (rc != 1)
+        if (len >= readbuf_len)
+        {
+            len = 0; /* not read yet */
             goto exit;
+        }
+        c = readbuf[len];
         *value += (c & 127) * multiplier;
         multiplier *= 128;
     } while ((c & 128) != 0);
@@ -439,6 +1079,11 @@ exit:
 
 
 /**
+ * Each network read asks for all the free space in readbuf, so one read can bring in several packets.
+ * Whatever follows the packet returned is kept for the next call, as is a partly read packet when the
+ * timer expires.
+ * A PUBLISH too large for readbuf is returned once its topic and packet id are read, with stream_left
+ * set to the number of payload bytes which must then be read by readPayload.
  * If any read fails in this method, then we should disconnect from the network, as on reconnect
  * the packets can be retried.
  * @param timeout the max time to wait for the packet read to complete, in milliseconds
@@ -452,25 +1097,81 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::readPacket(Timer& tim
     int len = 0;
     int rem_len = 0;
 
-    /* 1. read the header byte.  This has the packet type in it */
-    rc = ipstack.read(readbuf, 1, timer.left_ms());
-    if (rc != 1)
-        goto exit;
-
-    len = 1;
-    /* 2. read the remaining length.  This is variable in itself */
-    decodePacket(&rem_len, timer.left_ms());
-    len += MQTTPacket_encode(readbuf + 1, rem_len); /* put the original remaining length into the buffer */
-
-    if (rem_len > (MAX_MQTT_PACKET_SIZE - len))
+    /* 1. drop the packet returned by the last call, keeping anything read after it */
+    if (packet_len > 0)
     {
-        rc = BUFFER_OVERFLOW;
-        goto exit;
+        readbuf_len -= packet_len;
+        memmove(readbuf, readbuf + packet_len, readbuf_len);
+        packet_len = 0;
     }
 
-    /* 3. read the rest of the buffer using a callback to supply the rest of the data */
-    if (rem_len > 0 && (ipstack.read(readbuf + len, rem_len, timer.left_ms()) != rem_len))
-        goto exit;
+    /* 2. read until readbuf holds the header byte, the remaining length and the rest of the packet */
+    while (true)
+    {
+        if ((len = decodePacket(&rem_len)) < 0)
+        {
+            rc = FAILURE;
+            goto exit;
+        }
+        if (len > 0)
+        {
+            len += 1 + rem_len;
+            if (len <= MAX_MQTT_PACKET_SIZE)
+            {
+                if (len <= readbuf_len)
+                    break;
+            }
+            else
+            {
+                int hdrlen = len - rem_len + 2; // up to the topic length
+                header.byte = readbuf[0];
+                if (header.bits.type != PUBLISH)
+                {
+                    rc = BUFFER_OVERFLOW;
+                    goto exit;
+                }
+                if (hdrlen <= readbuf_len)
+                {
+                    int proplen = 0, n = 0;
+
+                    hdrlen += (readbuf[hdrlen - 2] << 8) + readbuf[hdrlen - 1] + ((header.bits.qos > 0) ? 2 : 0);
+                    if (mqtt_version == 5) // and the properties
+                    {
+                        if (hdrlen >= readbuf_len || (n = MQTTPacket_decodeLen(readbuf + hdrlen, readbuf_len - hdrlen, &proplen)) == 0)
+                            n = readbuf_len + 1 - hdrlen;   // their length is not read yet
+                        else if (n < 0)
+                        {
+                            rc = FAILURE;
+                            goto exit;
+                        }
+                        hdrlen += n + proplen;
+                    }
+                    if (hdrlen >= MAX_MQTT_PACKET_SIZE || hdrlen > len) // no room left for the payload
+                    {
+                        rc = BUFFER_OVERFLOW;
+                        goto exit;
+                    }
+                    if (hdrlen <= readbuf_len)
+                    {
+                        stream_left = len - readbuf_len;
+                        len = hdrlen;
+                        break;
+                    }
+                }
+            }
+        }
+
+        rc = ipstack.read(readbuf + readbuf_len, MAX_MQTT_PACKET_SIZE - readbuf_len, timer.left_ms());
+        if (rc < 0)
+        {
+            rc = FAILURE;
+            goto exit;
+        }
+        readbuf_len += rc;
+        if (rc == 0 && timer.expired())
+            goto exit; // no complete packet yet
+    }
+    packet_len = len;
 
     header.byte = readbuf[0];
     rc = header.bits.type;
@@ -479,7 +1180,9 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::readPacket(Timer& tim
 exit:
 
 #if defined(MQTT_DEBUG)
-    if (rc >= 0)
+    if (rc > 0 && stream_left > 0)
+        DEBUG("Rc %d receiving packet of %d bytes, %d of them to be streamed\r\n", rc, len, stream_left)
+    else if (rc > 0)
     {
         char printbuf[50];
         DEBUG("Rc %d receiving packet %s\r\n", rc, 
@@ -490,66 +1193,109 @@ exit:
 }
 
 
-// assume topic filter and name is in correct format
-// # can only be at end
-// + and # can only be next to separator
-template<class Network, class Timer, int a, int b>
-bool MQTT::Client<Network, Timer, a, b>::isTopicMatched(char* topicFilter, MQTTString& topicName)
+template<class Network, class Timer, int a, int MAX_MESSAGE_HANDLERS>
+int MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::deliverMessage(MQTTString& topicName, Message& message)
 {
-    char* curf = topicFilter;
-    char* curn = topicName.lenstring.data;
-    char* curn_end = curn + topicName.lenstring.len;
-
-    while (*curf && curn < curn_end)
+    int rc = FAILURE;
+    int matches[MAX_MESSAGE_HANDLERS];
+    int count = 0;
+    MQTTString topic = topicName;   // pointed at the pooled copy, if any, until a handler takes it
+    Message msg = message;
+    MessageData md(topic, msg);
+
+    if (stream_left > 0)
+        return readPayload(&topicName, &message);
+
+    // we have to find the right message handlers - found all before calling any, as they can change them
+    count = topicTrie.match(topicName, matches, MAX_MESSAGE_HANDLERS);
+    if (message_pool && (count > 0 || defaultMessageHandler.attached()))
+        md.pooled = pool_alloc(message_pool, topic, msg);
+    for (int j = 0; j < count; ++j)
     {
-        if (*curn == '/' && *curf != '/')
-            break;
-        if (*curf != '+' && *curf != '#' && *curf != *curn)
-            break;
-        if (*curf == '+')
-        {   // skip until we meet the next separator, or end of string
-            char* nextpos = curn + 1;
-            while (nextpos < curn_end && *nextpos != '/')
-                nextpos = ++curn + 1;
+        int i = matches[j];
+        PooledMessage* pm = md.pooled;
+
+        if (messageHandlers[i].topicFilter == 0)
+            continue;
+        if (messageHandlers[i].fp.attached())
+        {
+            messageHandlers[i].fp(md);
+            rc = SUCCESS;
+        }
+        else if (messageHandlers[i].sfp.attached())
+        {
+            MessageChunkData mcd(topic, msg, 0, msg.payloadlen);
+            messageHandlers[i].sfp(mcd);
+            rc = SUCCESS;
         }
-        else if (*curf == '#')
-            curn = curn_end - 1;    // skip until end of string
-        curf++;
-        curn++;
-    };
+        if (pm && md.pooled == 0)
+        {
+            topic = topicName;  // taken, so no longer ours to pass on
+            msg = message;
+        }
+    }
 
-    return (curn == curn_end) && (*curf == '\0');
-}
+    if (rc == FAILURE && defaultMessageHandler.attached())
+    {
+        defaultMessageHandler(md);
+        rc = SUCCESS;
+    }
 
+    if (md.pooled)
+        pool_release(message_pool, md.pooled);
+    return rc;
+}
 
 
-template<class Network, class Timer, int a, int MAX_MESSAGE_HANDLERS>
-int MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::deliverMessage(MQTTString& topicName, Message& message)
+/**
+ * Read the rest of the payload of a streamed PUBLISH through the free part of readbuf, passing each chunk
+ * to the matching stream handlers, or discarding it if topicName is 0
+ * @return success code - on failure stream_left is set to -1
+ */
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::readPayload(MQTTString* topicName, Message* message)
 {
-    int rc = FAILURE;
-
-    // we have to find the right message handler - indexed by topic
-    for (int i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
+    int rc = topicName ? FAILURE : SUCCESS;
+    Timer timer(command_timeout_ms);
+    size_t total = message ? message->payloadlen : 0;
+    size_t offset = 0;
+    unsigned char* chunk = readbuf + packet_len;
+    int chunklen = readbuf_len - packet_len;    // read ahead with the topic
+    int matches[MAX_MESSAGE_HANDLERS];
+    int count = (topicName) ? topicTrie.match(*topicName, matches, MAX_MESSAGE_HANDLERS) : 0;
+
+    while (true)
     {
-        if (messageHandlers[i].topicFilter != 0 && (MQTTPacket_equals(&topicName, (char*)messageHandlers[i].topicFilter) ||
-                isTopicMatched((char*)messageHandlers[i].topicFilter, topicName)))
+        for (int j = 0; chunklen > 0 && j < count; ++j)
         {
-            if (messageHandlers[i].fp.attached())
+            int i = matches[j];
+
+            if (messageHandlers[i].topicFilter != 0 && messageHandlers[i].sfp.attached())
             {
-                MessageData md(topicName, message);
-                messageHandlers[i].fp(md);
+                message->payload = chunk;
+                message->payloadlen = chunklen;
+                MessageChunkData mcd(*topicName, *message, offset, total);
+                messageHandlers[i].sfp(mcd);
                 rc = SUCCESS;
             }
         }
-    }
+        offset += chunklen;
+        if (stream_left == 0)
+            break;
 
-    if (rc == FAILURE && defaultMessageHandler.attached())
-    {
-        MessageData md(topicName, message);
-        defaultMessageHandler(md);
-        rc = SUCCESS;
+        chunklen = ipstack.read(chunk, (stream_left < MAX_MQTT_PACKET_SIZE - packet_len) ? stream_left : MAX_MQTT_PACKET_SIZE - packet_len,
+                                timer.left_ms());
+        if (chunklen < 0 || (chunklen == 0 && timer.expired()))
+        {
+            stream_left = -1;
+            return FAILURE;
+        }
+        stream_left -= chunklen;
     }
+    readbuf_len = packet_len;
 
+    if (topicName && rc == FAILURE)
+        WARN("No stream handler for a message too large for the read buffer, so it is not acknowledged\r\n");
     return rc;
 }
 
@@ -562,6 +1308,18 @@ int MQTT::Client<Network, Timer, a, b>::yield(unsigned long timeout_ms)
     Timer timer;
 
     timer.countdown_ms(timeout_ms);
+    while (!isconnected && reconnect_session)
+    {
+        int sleep_ms;
+
+        if (reconnect_timer.expired() && reconnect() == SUCCESS)
+            break;
+        if (timer.expired())
+            return FAILURE;
+        // sleep until the next attempt or the timeout, rather than have a yield loop spin
+        sleep_ms = (reconnect_timer.left_ms() < timer.left_ms()) ? reconnect_timer.left_ms() : timer.left_ms();
+        MQTTCLIENT_SLEEP_MS((sleep_ms > 0) ? sleep_ms : 1);
+    }
     while (!timer.expired())
     {
         if (cycle(timer) < 0)
@@ -593,34 +1351,80 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::cycle(Timer& timer)
         case 0: // timed out reading packet
             break;
         case CONNACK:
-        case PUBACK:
         case SUBACK:
+        case UNSUBACK:
+#if !MQTTCLIENT_QOS1 && !MQTTCLIENT_QOS2
+        case PUBACK:
+#endif
             break;
+#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+        case PUBACK:
+        {
+            unsigned short mypacketid;
+            unsigned char dup, type, reason;
+            MQTTProperties properties = MQTTProperties_initializer;
+            InflightMessage* msg;
+            if (MQTTV5Deserialize_ack(&type, &dup, &mypacketid, &reason, (mqtt_version == 5) ? &properties : 0,
+                                      readbuf, MAX_MQTT_PACKET_SIZE) != 1)
+            {
+                rc = FAILURE;
+                goto exit;
+            }
+            if ((msg = findInflight(mypacketid)) != 0 && msg->qos == QOS1)
+                completeInflight(msg, (reason < 0x80) ? SUCCESS : FAILURE);
+            break;
+        }
+#endif
         case PUBLISH:
         {
             MQTTString topicName = MQTTString_initializer;
+            MQTTProperties properties = MQTTProperties_initializer;
             Message msg;
             int intQoS;
+            bool ack = (stream_left == 0);  // one too large for readbuf only if a stream handler takes it
             msg.payloadlen = 0; /* this is a size_t, but deserialize publish sets this as int */
-            if (MQTTDeserialize_publish((unsigned char*)&msg.dup, &intQoS, (unsigned char*)&msg.retained, (unsigned short*)&msg.id, &topicName,
-                                 (unsigned char**)&msg.payload, (int*)&msg.payloadlen, readbuf, MAX_MQTT_PACKET_SIZE) != 1)
+            if (MQTTV5Deserialize_publish((unsigned char*)&msg.dup, &intQoS, (unsigned char*)&msg.retained, (unsigned short*)&msg.id, &topicName,
+                                 (mqtt_version == 5) ? &properties : 0, (unsigned char**)&msg.payload, (int*)&msg.payloadlen,
+                                 readbuf, MAX_MQTT_PACKET_SIZE) != 1)
                 goto exit;
             msg.qos = (enum QoS)intQoS;
 #if MQTTCLIENT_QOS2
             if (msg.qos != QOS2)
 #endif
-                deliverMessage(topicName, msg);
+                ack = (deliverMessage(topicName, msg) == SUCCESS) || ack;
 #if MQTTCLIENT_QOS2
             else if (isQoS2msgidFree(msg.id))
             {
                 if (useQoS2msgid(msg.id))
-                    deliverMessage(topicName, msg);
+                    ack = (deliverMessage(topicName, msg) == SUCCESS) || ack;
+                else if (mqtt_version == 5)
+                {
+                    // beyond the Receive Maximum of the CONNECT, which is a protocol error
+                    if ((len = MQTTV5Serialize_disconnect(sendbuf, MAX_MQTT_PACKET_SIZE, 0x93, 0)) > 0)
+                        sendPacket(len, timer);
+                    rc = FAILURE;
+                    goto exit;
+                }
                 else
-                    WARN("Maximum number of incoming QoS2 messages exceeded");
+                {
+                    WARN("Incoming QoS 2 window full, message %d delivered without its id recorded\r\n", msg.id);
+                    ack = (deliverMessage(topicName, msg) == SUCCESS) || ack;
+                }
+                if (!ack)
+                    freeQoS2msgid(msg.id);  // so that it is delivered when sent again
             }
+            else
+                ack = true;     // delivered before, so the PUBREC is sent again
 #endif
+            if (stream_left > 0)
+                readPayload(0, 0); // not delivered, but the payload must still be read
+            if (stream_left != 0)
+            {
+                rc = FAILURE;
+                goto exit;
+            }
 #if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
-            if (msg.qos != QOS0)
+            if (msg.qos != QOS0 && ack)
             {
                 if (msg.qos == QOS1)
                     len = MQTTSerialize_ack(sendbuf, MAX_MQTT_PACKET_SIZE, PUBACK, 0, msg.id);
@@ -629,7 +1433,7 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::cycle(Timer& timer)
                 if (len <= 0)
                     rc = FAILURE;
                 else
-                    rc = sendPacket(len, timer);
+                    rc = queuePacket(len, timer);
                 if (rc == FAILURE)
                     goto exit; // there was a problem
             }
@@ -639,32 +1443,71 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::cycle(Timer& timer)
 #if MQTTCLIENT_QOS2
         case PUBREC:
         case PUBREL:
+        {
             unsigned short mypacketid;
-            unsigned char dup, type;
-            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, readbuf, MAX_MQTT_PACKET_SIZE) != 1)
+            unsigned char dup, type, reason;
+            MQTTProperties properties = MQTTProperties_initializer;
+            InflightMessage* msg;
+            if (MQTTV5Deserialize_ack(&type, &dup, &mypacketid, &reason, (mqtt_version == 5) ? &properties : 0,
+                                      readbuf, MAX_MQTT_PACKET_SIZE) != 1)
                 rc = FAILURE;
+            else if (packet_type == PUBREC && reason >= 0x80)
+            {
+                if ((msg = findInflight(mypacketid)) != 0 && msg->qos == QOS2)
+                    completeInflight(msg, FAILURE);   // refused, so the exchange ends here
+                break;
+            }
             else if ((len = MQTTSerialize_ack(sendbuf, MAX_MQTT_PACKET_SIZE,
                                  (packet_type == PUBREC) ? PUBREL : PUBCOMP, 0, mypacketid)) <= 0)
                 rc = FAILURE;
-            else if ((rc = sendPacket(len, timer)) != SUCCESS) // send the PUBREL packet
+            else if ((rc = queuePacket(len, timer)) != SUCCESS) // queue the PUBREL or PUBCOMP packet
                 rc = FAILURE; // there was a problem
             if (rc == FAILURE)
                 goto exit; // there was a problem
             if (packet_type == PUBREL)
                 freeQoS2msgid(mypacketid);
+            else if ((msg = findInflight(mypacketid)) != 0)
+                msg->pubrel = true;
             break;
+        }
 
         case PUBCOMP:
+        {
+            unsigned short mypacketid;
+            unsigned char dup, type, reason;
+            MQTTProperties properties = MQTTProperties_initializer;
+            InflightMessage* msg;
+            if (MQTTV5Deserialize_ack(&type, &dup, &mypacketid, &reason, (mqtt_version == 5) ? &properties : 0,
+                                      readbuf, MAX_MQTT_PACKET_SIZE) != 1)
+            {
+                rc = FAILURE;
+                goto exit;
+            }
+            if ((msg = findInflight(mypacketid)) != 0 && msg->qos == QOS2)
+                completeInflight(msg, (reason < 0x80) ? SUCCESS : FAILURE);
             break;
+        }
 #endif
         case PINGRESP:
             ping_outstanding = false;
             break;
+        case DISCONNECT:    // from an MQTT 5 server
+        {
+            unsigned char reason = 0;
+            MQTTProperties properties = MQTTProperties_initializer;
+            if (MQTTV5Deserialize_disconnect(&properties, &reason, readbuf, MAX_MQTT_PACKET_SIZE) == 1)
+                WARN("Disconnected by the server, reason code 0x%x\r\n", reason);
+            rc = FAILURE;
+            goto exit;
+        }
     }
 
     if (keepalive() != SUCCESS)
         //check only keepalive FAILURE status so that previous FAILURE status can be considered as FAULT
         rc = FAILURE;
+    // acks are gathered while the packets they answer are already read, then sent in one write
+    else if ((timer.expired() || !packetWaiting()) && flushPackets(timer) != SUCCESS)
+        rc = FAILURE;
 
 exit:
     if (rc == SUCCESS)
@@ -679,7 +1522,6 @@ template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
 int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::keepalive()
 {
     int rc = SUCCESS;
-    static Timer ping_sent;
 
     if (keepAliveInterval == 0)
         goto exit;
@@ -698,7 +1540,7 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::keepalive()
     {
         Timer timer(1000);
         int len = MQTTSerialize_pingreq(sendbuf, MAX_MQTT_PACKET_SIZE);
-        if (len > 0 && (rc = sendPacket(len, timer)) == SUCCESS) // send the ping packet
+        if (len > 0 && (rc = sendPacket(len, timer)) == SUCCESS) // send the ping packet, with any acks queued
         {
             ping_outstanding = true;
             ping_sent.countdown(this->keepAliveInterval);
@@ -709,6 +1551,71 @@ exit:
 }
 
 
+// post the keepaliveEvent for when the next ping, PINGRESP or reconnect is due, or cancel it if none is
+template<class Network, class Timer, int a, int b>
+void MQTT::Client<Network, Timer, a, b>::scheduleKeepalive()
+{
+    int delay_ms = 0;
+
+    if (keepalive_queue == 0)
+        return;
+    if (isconnected && keepAliveInterval > 0)
+    {
+        if (ping_outstanding)
+            delay_ms = ping_sent.left_ms();
+        else
+        {
+            delay_ms = last_sent.left_ms();
+            if (last_received.left_ms() < delay_ms)
+                delay_ms = last_received.left_ms();
+        }
+    }
+    else if (!isconnected && reconnect_session)
+        delay_ms = reconnect_timer.left_ms();
+    else
+    {
+        keepalive_post(this, -1);
+        return;
+    }
+    keepalive_post(this, (delay_ms < 0) ? 0 : delay_ms);
+}
+
+
+template<class Network, class Timer, int a, int b>
+void MQTT::Client<Network, Timer, a, b>::keepaliveEvent()
+{
+    Timer timer(0);     // expired, so only what has already been received is read
+
+    keepalive_event = 0;
+    if (!isconnected && reconnect_session && reconnect_timer.expired())
+        reconnect();
+    while (isconnected && cycle(timer) > 0)
+        ;   // each cycle runs the keepalive, even when no packet was read
+    scheduleKeepalive();
+}
+
+
+// called from the Network's sigio, which can be in interrupt context, so only posts readEvent
+template<class Network, class Timer, int a, int b>
+void MQTT::Client<Network, Timer, a, b>::readable()
+{
+    if (keepalive_queue)
+        read_post(this, true);
+}
+
+
+template<class Network, class Timer, int a, int b>
+void MQTT::Client<Network, Timer, a, b>::readEvent()
+{
+    Timer timer(0);
+
+    read_event = 0;     // so that data arriving from now on posts another
+    while (isconnected && cycle(timer) > 0)
+        ;
+    scheduleKeepalive();
+}
+
+
 // only used in single-threaded mode where one command at a time is in process
 template<class Network, class Timer, int a, int b>
 int MQTT::Client<Network, Timer, a, b>::waitfor(int packet_type, Timer& timer)
@@ -723,6 +1630,11 @@ int MQTT::Client<Network, Timer, a, b>::waitfor(int packet_type, Timer& timer)
     }
     while (rc != packet_type && rc >= 0);
 
+    if (rc == packet_type && flushPackets(timer) != SUCCESS) // acks for packets read on the way
+    {
+        closeSession();
+        rc = FAILURE;
+    }
     return rc;
 }
 
@@ -739,7 +1651,33 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::connect(MQTTPacket_co
 
     this->keepAliveInterval = options.keepAliveInterval;
     this->cleansession = options.cleansession;
-    if ((len = MQTTSerialize_connect(sendbuf, MAX_MQTT_PACKET_SIZE, &options)) <= 0)
+    connect_options = options;
+    readbuf_len = packet_len = stream_left = 0; // anything read ahead belongs to the previous connection
+    txbuf_len = 0;
+    mqtt_version = options.MQTTVersion;
+    topic_alias_max = 0;
+    receive_max = 65535;
+    max_packet_size = 0;
+    for (int i = 0; i <= MQTTCLIENT_TOPIC_ALIASES; ++i)
+        topic_aliases[i] = 0;
+    if (mqtt_version == 5)
+    {
+        // keep the session after the connection closes, as MQTT 3 does, unless it is clean
+        MQTTProperty property[2];
+        MQTTProperties properties = {0, 2, 0, property};
+        MQTTProperty expiry = {MQTTPROPERTY_CODE_SESSION_EXPIRY_INTERVAL, 0xFFFFFFFF};
+        if (!options.cleansession)
+            MQTTProperties_add(&properties, &expiry);
+#if MQTTCLIENT_QOS2
+        // no more QoS 1 and 2 publishes unacknowledged at once than the QoS 2 window holds
+        MQTTProperty receive = {MQTTPROPERTY_CODE_RECEIVE_MAXIMUM, MAX_INCOMING_QOS2_MESSAGES};
+        MQTTProperties_add(&properties, &receive);
+#endif
+        len = MQTTV5Serialize_connect(sendbuf, MAX_MQTT_PACKET_SIZE, &options, &properties, 0);
+    }
+    else
+        len = MQTTSerialize_connect(sendbuf, MAX_MQTT_PACKET_SIZE, &options);
+    if (len <= 0)
         goto exit;
     if ((rc = sendPacket(len, connect_timer)) != SUCCESS)  // send the connect packet
         goto exit; // there was a problem
@@ -748,35 +1686,14 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::connect(MQTTPacket_co
         last_received.countdown(this->keepAliveInterval);
     // this will be a blocking call, wait for the connack
     if (waitfor(CONNACK, connect_timer) == CONNACK)
-    {
-        data.rc = 0;
-        data.sessionPresent = false;
-        if (MQTTDeserialize_connack((unsigned char*)&data.sessionPresent,
-                            (unsigned char*)&data.rc, readbuf, MAX_MQTT_PACKET_SIZE) == 1)
-            rc = data.rc;
-        else
-            rc = FAILURE;
-    }
+        rc = deserializeConnack(data);
     else
         rc = FAILURE;
 
-#if MQTTCLIENT_QOS2
-    // resend any inflight publish
-    if (inflightMsgid > 0 && inflightQoS == QOS2 && pubrel)
-    {
-        if ((len = MQTTSerialize_ack(sendbuf, MAX_MQTT_PACKET_SIZE, PUBREL, 0, inflightMsgid)) <= 0)
-            rc = FAILURE;
-        else
-            rc = publish(len, connect_timer, inflightQoS);
-    }
-    else
-#endif
 #if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
-    if (inflightMsgid > 0)
-    {
-        memcpy(sendbuf, pubbuf, MAX_MQTT_PACKET_SIZE);
-        rc = publish(inflightLen, connect_timer, inflightQoS);
-    }
+    // resend any inflight publishes - their acks are processed as they arrive
+    if (rc == SUCCESS)
+        rc = resendInflight(connect_timer);
 #endif
 
 exit:
@@ -784,11 +1701,44 @@ exit:
     {
         isconnected = true;
         ping_outstanding = false;
+        reconnect_session = (reconnect_hostname != 0);
+        reconnect_attempts = 0;
+        scheduleKeepalive();
     }
     return rc;
 }
 
 
+/**
+ * Read the CONNACK in readbuf, and with MQTT 5 the server's topic alias maximum, keepalive, receive maximum
+ * and maximum packet size from its properties
+ * @return the return or reason code, or FAILURE if the CONNACK cannot be read
+ */
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::deserializeConnack(connackData& data)
+{
+    MQTTProperty property[MQTTCLIENT_CONNACK_PROPERTIES];
+    MQTTProperties properties = {0, MQTTCLIENT_CONNACK_PROPERTIES, 0, property};
+    unsigned int value = 0;
+
+    data.rc = 0;
+    data.sessionPresent = false;
+    if (MQTTV5Deserialize_connack((mqtt_version == 5) ? &properties : 0, (unsigned char*)&data.sessionPresent,
+                                  (unsigned char*)&data.rc, readbuf, MAX_MQTT_PACKET_SIZE) != 1)
+        return FAILURE;
+
+    if (MQTTProperties_getNumericValue(&properties, MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM, &value))
+        topic_alias_max = (value < MQTTCLIENT_TOPIC_ALIASES) ? value : MQTTCLIENT_TOPIC_ALIASES;
+    if (MQTTProperties_getNumericValue(&properties, MQTTPROPERTY_CODE_SERVER_KEEP_ALIVE, &value))
+        keepAliveInterval = value;
+    if (MQTTProperties_getNumericValue(&properties, MQTTPROPERTY_CODE_RECEIVE_MAXIMUM, &value) && value > 0)
+        receive_max = value;
+    if (MQTTProperties_getNumericValue(&properties, MQTTPROPERTY_CODE_MAXIMUM_PACKET_SIZE, &value))
+        max_packet_size = value;
+    return data.rc;
+}
+
+
 template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
 int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::connect(MQTTPacket_connectData& options)
 {
@@ -805,43 +1755,156 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::connect()
 }
 
 
-template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
-int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::setMessageHandler(const char* topicFilter, messageHandler messageHandler)
+template<class Network, class Timer, int a, int b>
+int MQTT::Client<Network, Timer, a, b>::reconnect()
 {
     int rc = FAILURE;
-    int i = -1;
+    connackData data;
+    Timer timer(command_timeout_ms);
+
+    if (reconnect_network(this) != 0)
+        goto exit;
+    if ((rc = connect(connect_options, data)) != SUCCESS)
+        goto exit;
+    if (!data.sessionPresent)
+        rc = resubscribe(timer);
 
-    // first check for an existing matching slot
-    for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
+exit:
+    if (rc != SUCCESS)
     {
-        if (messageHandlers[i].topicFilter != 0 && strcmp(messageHandlers[i].topicFilter, topicFilter) == 0)
+        if (isconnected)
+            closeSession();     // which sets the time of the next attempt
+        else
         {
-            if (messageHandler == 0) // remove existing
-            {
-                messageHandlers[i].topicFilter = 0;
-                messageHandlers[i].fp.detach();
-            }
-            rc = SUCCESS; // return i when adding new subscription
-            break;
+            backoff();
+            scheduleKeepalive();
+        }
+    }
+    return rc;
+}
+
+
+// subscribe again to the topic filters of the handlers subscribed to
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::resubscribe(Timer& timer)
+{
+    int rc = SUCCESS;
+    MQTTString topics[MAX_MESSAGE_HANDLERS];
+    int qoss[MAX_MESSAGE_HANDLERS];
+    int granted[MAX_MESSAGE_HANDLERS];
+    int count = 0;
+
+    for (int i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
+    {
+        if (messageHandlers[i].topicFilter != 0 && messageHandlers[i].qos >= 0)
+        {
+            MQTTString topic = {(char*)messageHandlers[i].topicFilter, {0, 0}};
+            topics[count] = topic;
+            qoss[count++] = messageHandlers[i].qos;
         }
     }
-    // if no existing, look for empty slot (unless we are removing)
-    if (messageHandler != 0) {
-        if (rc == FAILURE)
+
+    if ((rc = sendSubscribes(count, topics, qoss, granted, timer)) == SUCCESS)
+    {
+        for (int i = 0; i < count; ++i)
         {
-            for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
-            {
-                if (messageHandlers[i].topicFilter == 0)
-                {
-                    rc = SUCCESS;
-                    break;
-                }
-            }
+            if (granted[i] >= 0x80)
+                WARN("Subscription to %s refused on reconnect\r\n", topics[i].cstring);
         }
-        if (i < MAX_MESSAGE_HANDLERS)
+    }
+    return rc;
+}
+
+
+// the slot holding the handler for this topic filter, or else the first empty slot, or -1 if none is free
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::handlerSlot(const char* topicFilter)
+{
+    int empty = -1;
+
+    for (int i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
+    {
+        if (messageHandlers[i].topicFilter == 0)
+        {
+            if (empty == -1)
+                empty = i;
+        }
+        else if (strcmp(messageHandlers[i].topicFilter, topicFilter) == 0)
+            return i;
+    }
+    return empty;
+}
+
+
+// rebuild the topic index from the message handlers
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
+bool MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::indexHandlers()
+{
+    topicTrie.clear();
+    for (int i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
+    {
+        if (messageHandlers[i].topicFilter != 0 && !topicTrie.add(messageHandlers[i].topicFilter, i))
+            return false;
+    }
+    return true;
+}
+
+
+// whether handlers for the topic filters would fit, both in messageHandlers and in the topic index, so
+// that nothing is subscribed to which no handler can be set for
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
+bool MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::handlersFit(int count, const char** topicFilters)
+{
+    int empty = 0;
+    bool fits = true;
+
+    for (int i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
+    {
+        if (messageHandlers[i].topicFilter == 0)
+            ++empty;
+    }
+    for (int i = 0; fits && i < count; ++i)
+    {
+        int slot = handlerSlot(topicFilters[i]);
+
+        if (slot >= 0 && messageHandlers[slot].topicFilter != 0)
+            continue;   // already has a handler, and its place in the index
+        fits = (--empty >= 0) && topicTrie.add(topicFilters[i], MAX_MESSAGE_HANDLERS);
+    }
+    indexHandlers();    // without the filters tried
+    return fits;
+}
+
+
+// set one of the handlers for a topic filter, or remove it if both are 0
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::setHandler(const char* topicFilter,
+     messageHandler messageHandler, streamHandler streamHandler)
+{
+    int rc = FAILURE;
+    int i = handlerSlot(topicFilter);
+
+    if (i >= 0 && (messageHandler != 0 || streamHandler != 0 || messageHandlers[i].topicFilter != 0))
+    {
+        if (messageHandlers[i].topicFilter == 0)
+            messageHandlers[i].qos = -1;    // not subscribed, unless by subscribe after this
+        messageHandlers[i].topicFilter = 0;
+        messageHandlers[i].fp.detach();
+        messageHandlers[i].sfp.detach();
+        if (messageHandler != 0 || streamHandler != 0)
         {
             messageHandlers[i].topicFilter = topicFilter;
-            messageHandlers[i].fp.attach(messageHandler);
+            if (messageHandler != 0)
+                messageHandlers[i].fp.attach(messageHandler);
+            else
+                messageHandlers[i].sfp.attach(streamHandler);
+        }
+        rc = SUCCESS;
+        if (!indexHandlers())
+        {
+            messageHandlers[i].topicFilter = 0; // no room in the topic index for a new filter
+            indexHandlers();
+            rc = FAILURE;
         }
     }
     return rc;
@@ -849,40 +1912,139 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::se
 
 
 template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
-int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::subscribe(const char* topicFilter,
-     enum QoS qos, messageHandler messageHandler, subackData& data)
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::setMessageHandler(const char* topicFilter, messageHandler messageHandler)
+{
+    return setHandler(topicFilter, messageHandler, 0);
+}
+
+
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::setStreamHandler(const char* topicFilter, streamHandler streamHandler)
+{
+    return setHandler(topicFilter, 0, streamHandler);
+}
+
+
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::sendSubscribe(const char* topicFilter,
+     enum QoS qos, subackData& data)
 {
     int rc = FAILURE;
     Timer timer(command_timeout_ms);
-    int len = 0;
     MQTTString topic = {(char*)topicFilter, {0, 0}};
+    int requested = qos;
 
     if (!isconnected)
         goto exit;
 
-    len = MQTTSerialize_subscribe(sendbuf, MAX_MQTT_PACKET_SIZE, 0, packetid.getNext(), 1, &topic, (int*)&qos);
-    if (len <= 0)
-        goto exit;
-    if ((rc = sendPacket(len, timer)) != SUCCESS) // send the subscribe packet
-        goto exit;             // there was a problem
+    rc = sendSubscribes(1, &topic, &requested, &data.grantedQoS, timer);
 
-    if (waitfor(SUBACK, timer) == SUBACK)      // wait for suback
+exit:
+    if (rc == FAILURE && isconnected)
+        closeSession();
+    return rc;
+}
+
+
+// send subscribe packets for the topic filters, as many in each as fit, and wait for their subacks
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::sendSubscribes(int count, MQTTString* topics,
+     int* qoss, int* granted, Timer& timer)
+{
+    int rc = SUCCESS;
+
+    for (int first = 0; first < count && rc == SUCCESS; )
     {
-        int count = 0;
-        unsigned short mypacketid;
-        data.grantedQoS = 0;
-        if (MQTTDeserialize_suback(&mypacketid, 1, &count, &data.grantedQoS, readbuf, MAX_MQTT_PACKET_SIZE) == 1)
+        unsigned short id = packetid.getNext();
+        int n = count - first;
+        int len = 0;
+
+        MQTTProperties properties = MQTTProperties_initializer;
+
+        while ((len = MQTTV5Serialize_subscribe(sendbuf, MAX_MQTT_PACKET_SIZE, 0, id, (mqtt_version == 5) ? &properties : 0,
+                                                n, &topics[first], &qoss[first])) <= 0 && n > 1)
+            --n;
+        if (len <= 0 || (rc = sendPacket(len, timer)) != SUCCESS) // send the subscribe packet
+            rc = FAILURE;
+        else if (waitfor(SUBACK, timer) == SUBACK)      // wait for suback
         {
-            if (data.grantedQoS != 0x80)
-                rc = setMessageHandler(topicFilter, messageHandler);
+            unsigned short mypacketid;
+            int grantedcount = 0;
+            if (MQTTV5Deserialize_suback(&mypacketid, (mqtt_version == 5) ? &properties : 0, n, &grantedcount, &granted[first],
+                                         readbuf, MAX_MQTT_PACKET_SIZE) != 1)
+                grantedcount = 0;
+            for (int i = grantedcount; i < n; ++i)
+                granted[first + i] = 0x80;  // missing from the suback
         }
+        else
+            rc = FAILURE;
+        first += n;
     }
-    else
-        rc = FAILURE;
+    return rc;
+}
 
-exit:
-    if (rc == FAILURE)
-        closeSession();
+
+// send unsubscribe packets for the topic filters, as many in each as fit, and wait for their unsubacks
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::sendUnsubscribes(int count, MQTTString* topics,
+     Timer& timer)
+{
+    int rc = SUCCESS;
+
+    for (int first = 0; first < count && rc == SUCCESS; )
+    {
+        unsigned short id = packetid.getNext();
+        int n = count - first;
+        int len = 0;
+
+        MQTTProperties properties = MQTTProperties_initializer;
+
+        while ((len = MQTTV5Serialize_unsubscribe(sendbuf, MAX_MQTT_PACKET_SIZE, 0, id, (mqtt_version == 5) ? &properties : 0,
+                                                  n, &topics[first])) <= 0 && n > 1)
+            --n;
+        if (len <= 0 || (rc = sendPacket(len, timer)) != SUCCESS) // send the unsubscribe packet
+            rc = FAILURE;
+        else if (waitfor(UNSUBACK, timer) == UNSUBACK)
+        {
+            unsigned short mypacketid;  // should be the same as the packetid above
+            int reasoncount = 0;
+            if (MQTTV5Deserialize_unsuback(&mypacketid, (mqtt_version == 5) ? &properties : 0, 0, &reasoncount, 0,
+                                           readbuf, MAX_MQTT_PACKET_SIZE) == 1)
+            {
+                // remove the subscription message handlers associated with these topics, if there are any
+                for (int i = first; i < first + n; ++i)
+                    setHandler(topics[i].cstring, 0, 0);
+            }
+        }
+        else
+            rc = FAILURE;
+        first += n;
+    }
+    return rc;
+}
+
+
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::subscribe(const char* topicFilter,
+     enum QoS qos, messageHandler messageHandler, subackData& data)
+{
+    int rc = handlersFit(1, &topicFilter) ? sendSubscribe(topicFilter, qos, data) : FAILURE;
+
+    if (rc == SUCCESS && data.grantedQoS < 0x80 && (rc = setMessageHandler(topicFilter, messageHandler)) == SUCCESS)
+        messageHandlers[handlerSlot(topicFilter)].qos = qos;
+    return rc;
+}
+
+
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::subscribeStream(const char* topicFilter,
+     enum QoS qos, streamHandler streamHandler)
+{
+    subackData data;
+    int rc = handlersFit(1, &topicFilter) ? sendSubscribe(topicFilter, qos, data) : FAILURE;
+
+    if (rc == SUCCESS && data.grantedQoS < 0x80 && (rc = setStreamHandler(topicFilter, streamHandler)) == SUCCESS)
+        messageHandlers[handlerSlot(topicFilter)].qos = qos;
     return rc;
 }
 
@@ -897,130 +2059,246 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::su
 
 template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
 int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::unsubscribe(const char* topicFilter)
+{
+    return unsubscribe(1, &topicFilter);
+}
+
+
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::unsubscribe(int count, const char** topicFilters)
 {
     int rc = FAILURE;
     Timer timer(command_timeout_ms);
-    MQTTString topic = {(char*)topicFilter, {0, 0}};
-    int len = 0;
-
-    if (!isconnected)
-        goto exit;
+    MQTTString topics[MAX_MESSAGE_HANDLERS];
 
-    if ((len = MQTTSerialize_unsubscribe(sendbuf, MAX_MQTT_PACKET_SIZE, 0, packetid.getNext(), 1, &topic)) <= 0)
+    if (!isconnected || count > MAX_MESSAGE_HANDLERS)
         goto exit;
-    if ((rc = sendPacket(len, timer)) != SUCCESS) // send the unsubscribe packet
-        goto exit; // there was a problem
 
-    if (waitfor(UNSUBACK, timer) == UNSUBACK)
+    for (int i = 0; i < count; ++i)
     {
-        unsigned short mypacketid;  // should be the same as the packetid above
-        if (MQTTDeserialize_unsuback(&mypacketid, readbuf, MAX_MQTT_PACKET_SIZE) == 1)
-        {
-            // remove the subscription message handler associated with this topic, if there is one
-            setMessageHandler(topicFilter, 0);
-        }
+        MQTTString topic = {(char*)topicFilters[i], {0, 0}};
+        topics[i] = topic;
     }
-    else
-        rc = FAILURE;
+    rc = sendUnsubscribes(count, topics, timer);
 
 exit:
-    if (rc != SUCCESS)
+    if (rc != SUCCESS && isconnected)
         closeSession();
     return rc;
 }
 
 
-template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
-int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(int len, Timer& timer, enum QoS qos)
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::subscribe(int count, const char** topicFilters,
+     enum QoS* qos, messageHandler* mhs, int* grantedQoSs)
 {
-    int rc;
+    int rc = FAILURE;
+    Timer timer(command_timeout_ms);
+    MQTTString topics[MAX_MESSAGE_HANDLERS];
+    int qoss[MAX_MESSAGE_HANDLERS];
+    int granted[MAX_MESSAGE_HANDLERS];
 
-    if ((rc = sendPacket(len, timer)) != SUCCESS) // send the publish packet
-        goto exit; // there was a problem
+    if (!isconnected || count > MAX_MESSAGE_HANDLERS || !handlersFit(count, topicFilters))
+        goto exit;
 
-#if MQTTCLIENT_QOS1
-    if (qos == QOS1)
+    for (int i = 0; i < count; ++i)
     {
-        if (waitfor(PUBACK, timer) == PUBACK)
-        {
-            unsigned short mypacketid;
-            unsigned char dup, type;
-            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, readbuf, MAX_MQTT_PACKET_SIZE) != 1)
-                rc = FAILURE;
-            else if (inflightMsgid == mypacketid)
-                inflightMsgid = 0;
-        }
-        else
-            rc = FAILURE;
+        MQTTString topic = {(char*)topicFilters[i], {0, 0}};
+        topics[i] = topic;
+        qoss[i] = qos[i];
     }
-#endif
-#if MQTTCLIENT_QOS2
-    else if (qos == QOS2)
+    if ((rc = sendSubscribes(count, topics, qoss, granted, timer)) != SUCCESS)
     {
-        if (waitfor(PUBCOMP, timer) == PUBCOMP)
-        {
-            unsigned short mypacketid;
-            unsigned char dup, type;
-            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, readbuf, MAX_MQTT_PACKET_SIZE) != 1)
-                rc = FAILURE;
-            else if (inflightMsgid == mypacketid)
-                inflightMsgid = 0;
-        }
+        if (isconnected)
+            closeSession();
+        goto exit;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (grantedQoSs)
+            grantedQoSs[i] = granted[i];
+        if (granted[i] >= 0x80)
+            continue;
+        if (setMessageHandler(topicFilters[i], mhs[i]) == SUCCESS)
+            messageHandlers[handlerSlot(topicFilters[i])].qos = qos[i];
         else
             rc = FAILURE;
     }
-#endif
 
 exit:
-    if (rc != SUCCESS)
-        closeSession();
     return rc;
 }
 
 
+/**
+ * Serialize a publish into sendbuf.  If the whole packet does not fit, only the part before the payload
+ * is, and streamlen is set to the number of payload bytes to be sent after it.
+ * @param prepared - topicName prepared, or 0
+ * @return the length of the serialized data.  <= 0 indicates error
+ */
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::serializePublish(unsigned char dup, enum QoS qos, bool retained,
+    unsigned short id, const char* topicName, void* payload, size_t payloadlen, size_t& streamlen, MQTTPreparedTopic* prepared)
+{
+    MQTTString topicString = MQTTString_initializer;
+    int len;
+
+    topicString.cstring = (char*)topicName;
+    streamlen = 0;
+    if (mqtt_version == 5)
+    {
+        MQTTProperty property;
+        MQTTProperties properties = {0, 1, 0, &property};
+        MQTTProperty alias = {MQTTPROPERTY_CODE_TOPIC_ALIAS, 0};
+
+        if (prepared && (alias.value = topicAlias(prepared, topicString)) > 0)
+            MQTTProperties_add(&properties, &alias);
+        len = MQTTV5Serialize_publish(sendbuf, MAX_MQTT_PACKET_SIZE, dup, qos, retained, id,
+                  topicString, &properties, (unsigned char*)payload, payloadlen);
+        if (len == MQTTPACKET_BUFFER_TOO_SHORT)
+        {
+            len = MQTTV5Serialize_publishHeader(sendbuf, MAX_MQTT_PACKET_SIZE, dup, qos, retained, id,
+                      topicString, &properties, payloadlen);
+            streamlen = payloadlen;
+        }
+        if (max_packet_size > 0 && len > 0 && len + streamlen > max_packet_size)
+        {
+            if (alias.value > 0 && topicString.cstring)
+                topic_aliases[alias.value] = 0;     // just assigned, but the server will not see it
+            len = BUFFER_OVERFLOW;
+        }
+        return len;
+    }
+    if (prepared)
+        len = MQTTSerialize_preparedPublish(sendbuf, MAX_MQTT_PACKET_SIZE, dup, qos, retained, id,
+                  prepared, (unsigned char*)payload, payloadlen);
+    else
+        len = MQTTSerialize_publish(sendbuf, MAX_MQTT_PACKET_SIZE, dup, qos, retained, id,
+                  topicString, (unsigned char*)payload, payloadlen);
+    if (len == MQTTPACKET_BUFFER_TOO_SHORT)
+    {
+        len = MQTTSerialize_publishHeader(sendbuf, MAX_MQTT_PACKET_SIZE, dup, qos, retained, id,
+                  topicString, payloadlen);
+        streamlen = payloadlen;
+    }
+    return len;
+}
+
 
+/**
+ * The MQTT 5 topic alias of a prepared topic on this connection.  One is assigned on its first publish,
+ * which carries the topic name too; later ones carry only the alias, so topicName is emptied for them.
+ * @return the alias, or 0 if none is free
+ */
 template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
-int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(const char* topicName, void* payload, size_t payloadlen, unsigned short& id, enum QoS qos, bool retained)
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::topicAlias(MQTTPreparedTopic* prepared, MQTTString& topicName)
+{
+    int alias = 0;
+
+    for (int i = 1; i <= topic_alias_max; ++i)
+    {
+        if (topic_aliases[i] == prepared)
+        {
+            topicName.cstring = 0;
+            topicName.lenstring.len = 0;
+            return i;
+        }
+        if (topic_aliases[i] == 0 && alias == 0)
+            alias = i;
+    }
+    if (alias > 0)
+        topic_aliases[alias] = prepared;
+    return alias;
+}
+
+
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::startPublish(const char* topicName, void* payload, size_t payloadlen,
+    unsigned short& id, enum QoS qos, bool retained, FP<void, publishData&>& fp, Timer& timer, MQTTPreparedTopic* prepared)
 {
     int rc = FAILURE;
-    Timer timer(command_timeout_ms);
-    MQTTString topicString = MQTTString_initializer;
+    size_t streamlen = 0;
     int len = 0;
+#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+    InflightMessage* msg = 0;
+#endif
 
     if (!isconnected)
         goto exit;
 
-    topicString.cstring = (char*)topicName;
-
 #if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
     if (qos == QOS1 || qos == QOS2)
-        id = packetid.getNext();
+    {
+        while (inflightCount() >= receive_max || (msg = findInflight(0)) == 0) // wait for room in the in-flight window
+        {
+            if (timer.expired() || cycle(timer) < 0)
+                goto exit;
+        }
+        do
+            id = packetid.getNext();
+        while (findInflight(id) != 0);
+    }
 #endif
 
-    len = MQTTSerialize_publish(sendbuf, MAX_MQTT_PACKET_SIZE, 0, qos, retained, id,
-              topicString, (unsigned char*)payload, payloadlen);
+    len = serializePublish(0, qos, retained, id, topicName, payload, payloadlen, streamlen, prepared);
     if (len <= 0)
         goto exit;
 
 #if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
-    if (!cleansession)
+    if (msg)
     {
-        memcpy(pubbuf, sendbuf, len);
-        inflightMsgid = id;
-        inflightLen = len;
-        inflightQoS = qos;
-#if MQTTCLIENT_QOS2
-        pubrel = false;
-#endif
+        msg->msgid = id;
+        msg->qos = qos;
+        msg->pubrel = false;
+        msg->retained = retained;
+        msg->topicName = topicName;
+        msg->payload = payload;
+        msg->payloadlen = payloadlen;
+        msg->fp = fp;
     }
 #endif
 
-    rc = publish(len, timer, qos);
+    if ((rc = sendPacket(len, timer, payload, streamlen)) != SUCCESS) // send the publish packet
+        closeSession(); // there was a problem - it is sent again on reconnect, unless the session is clean
+    else if (qos == QOS0 && fp.attached())
+    {
+        publishData data = {id, SUCCESS};
+        fp(data);
+    }
 exit:
     return rc;
 }
 
 
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publishAsync(const char* topicName, void* payload, size_t payloadlen,
+    unsigned short& id, enum QoS qos, bool retained, publishHandler ph)
+{
+    Timer timer(command_timeout_ms);
+    FP<void, publishData&> fp;
+
+    if (ph != 0)
+        fp.attach(ph);
+    return startPublish(topicName, payload, payloadlen, id, qos, retained, fp, timer);
+}
+
+
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(const char* topicName, void* payload, size_t payloadlen, unsigned short& id, enum QoS qos, bool retained)
+{
+    Timer timer(command_timeout_ms);
+    FP<void, publishData&> fp;
+    int rc = startPublish(topicName, payload, payloadlen, id, qos, retained, fp, timer);
+
+#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+    if (rc == SUCCESS && qos != QOS0 && (rc = waitforInflight(id, timer)) != SUCCESS && isconnected && findInflight(id) != 0)
+        closeSession();     // not acknowledged, rather than refused
+#endif
+    return rc;
+}
+
+
 template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
 int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(const char* topicName, void* payload, size_t payloadlen, enum QoS qos, bool retained)
 {
@@ -1029,6 +2307,91 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(const char* t
 }
 
 
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(MQTTPreparedTopic& topic, void* payload, size_t payloadlen, enum QoS qos, bool retained)
+{
+    Timer timer(command_timeout_ms);
+    FP<void, publishData&> fp;
+    unsigned short id = 0;
+    int rc = startPublish(topic.topicName, payload, payloadlen, id, qos, retained, fp, timer, &topic);
+
+#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+    if (rc == SUCCESS && qos != QOS0 && (rc = waitforInflight(id, timer)) != SUCCESS && isconnected && findInflight(id) != 0)
+        closeSession();     // not acknowledged, rather than refused
+#endif
+    return rc;
+}
+
+
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publishQoS0(const char* topicName, void* payload, size_t payloadlen, bool retained)
+{
+    return queuePublish(topicName, payload, payloadlen, retained, 0);
+}
+
+
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publishQoS0(MQTTPreparedTopic& topic, void* payload, size_t payloadlen, bool retained)
+{
+    return queuePublish(topic.topicName, payload, payloadlen, retained, &topic);
+}
+
+
+/**
+ * Queue a QoS 0 publish in txbuf.  With MQTT 3 it is serialized there directly, after sending what is
+ * queued if it does not fit behind that; with MQTT 5, or when it is larger than txbuf, it goes through
+ * sendbuf and queuePacket, which sends it straight away if it is larger than txbuf.
+ */
+template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::queuePublish(const char* topicName, void* payload, size_t payloadlen,
+    bool retained, MQTTPreparedTopic* prepared)
+{
+    MQTTString topicString = MQTTString_initializer;
+    size_t streamlen = 0;
+    int len = 0;
+    int rc = FAILURE;
+
+    if (!isconnected)
+        return rc;
+
+    topicString.cstring = (char*)topicName;
+    while (mqtt_version != 5)   // no topic alias to assign, which must not be lost if the publish does not fit
+    {
+        if (prepared)
+            len = MQTTSerialize_preparedPublish(&txbuf[txbuf_len], MQTTCLIENT_TX_BUFFER - txbuf_len, 0, QOS0, retained, 0,
+                      prepared, (unsigned char*)payload, payloadlen);
+        else
+            len = MQTTSerialize_publish(&txbuf[txbuf_len], MQTTCLIENT_TX_BUFFER - txbuf_len, 0, QOS0, retained, 0,
+                      topicString, (unsigned char*)payload, payloadlen);
+        if (len > 0)
+        {
+            txbuf_len += len;
+            return SUCCESS;
+        }
+        if (txbuf_len == 0)
+            break;  // larger than txbuf
+
+        Timer timer(command_timeout_ms);
+        if ((rc = flushPackets(timer)) != SUCCESS)  // make room, rather than serialize it again through sendbuf
+        {
+            closeSession();
+            return rc;
+        }
+    }
+
+    Timer timer(command_timeout_ms);
+    if ((len = serializePublish(0, QOS0, retained, 0, topicName, payload, payloadlen, streamlen, prepared)) <= 0)
+        return rc;
+    if (streamlen > 0)
+        rc = sendPacket(len, timer, payload, streamlen);
+    else
+        rc = queuePacket(len, timer);
+    if (rc != SUCCESS)
+        closeSession();
+    return rc;
+}
+
+
 template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
 int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(const char* topicName, Message& message)
 {
@@ -1044,6 +2407,7 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::disconnect()
     int len = MQTTSerialize_disconnect(sendbuf, MAX_MQTT_PACKET_SIZE);
     if (len > 0)
         rc = sendPacket(len, timer);            // send the disconnect packet
+    reconnect_session = false;
     closeSession();
     return rc;
 }
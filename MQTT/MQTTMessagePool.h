@@ -0,0 +1,129 @@
+#if !defined(MQTTMESSAGEPOOL_H)
+#define MQTTMESSAGEPOOL_H
+
+#include "MQTTClient.h"
+#include "mbed_critical.h"
+#include <stdint.h>
+#include <string.h>
+
+namespace MQTT
+{
+
+/** A message received into a block of a MessagePool, as handed over by MessageData::take
+ */
+struct PooledMessage
+{
+    Message message;    // its payload follows the topic name in the block
+    char* topicName;    // null-terminated
+};
+
+
+/**
+ * @class MessagePool
+ * @brief fixed-size blocks for received messages, so that handlers can pass them on to other threads
+ *
+ * Set on a client with Client::setMessagePool, each received message which fits is copied into a free
+ * block before its handlers are called.  One of them can take it with MessageData::take, to release it
+ * to the pool later from any thread; otherwise the client releases it when they return.  Blocks are
+ * only allocated by the client's thread, so the free list is a stack which any thread can push to with
+ * core_util_atomic compare and swap, and the one popping it needs no protection from ABA.
+ * @param BLOCKS the number of blocks
+ * @param BLOCK_SIZE the size of each, which holds a PooledMessage, the topic name with its null and the payload
+ */
+template<int BLOCKS, int BLOCK_SIZE = 256>
+class MessagePool
+{
+public:
+
+    MessagePool()
+    {
+        for (uint32_t i = 0; i < BLOCKS; ++i)
+            link(i) = (i + 1 < BLOCKS) ? i + 1 : NONE;
+        free_head = 0;
+        free_count = BLOCKS;
+    }
+
+    /** Copy a received message into a free block, and point topicName and message at the copy.  Only to be
+     *  called by the client's thread.
+     *  @param topicName - the topic name of the message
+     *  @param message - the message
+     *  @return the block, or 0 if none is free or the message does not fit in one
+     */
+    PooledMessage* alloc(MQTTString& topicName, Message& message)
+    {
+        const char* topic = (topicName.cstring) ? topicName.cstring : topicName.lenstring.data;
+        size_t topiclen = (topicName.cstring) ? strlen(topicName.cstring) : topicName.lenstring.len;
+        uint32_t head = free_head;
+        PooledMessage* pm = 0;
+
+        if (sizeof(PooledMessage) + topiclen + 1 + message.payloadlen > BLOCK_SIZE)
+            return 0;
+        do
+        {
+            if (head == NONE)
+                return 0;
+        }
+        while (!core_util_atomic_cas_u32(&free_head, &head, link(head)));
+        core_util_atomic_decr_u32(&free_count, 1);
+
+        pm = block(head);
+        pm->message = message;
+        pm->topicName = (char*)(pm + 1);
+        memcpy(pm->topicName, topic, topiclen);
+        pm->topicName[topiclen] = '\0';
+        pm->message.payload = pm->topicName + topiclen + 1;
+        memcpy(pm->message.payload, message.payload, message.payloadlen);
+
+        message = pm->message;
+        topicName.cstring = 0;
+        topicName.lenstring.len = topiclen;
+        topicName.lenstring.data = pm->topicName;
+        return pm;
+    }
+
+    /** Return a block to the pool, from any thread
+     *  @param pm - the block, from alloc or MessageData::take
+     */
+    void release(PooledMessage* pm)
+    {
+        uint32_t i = ((char*)pm - (char*)blocks) / sizeof(blocks[0]);
+        uint32_t head = free_head;
+
+        do
+            link(i) = head;
+        while (!core_util_atomic_cas_u32(&free_head, &head, i));
+        core_util_atomic_incr_u32(&free_count, 1);
+    }
+
+    /** The number of free blocks
+     */
+    int available()
+    {
+        return free_count;
+    }
+
+private:
+
+    enum { NONE = 0xFFFFFFFF };
+
+    uint64_t blocks[BLOCKS][(BLOCK_SIZE + 7) / 8];  // of 8 byte words, to align the PooledMessage at the start
+    volatile uint32_t free_head;    // index of the first free block, NONE if there is none
+    volatile uint32_t free_count;
+
+    typedef char block_size_check[(BLOCK_SIZE > (int)sizeof(PooledMessage)) ? 1 : -1];
+
+    PooledMessage* block(uint32_t i)
+    {
+        return (PooledMessage*)blocks[i];
+    }
+
+    // the index of the next free block, kept in the first word of a free one
+    volatile uint32_t& link(uint32_t i)
+    {
+        return *(volatile uint32_t*)blocks[i];
+    }
+};
+
+}
+
+#endif
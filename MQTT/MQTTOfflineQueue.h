@@ -0,0 +1,435 @@
+#if !defined(MQTTOFFLINEQUEUE_H)
+#define MQTTOFFLINEQUEUE_H
+
+#include "MQTTClient.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace MQTT
+{
+
+/**
+ * @class OfflineQueue
+ * @brief store and forward publishes through a Client, so that they are not lost while it is disconnected
+ *
+ * Messages are copied into a RAM buffer, or once that is full into a file, such as one on a flash file
+ * system, and published in order whenever the client is connected, up to MAX_INFLIGHT_MESSAGES at a time
+ * without waiting for each one's acks.  Each record is a flags byte with a commit bit, the QoS and the
+ * retained flag, the topic and payload lengths encoded as MQTT remaining lengths, the topic with its
+ * terminating null and the payload.  In the file the records end at a null byte, and each is appended
+ * with its flags byte written last, over that null, so that one cut short by a reset is never read.
+ * The file starts with the position of the first record not yet published, which is rewritten only once
+ * all the records read from the file into RAM at a time are published, rather than for each message,
+ * to spare the flash.  So the records in the file survive a restart, though some of them may be
+ * published again; those in RAM do not.  The file is started again from the beginning whenever it is
+ * emptied, and when it is full the records left are moved there if the space before them is larger,
+ * so it does not grow beyond max_store_bytes.
+ * @param Client the MQTT::Client type to publish through
+ * @param MAX_RAM_BYTES the size of the RAM buffer, which limits the size of a record
+ */
+template<class Client, int MAX_RAM_BYTES = 512>
+class OfflineQueue
+{
+public:
+
+    /** Construct the queue
+     *  @param client - the client to publish through
+     *  @param store - a file opened for update to spill to, or 0 to keep only what fits in RAM.  Records
+     *      left in it by an earlier run are published first.
+     *  @param max_store_bytes - the size the file may grow to
+     */
+    OfflineQueue(Client& client, FILE* store = 0, long max_store_bytes = 0)
+        : client(client), store(store), max_store_bytes(max_store_bytes)
+    {
+        len = first = next = 0;
+        ram_count = 0;
+        from_store = false;
+        window_start = window_count = 0;
+        head = loaded = tail = HEADER_LEN;
+        stored = 0;
+        if (store && !load())
+            restart();
+    }
+
+    /** Queue a message, then publish as many queued messages as the client can
+     *  @param topicName - the topic to publish to
+     *  @param payload - the data to send, copied
+     *  @param payloadlen - the length of the data
+     *  @param qos - the QoS to send the publish at
+     *  @param retained - whether the message should be retained
+     *  @return success code - BUFFER_OVERFLOW if there is no room for the message
+     */
+    int publish(const char* topicName, const void* payload, size_t payloadlen, enum QoS qos = QOS0, bool retained = false)
+    {
+        unsigned char header[1 + 4 + 4];
+        int topiclen = strlen(topicName) + 1;
+        int hdrlen = 1;
+        long reclen = 0;
+
+        header[0] = COMMITTED | qos | (retained ? 4 : 0);
+        hdrlen += MQTTPacket_encode(header + hdrlen, topiclen);
+        hdrlen += MQTTPacket_encode(header + hdrlen, payloadlen);
+        reclen = hdrlen + topiclen + payloadlen;
+        if (reclen > MAX_RAM_BYTES)
+            return BUFFER_OVERFLOW;
+
+        if (stored == 0)
+            shift();
+        if (stored == 0 && len + reclen <= MAX_RAM_BYTES)
+        {
+            memcpy(buf + len, header, hdrlen);
+            memcpy(buf + len + hdrlen, topicName, topiclen);
+            memcpy(buf + len + hdrlen + topiclen, payload, payloadlen);
+            len += reclen;
+            ++ram_count;
+        }
+        else if (store && (tail + reclen < max_store_bytes || compact(reclen)))
+        {
+            if (!append(header, hdrlen, topicName, topiclen, payload, payloadlen))
+                return FAILURE;
+            tail += reclen;
+            ++stored;
+        }
+        else
+            return BUFFER_OVERFLOW;
+
+        if (client.isConnected())
+            drain();
+        return SUCCESS;
+    }
+
+    /** Publish queued messages in order while the client is connected, without waiting for their acks.
+     *  Each record is removed once its publish completes.  One the client could not send is sent again
+     *  when it is connected again, unless the client kept it to send again itself; one the server refuses
+     *  is dropped.
+     *  @return success code - FAILURE if the client is not connected, or did not take a message
+     */
+    int drain()
+    {
+        int rc = SUCCESS;
+
+        release();
+        if (!client.isConnected())
+            return FAILURE;
+        for (int i = 0; rc == SUCCESS && i < window_count; ++i)
+        {
+            Slot* slot = &window[(window_start + i) % WINDOW];
+            if (slot->state == RESEND)
+                rc = send(slot);
+        }
+        while (rc == SUCCESS)
+        {
+            Slot* slot = 0;
+            int hdrlen, topiclen, payloadlen;
+
+            release();  // QoS 0 publishes, and some acks, complete straight away
+            if (window_count == WINDOW || (next == len && (first < len || !refill())))
+                break;
+            slot = &window[(window_start + window_count++) % WINDOW];
+            slot->offset = next;
+            next += recordLength(buf + next, len - next, &hdrlen, &topiclen, &payloadlen);
+            rc = send(slot);
+        }
+        release();
+        return rc;
+    }
+
+    /** Yield to the client, then publish queued messages if it is connected, as it is again once it has
+     *  reconnected
+     *  @param timeout_ms the time to wait, in milliseconds
+     *  @return success code - of the client's yield
+     */
+    int yield(unsigned long timeout_ms = 1000L)
+    {
+        int rc = client.yield(timeout_ms);
+
+        if (client.isConnected())
+            drain();
+        return rc;
+    }
+
+    /** The number of messages queued, including those published but not yet acknowledged
+     */
+    int count()
+    {
+        return (from_store ? 0 : ram_count) + stored;
+    }
+
+private:
+
+    enum { HEADER_LEN = 8,      // "MQOQ", then the position of the first record, 4 bytes little-endian
+           COMMITTED = 0x80 };  // set in the flags byte of every record
+#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+    enum { WINDOW = MAX_INFLIGHT_MESSAGES };
+#else
+    enum { WINDOW = 1 };
+#endif
+    enum State { SENT, DONE, RESEND };
+
+    // a record handed to the client, in the order they were taken from buf
+    struct Slot
+    {
+        long offset;        // of the record in buf
+        unsigned short id;  // packet id, 0 for QoS 0
+        State state;
+    };
+
+    Client& client;
+    FILE* store;
+    long max_store_bytes;
+
+    unsigned char buf[MAX_RAM_BYTES];
+    long len;               // bytes of records in buf
+    long first;             // offset in buf of the first record not yet completed
+    long next;              // offset in buf of the first record not yet handed to the client
+    int ram_count;          // records in buf from first
+    bool from_store;        // the records in buf were loaded from the file, and are still counted in stored
+    Slot window[WINDOW];    // the records from first to next
+    int window_start;
+    int window_count;
+
+    long head;              // file position of the first record not yet published
+    long loaded;            // file position of the first record not yet loaded into buf
+    long tail;              // file position of the null after the last record
+    int stored;             // records from head to tail
+
+    // decode a remaining length from the avail bytes at p, returning the bytes used, or 0 if incomplete
+    static int decode(unsigned char* p, long avail, int* value)
+    {
+        int multiplier = 1;
+        int i = 0;
+
+        *value = 0;
+        do
+        {
+            if (i == avail || i == 4)
+                return 0;
+            *value += (p[i] & 127) * multiplier;
+            multiplier *= 128;
+        }
+        while ((p[i++] & 128) != 0);
+        return i;
+    }
+
+    // the length of the committed record at p, or 0 if there is none or the avail bytes there do not hold all of it
+    static long recordLength(unsigned char* p, long avail, int* hdrlen, int* topiclen, int* payloadlen)
+    {
+        int n = 0;
+        long reclen = 0;
+
+        if (avail < 1 || (p[0] & COMMITTED) == 0 || (n = decode(p + 1, avail - 1, topiclen)) == 0)
+            return 0;
+        *hdrlen = 1 + n;
+        if ((n = decode(p + *hdrlen, avail - *hdrlen, payloadlen)) == 0)
+            return 0;
+        *hdrlen += n;
+        reclen = *hdrlen + *topiclen + *payloadlen;
+        return (reclen <= avail) ? reclen : 0;
+    }
+
+    // hand a record to the client, the topic and payload staying in buf until the publish completes
+    int send(Slot* slot)
+    {
+        unsigned char* p = buf + slot->offset;
+        int hdrlen = 0, topiclen = 0, payloadlen = 0;
+        int rc;
+
+        recordLength(p, len - slot->offset, &hdrlen, &topiclen, &payloadlen);
+        slot->id = 0;
+        slot->state = SENT;
+        rc = client.publishAsync((const char*)p + hdrlen, p + hdrlen + topiclen, payloadlen, slot->id,
+                                 (enum QoS)(p[0] & 3), (p[0] & 4) != 0, this, &OfflineQueue::completed);
+        if (rc != SUCCESS && slot->state == SENT && !kept(slot->id))
+            slot->state = RESEND;
+        return rc;
+    }
+
+    // called by the client when a publish completes
+    void completed(publishData& data)
+    {
+        for (int i = 0; i < window_count; ++i)
+        {
+            Slot* slot = &window[(window_start + i) % WINDOW];
+
+            if (slot->state == SENT && slot->id == data.id)
+            {
+                // failed while connected means refused, else the client is ending a clean session
+                slot->state = (data.rc == SUCCESS || client.isConnected()) ? DONE : RESEND;
+                break;
+            }
+        }
+    }
+
+    bool kept(unsigned short id)
+    {
+#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+        return client.isInflight(id);
+#else
+        return false;
+#endif
+    }
+
+    // remove the completed records at the front of the window, from buf and from the file
+    void release()
+    {
+        while (window_count > 0 && window[window_start].state == DONE)
+        {
+            int hdrlen, topiclen, payloadlen;
+            long reclen = recordLength(buf + first, len - first, &hdrlen, &topiclen, &payloadlen);
+
+            first += reclen;
+            --ram_count;
+            if (from_store)
+            {
+                head += reclen;
+                if (--stored == 0)
+                    restart();
+                else if (first == len)
+                    writeHeader();  // once for all the records loaded together
+            }
+            window_start = (window_start + 1) % WINDOW;
+            --window_count;
+        }
+    }
+
+    // move the records left to the start of buf, once none is with the client
+    void shift()
+    {
+        if (window_count == 0 && first > 0)
+        {
+            len -= first;
+            next -= first;
+            memmove(buf, buf + first, len);
+            first = 0;
+        }
+    }
+
+    // load as many whole records from the file into the empty buf as fit, returning false if there are none
+    bool refill()
+    {
+        long n = tail - loaded;
+        long reclen = 0;
+        int hdrlen, topiclen, payloadlen;
+
+        if (stored == 0 || n <= 0)
+            return false;
+        if (n > MAX_RAM_BYTES)
+            n = MAX_RAM_BYTES;
+        len = first = next = 0;
+        if (fseek(store, loaded, SEEK_SET) != 0 || fread(buf, 1, n, store) != (size_t)n)
+            return false;
+        while ((reclen = recordLength(buf + len, n - len, &hdrlen, &topiclen, &payloadlen)) > 0)
+        {
+            len += reclen;
+            ++ram_count;
+        }
+        loaded += len;
+        from_store = true;
+        return ram_count > 0;
+    }
+
+    // write a record at the end of the file, followed by a null, and its flags byte last
+    bool append(unsigned char* header, int hdrlen, const char* topicName, int topiclen, const void* payload, size_t payloadlen)
+    {
+        unsigned char end = 0;
+
+        return fseek(store, tail + 1, SEEK_SET) == 0 && fwrite(header + 1, 1, hdrlen - 1, store) == (size_t)(hdrlen - 1) &&
+               fwrite(topicName, 1, topiclen, store) == (size_t)topiclen &&
+               fwrite(payload, 1, payloadlen, store) == payloadlen && fwrite(&end, 1, 1, store) == 1 &&
+               fflush(store) == 0 &&
+               fseek(store, tail, SEEK_SET) == 0 && fwrite(header, 1, 1, store) == 1 && fflush(store) == 0;
+    }
+
+    // find the records left in the file by an earlier run, returning false if there are none
+    bool load()
+    {
+        unsigned char h[HEADER_LEN];
+        unsigned char end = 0;
+        long used = 0;
+
+        if (fseek(store, 0, SEEK_SET) != 0 || fread(h, 1, HEADER_LEN, store) != HEADER_LEN ||
+            memcmp(h, "MQOQ", 4) != 0 || get32(h + 4) < HEADER_LEN)
+            return false;
+        head = loaded = tail = get32(h + 4);
+        do
+        {
+            long n = (fseek(store, tail, SEEK_SET) == 0) ? fread(buf, 1, MAX_RAM_BYTES, store) : 0;
+            long reclen = 0;
+            int hdrlen, topiclen, payloadlen;
+
+            used = 0;
+            while ((reclen = recordLength(buf + used, n - used, &hdrlen, &topiclen, &payloadlen)) > 0)
+            {
+                used += reclen;
+                ++stored;
+            }
+            tail += used;
+        }
+        while (used > 0);
+        // the first record not committed, if any, is overwritten by the next
+        return stored > 0 && fseek(store, tail, SEEK_SET) == 0 && fwrite(&end, 1, 1, store) == 1 && fflush(store) == 0;
+    }
+
+    // start the file again, empty
+    bool restart()
+    {
+        unsigned char end = 0;
+
+        head = loaded = tail = HEADER_LEN;
+        stored = 0;
+        from_store = false;
+        return fseek(store, tail, SEEK_SET) == 0 && fwrite(&end, 1, 1, store) == 1 && writeHeader();
+    }
+
+    // move the records to the start of the file to make room for reclen more bytes, when the space before
+    // them is larger than they are, so that a reset part way through leaves them where the header says
+    bool compact(long reclen)
+    {
+        long shift = head - HEADER_LEN;
+        long n = tail - head;
+        unsigned char chunk[32];
+        unsigned char end = 0;
+
+        if (n >= shift || tail - shift + reclen >= max_store_bytes || !writeHeader())
+            return false;
+        for (long done = 0; done < n; )
+        {
+            long k = (n - done < (long)sizeof(chunk)) ? n - done : (long)sizeof(chunk);
+
+            if (fseek(store, head + done, SEEK_SET) != 0 || fread(chunk, 1, k, store) != (size_t)k ||
+                fseek(store, HEADER_LEN + done, SEEK_SET) != 0 || fwrite(chunk, 1, k, store) != (size_t)k)
+                return false;
+            done += k;
+        }
+        if (fseek(store, tail - shift, SEEK_SET) != 0 || fwrite(&end, 1, 1, store) != 1 || fflush(store) != 0)
+            return false;
+        head -= shift;
+        loaded -= shift;
+        tail -= shift;
+        return writeHeader();
+    }
+
+    bool writeHeader()
+    {
+        unsigned char h[HEADER_LEN];
+
+        memcpy(h, "MQOQ", 4);
+        put32(h + 4, head);
+        return fseek(store, 0, SEEK_SET) == 0 && fwrite(h, 1, HEADER_LEN, store) == HEADER_LEN && fflush(store) == 0;
+    }
+
+    static long get32(unsigned char* p)
+    {
+        return p[0] | (p[1] << 8) | ((long)p[2] << 16) | ((long)p[3] << 24);
+    }
+
+    static void put32(unsigned char* p, long value)
+    {
+        for (int i = 0; i < 4; ++i)
+            p[i] = (unsigned char)(value >> (8 * i));
+    }
+};
+
+}
+
+#endif
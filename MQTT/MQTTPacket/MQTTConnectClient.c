@@ -32,7 +32,7 @@ int MQTTSerialize_connectLength(MQTTPacket_connectData* options)
 
 	if (options->MQTTVersion == 3)
 		len = 12; /* variable depending on MQTT or MQIsdp */
-	else if (options->MQTTVersion == 4)
+	else if (options->MQTTVersion == 4 || options->MQTTVersion == 5)
 		len = 10;
 
 	len += MQTTstrlen(options->clientID)+2;
@@ -57,6 +57,23 @@ int MQTTSerialize_connectLength(MQTTPacket_connectData* options)
   */
 int MQTTSerialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData* options)
 {
+	return MQTTV5Serialize_connect(buf, buflen, options, NULL, NULL);
+}
+
+
+/**
+  * Serializes the connect options into the buffer, with the MQTT 5 properties when options->MQTTVersion is 5
+  * @param buf the buffer into which the packet will be serialized
+  * @param len the length in bytes of the supplied buffer
+  * @param options the options to be used to build the connect packet
+  * @param connectProperties the properties of the connect, or NULL for none
+  * @param willProperties the properties of the will message, or NULL for none
+  * @return serialized length, or error if 0
+  */
+int MQTTV5Serialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData* options,
+		MQTTProperties* connectProperties, MQTTProperties* willProperties)
+{
+	MQTTProperties noProperties = MQTTProperties_initializer;
 	unsigned char *ptr = buf;
 	MQTTHeader header = {0};
 	MQTTConnectFlags flags = {0};
@@ -64,7 +81,21 @@ int MQTTSerialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData
 	int rc = -1;
 
 	FUNC_ENTRY;
-	if (MQTTPacket_len(len = MQTTSerialize_connectLength(options)) > buflen)
+	if (options->MQTTVersion != 5)
+		connectProperties = willProperties = NULL;
+	else
+	{
+		if (connectProperties == NULL)
+			connectProperties = &noProperties;
+		if (willProperties == NULL || !options->willFlag)
+			willProperties = (options->willFlag) ? &noProperties : NULL;
+	}
+	len = MQTTSerialize_connectLength(options);
+	if (connectProperties)
+		len += MQTTProperties_len(connectProperties);
+	if (willProperties)
+		len += MQTTProperties_len(willProperties);
+	if (MQTTPacket_len(len) > buflen)
 	{
 		rc = MQTTPACKET_BUFFER_TOO_SHORT;
 		goto exit;
@@ -76,10 +107,10 @@ int MQTTSerialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData
 
 	ptr += MQTTPacket_encode(ptr, len); /* write remaining length */
 
-	if (options->MQTTVersion == 4)
+	if (options->MQTTVersion == 4 || options->MQTTVersion == 5)
 	{
 		writeCString(&ptr, "MQTT");
-		writeChar(&ptr, (char) 4);
+		writeChar(&ptr, (char) options->MQTTVersion);
 	}
 	else
 	{
@@ -103,9 +134,13 @@ int MQTTSerialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData
 
 	writeChar(&ptr, flags.all);
 	writeInt(&ptr, options->keepAliveInterval);
+	if (connectProperties)
+		MQTTProperties_write(&ptr, connectProperties);
 	writeMQTTString(&ptr, options->clientID);
 	if (options->willFlag)
 	{
+		if (willProperties)
+			MQTTProperties_write(&ptr, willProperties);
 		writeMQTTString(&ptr, options->will.topicName);
 		writeMQTTString(&ptr, options->will.message);
 	}
@@ -130,6 +165,22 @@ int MQTTSerialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData
   * @return error code.  1 is success, 0 is failure
   */
 int MQTTDeserialize_connack(unsigned char* sessionPresent, unsigned char* connack_rc, unsigned char* buf, int buflen)
+{
+	return MQTTV5Deserialize_connack(NULL, sessionPresent, connack_rc, buf, buflen);
+}
+
+
+/**
+  * Deserializes the supplied (wire) buffer into MQTT 5 connack data
+  * @param connackProperties the properties returned, or NULL to read an MQTT 3 connack
+  * @param sessionPresent the session present flag returned
+  * @param reasonCode returned integer value of the connack reason code
+  * @param buf the raw buffer data, of the correct length determined by the remaining length field
+  * @param len the length in bytes of the data in the supplied buffer
+  * @return error code.  1 is success, 0 is failure
+  */
+int MQTTV5Deserialize_connack(MQTTProperties* connackProperties, unsigned char* sessionPresent, unsigned char* reasonCode,
+		unsigned char* buf, int buflen)
 {
 	MQTTHeader header = {0};
 	unsigned char* curdata = buf;
@@ -150,7 +201,16 @@ int MQTTDeserialize_connack(unsigned char* sessionPresent, unsigned char* connac
 
 	flags.all = readChar(&curdata);
 	*sessionPresent = flags.bits.sessionpresent;
-	*connack_rc = readChar(&curdata);
+	*reasonCode = readChar(&curdata);
+	if (connackProperties)
+	{
+		connackProperties->count = connackProperties->length = 0;
+		if (curdata < enddata && !MQTTProperties_read(connackProperties, &curdata, enddata))
+		{
+			rc = 0;
+			goto exit;
+		}
+	}
 
 	rc = 1;
 exit:
@@ -203,6 +263,80 @@ int MQTTSerialize_disconnect(unsigned char* buf, int buflen)
 }
 
 
+/**
+  * Serializes an MQTT 5 disconnect packet into the supplied buffer, ready for writing to a socket
+  * @param buf the buffer into which the packet will be serialized
+  * @param buflen the length in bytes of the supplied buffer, to avoid overruns
+  * @param reasonCode the reason for disconnecting
+  * @param properties the properties of the disconnect, or NULL for none
+  * @return serialized length, or error if 0
+  */
+int MQTTV5Serialize_disconnect(unsigned char* buf, int buflen, unsigned char reasonCode, MQTTProperties* properties)
+{
+	MQTTHeader header = {0};
+	unsigned char *ptr = buf;
+	int rem_len = 1 + ((properties) ? MQTTProperties_len(properties) : 0);
+	int rc = -1;
+
+	FUNC_ENTRY;
+	if (MQTTPacket_len(rem_len) > buflen)
+	{
+		rc = MQTTPACKET_BUFFER_TOO_SHORT;
+		goto exit;
+	}
+	header.byte = 0;
+	header.bits.type = DISCONNECT;
+	writeChar(&ptr, header.byte); /* write header */
+
+	ptr += MQTTPacket_encode(ptr, rem_len); /* write remaining length */
+	writeChar(&ptr, reasonCode);
+	if (properties)
+		MQTTProperties_write(&ptr, properties);
+	rc = ptr - buf;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+  * Deserializes the supplied (wire) buffer into MQTT 5 disconnect data, as sent by a server
+  * @param properties the properties returned, or NULL
+  * @param reasonCode returned integer value of the reason code, 0 if there is none
+  * @param buf the raw buffer data, of the correct length determined by the remaining length field
+  * @param buflen the length in bytes of the data in the supplied buffer
+  * @return error code.  1 is success, 0 is failure
+  */
+int MQTTV5Deserialize_disconnect(MQTTProperties* properties, unsigned char* reasonCode, unsigned char* buf, int buflen)
+{
+	MQTTHeader header = {0};
+	unsigned char* curdata = buf;
+	unsigned char* enddata = NULL;
+	int rc = 0;
+	int mylen;
+
+	FUNC_ENTRY;
+	header.byte = readChar(&curdata);
+	if (header.bits.type != DISCONNECT)
+		goto exit;
+
+	curdata += MQTTPacket_decodeBuf(curdata, &mylen); /* read remaining length */
+	enddata = curdata + mylen;
+	*reasonCode = (curdata < enddata) ? readChar(&curdata) : 0;
+	if (properties)
+	{
+		properties->count = properties->length = 0;
+		if (curdata < enddata && !MQTTProperties_read(properties, &curdata, enddata))
+			goto exit;
+	}
+
+	rc = 1;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
 /**
   * Serializes a disconnect packet into the supplied buffer, ready for writing to a socket
   * @param buf the buffer into which the packet will be serialized
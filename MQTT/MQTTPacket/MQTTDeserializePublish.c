@@ -35,6 +35,19 @@
   */
 int MQTTDeserialize_publish(unsigned char* dup, int* qos, unsigned char* retained, unsigned short* packetid, MQTTString* topicName,
 		unsigned char** payload, int* payloadlen, unsigned char* buf, int buflen)
+{
+	return MQTTV5Deserialize_publish(dup, qos, retained, packetid, topicName, NULL, payload, payloadlen, buf, buflen);
+}
+
+
+/**
+  * Deserializes the supplied (wire) buffer into publish data, as MQTTDeserialize_publish, with MQTT 5 properties
+  * @param properties returned - the properties of the publish, as many as fit in its array, or NULL to read an
+  *   MQTT 3 publish
+  * @return error code.  1 is success
+  */
+int MQTTV5Deserialize_publish(unsigned char* dup, int* qos, unsigned char* retained, unsigned short* packetid, MQTTString* topicName,
+		MQTTProperties* properties, unsigned char** payload, int* payloadlen, unsigned char* buf, int buflen)
 {
 	MQTTHeader header = {0};
 	unsigned char* curdata = buf;
@@ -50,16 +63,19 @@ int MQTTDeserialize_publish(unsigned char* dup, int* qos, unsigned char* retaine
 	*qos = header.bits.qos;
 	*retained = header.bits.retain;
 
-	curdata += (rc = MQTTPacket_decodeBuf(curdata, &mylen)); /* read remaining length */
+	curdata += MQTTPacket_decodeBuf(curdata, &mylen); /* read remaining length */
 	enddata = curdata + mylen;
 
 	if (!readMQTTLenString(topicName, &curdata, enddata) ||
-		enddata - curdata < 0) /* do we have enough data to read the protocol version byte? */
+		enddata - curdata < ((*qos > 0) ? 2 : 0)) /* do we have enough data to read the packet id? */
 		goto exit;
 
 	if (*qos > 0)
 		*packetid = readInt(&curdata);
 
+	if (properties && !MQTTProperties_read(properties, &curdata, enddata))
+		goto exit;
+
 	*payloadlen = enddata - curdata;
 	*payload = curdata;
 	rc = 1;
@@ -105,3 +121,49 @@ exit:
 	return rc;
 }
 
+
+/**
+  * Deserializes the supplied (wire) buffer into an MQTT 5 ack, which can have a reason code and properties
+  * @param packettype returned integer - the MQTT packet type
+  * @param dup returned integer - the MQTT dup flag
+  * @param packetid returned integer - the MQTT packet identifier
+  * @param reasonCode returned integer - the reason code, 0 for success if there is none
+  * @param properties returned - the properties of the ack, as many as fit in its array, or NULL
+  * @param buf the raw buffer data, of the correct length determined by the remaining length field
+  * @param buflen the length in bytes of the data in the supplied buffer
+  * @return error code.  1 is success, 0 is failure
+  */
+int MQTTV5Deserialize_ack(unsigned char* packettype, unsigned char* dup, unsigned short* packetid, unsigned char* reasonCode,
+		MQTTProperties* properties, unsigned char* buf, int buflen)
+{
+	MQTTHeader header = {0};
+	unsigned char* curdata = buf;
+	unsigned char* enddata = NULL;
+	int rc = 0;
+	int mylen;
+
+	FUNC_ENTRY;
+	header.byte = readChar(&curdata);
+	*dup = header.bits.dup;
+	*packettype = header.bits.type;
+
+	curdata += MQTTPacket_decodeBuf(curdata, &mylen); /* read remaining length */
+	enddata = curdata + mylen;
+
+	if (enddata - curdata < 2)
+		goto exit;
+	*packetid = readInt(&curdata);
+	*reasonCode = (curdata < enddata) ? readChar(&curdata) : MQTTREASONCODE_SUCCESS;
+	if (properties)
+	{
+		properties->count = properties->length = 0;
+		if (curdata < enddata && !MQTTProperties_read(properties, &curdata, enddata))
+			goto exit;
+	}
+
+	rc = 1;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
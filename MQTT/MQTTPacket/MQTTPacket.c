@@ -117,6 +117,33 @@ int MQTTPacket_decodeBuf(unsigned char* buf, int* value)
 }
 
 
+/**
+ * Decodes a variable byte integer, such as the remaining length or an MQTT 5 property length, from a
+ * buffer which need not hold all of it
+ * @param buf the buffer to decode from
+ * @param buflen the number of bytes in buf
+ * @param value the decoded value returned
+ * @return the number of bytes used, 0 if buf ends first, or MQTTPACKET_READ_ERROR if they are invalid
+ */
+int MQTTPacket_decodeLen(unsigned char* buf, int buflen, int* value)
+{
+	int multiplier = 1;
+	int len = 0;
+
+	*value = 0;
+	do
+	{
+		if (len == MAX_NO_OF_REMAINING_LENGTH_BYTES)
+			return MQTTPACKET_READ_ERROR;
+		if (len == buflen)
+			return 0;
+		*value += (buf[len] & 127) * multiplier;
+		multiplier *= 128;
+	} while ((buf[len++] & 128) != 0);
+	return len;
+}
+
+
 /**
  * Calculates an integer from two bytes read from the input buffer
  * @param pptr pointer to the input buffer - incremented by the number of bytes used & returned
@@ -409,3 +436,86 @@ exit:
 	trp->state = 0;
 	return rc;
 }
+
+/**
+ * Helper function to parse packets from a chunk of data already in memory, such as a socket buffer,
+ * non-blocking.  Each call takes as much of the chunk as it can, across any number of packets, keeping
+ * the state of a packet split between chunks in trp.  A packet wholly within the chunk is handed over
+ * where it is; one split between chunks is gathered in buf first.
+ * @param buf the buffer into which a split packet is gathered
+ * @param buflen the length in bytes of the supplied buffer
+ * @param trp pointer to a transport structure holding the parse state - its getfn is not used
+ * @param data the chunk of data
+ * @param datalen the number of bytes in data
+ * @param packetfn called with trp->sck, each complete packet and its length.  The packet is only valid
+ * during the call.  Returns 0 to go on to the next packet, or anything else to stop after this one.
+ * @return the number of bytes of data used, less than datalen only if packetfn stopped, or -1 on error
+ * @note  a split packet must fit into the caller's buffer
+ */
+int MQTTPacket_readnbChunk(unsigned char* buf, int buflen, MQTTTransport *trp, unsigned char* data, int datalen,
+		int (*packetfn)(void *, unsigned char*, int))
+{
+	int rc = -1, used = 0, n, rem_len;
+	unsigned char c;
+
+	FUNC_ENTRY;
+	while (used < datalen)
+	{
+		switch(trp->state){
+		default:
+			trp->state = 0;
+			/*FALLTHROUGH*/
+		case 0:
+			/* a packet wholly in the chunk needs no copy */
+			if ((n = MQTTPacket_decodeLen(data + used + 1, datalen - used - 1, &rem_len)) == MQTTPACKET_READ_ERROR)
+				goto exit;
+			if (n > 0 && 1 + n + rem_len <= datalen - used)
+			{
+				used += 1 + n + rem_len;
+				if ((*packetfn)(trp->sck, data + used - (1 + n + rem_len), 1 + n + rem_len) != 0)
+					goto done;
+				continue;
+			}
+			buf[0] = data[used++];
+			trp->len = 0;
+			trp->multiplier = 1;
+			trp->rem_len = 0;
+			++trp->state;
+			break;
+		case 1:
+			/* the remaining length, one byte at a time as the chunk ends within it */
+			if (trp->len >= MAX_NO_OF_REMAINING_LENGTH_BYTES)
+				goto exit;
+			c = data[used++];
+			++(trp->len);
+			trp->rem_len += (c & 127) * trp->multiplier;
+			trp->multiplier *= 128;
+			if ((c & 128) != 0)
+				break;
+			trp->len = 1 + MQTTPacket_encode(buf + 1, trp->rem_len); /* put the original remaining length back into the buffer */
+			if((trp->rem_len + trp->len) > buflen)
+				goto exit;
+			++trp->state;
+			/*FALLTHROUGH*/
+		case 2:
+			n = (trp->rem_len < datalen - used) ? trp->rem_len : datalen - used;
+			memcpy(buf + trp->len, data + used, n);
+			used += n;
+			trp->len += n;
+			trp->rem_len -= n;
+			if (trp->rem_len)
+				break;
+			trp->state = 0;
+			if ((*packetfn)(trp->sck, buf, trp->len) != 0)
+				goto done;
+			break;
+		}
+	}
+done:
+	rc = used;
+exit:
+	if (rc == -1)
+		trp->state = 0;
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
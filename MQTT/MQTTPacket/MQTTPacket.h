@@ -88,6 +88,7 @@ typedef struct
 
 int MQTTstrlen(MQTTString mqttstring);
 
+#include "MQTTProperties.h"
 #include "MQTTConnect.h"
 #include "MQTTPublish.h"
 #include "MQTTSubscribe.h"
@@ -103,6 +104,7 @@ DLLExport int MQTTPacket_equals(MQTTString* a, char* b);
 DLLExport int MQTTPacket_encode(unsigned char* buf, int length);
 int MQTTPacket_decode(int (*getcharfn)(unsigned char*, int), int* value);
 int MQTTPacket_decodeBuf(unsigned char* buf, int* value);
+int MQTTPacket_decodeLen(unsigned char* buf, int buflen, int* value);
 
 int readInt(unsigned char** pptr);
 char readChar(unsigned char** pptr);
@@ -124,6 +126,8 @@ typedef struct {
 }MQTTTransport;
 
 int MQTTPacket_readnb(unsigned char* buf, int buflen, MQTTTransport *trp);
+int MQTTPacket_readnbChunk(unsigned char* buf, int buflen, MQTTTransport *trp, unsigned char* data, int datalen,
+		int (*packetfn)(void *, unsigned char*, int));
 
 #ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
 }
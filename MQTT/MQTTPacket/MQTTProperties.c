@@ -0,0 +1,297 @@
+#include "MQTTPacket.h"
+#include "StackTrace.h"
+
+#include <string.h>
+
+
+/**
+  * The number of bytes a variable byte integer is encoded in
+  */
+static int MQTTProperties_encodedLen(int value)
+{
+	if (value < 128)
+		return 1;
+	else if (value < 16384)
+		return 2;
+	else if (value < 2097152)
+		return 3;
+	return 4;
+}
+
+
+static void writeInt4(unsigned char** pptr, unsigned int anInt)
+{
+	writeInt(pptr, anInt >> 16);
+	writeInt(pptr, anInt & 0xFFFF);
+}
+
+
+static unsigned int readInt4(unsigned char** pptr)
+{
+	unsigned int value = readInt(pptr);
+	return (value << 16) | readInt(pptr);
+}
+
+
+/**
+  * Returns the encoding of a property's value
+  * @param identifier the property identifier, one of MQTTPropertyCodes
+  * @return one of MQTTPropertyTypes, or -1 if the identifier is not known
+  */
+int MQTTProperty_getType(int identifier)
+{
+	switch (identifier)
+	{
+	case MQTTPROPERTY_CODE_PAYLOAD_FORMAT_INDICATOR:
+	case MQTTPROPERTY_CODE_REQUEST_PROBLEM_INFORMATION:
+	case MQTTPROPERTY_CODE_REQUEST_RESPONSE_INFORMATION:
+	case MQTTPROPERTY_CODE_MAXIMUM_QOS:
+	case MQTTPROPERTY_CODE_RETAIN_AVAILABLE:
+	case MQTTPROPERTY_CODE_WILDCARD_SUBSCRIPTION_AVAILABLE:
+	case MQTTPROPERTY_CODE_SUBSCRIPTION_IDENTIFIERS_AVAILABLE:
+	case MQTTPROPERTY_CODE_SHARED_SUBSCRIPTION_AVAILABLE:
+		return MQTTPROPERTY_TYPE_BYTE;
+	case MQTTPROPERTY_CODE_SERVER_KEEP_ALIVE:
+	case MQTTPROPERTY_CODE_RECEIVE_MAXIMUM:
+	case MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM:
+	case MQTTPROPERTY_CODE_TOPIC_ALIAS:
+		return MQTTPROPERTY_TYPE_TWO_BYTE_INTEGER;
+	case MQTTPROPERTY_CODE_MESSAGE_EXPIRY_INTERVAL:
+	case MQTTPROPERTY_CODE_SESSION_EXPIRY_INTERVAL:
+	case MQTTPROPERTY_CODE_WILL_DELAY_INTERVAL:
+	case MQTTPROPERTY_CODE_MAXIMUM_PACKET_SIZE:
+		return MQTTPROPERTY_TYPE_FOUR_BYTE_INTEGER;
+	case MQTTPROPERTY_CODE_SUBSCRIPTION_IDENTIFIER:
+		return MQTTPROPERTY_TYPE_VARIABLE_BYTE_INTEGER;
+	case MQTTPROPERTY_CODE_CORRELATION_DATA:
+	case MQTTPROPERTY_CODE_AUTHENTICATION_DATA:
+		return MQTTPROPERTY_TYPE_BINARY_DATA;
+	case MQTTPROPERTY_CODE_CONTENT_TYPE:
+	case MQTTPROPERTY_CODE_RESPONSE_TOPIC:
+	case MQTTPROPERTY_CODE_ASSIGNED_CLIENT_IDENTIFIER:
+	case MQTTPROPERTY_CODE_AUTHENTICATION_METHOD:
+	case MQTTPROPERTY_CODE_RESPONSE_INFORMATION:
+	case MQTTPROPERTY_CODE_SERVER_REFERENCE:
+	case MQTTPROPERTY_CODE_REASON_STRING:
+		return MQTTPROPERTY_TYPE_UTF_8_ENCODED_STRING;
+	case MQTTPROPERTY_CODE_USER_PROPERTY:
+		return MQTTPROPERTY_TYPE_UTF_8_STRING_PAIR;
+	}
+	return -1;
+}
+
+
+/**
+  * Determines the serialized length of a property, with its identifier
+  * @return the length, or -1 if the identifier is not known
+  */
+static int MQTTProperty_len(const MQTTProperty* property)
+{
+	int len = 1; /* identifier */
+
+	switch (MQTTProperty_getType(property->identifier))
+	{
+	case MQTTPROPERTY_TYPE_BYTE:
+		len += 1;
+		break;
+	case MQTTPROPERTY_TYPE_TWO_BYTE_INTEGER:
+		len += 2;
+		break;
+	case MQTTPROPERTY_TYPE_FOUR_BYTE_INTEGER:
+		len += 4;
+		break;
+	case MQTTPROPERTY_TYPE_VARIABLE_BYTE_INTEGER:
+		len += MQTTProperties_encodedLen(property->value);
+		break;
+	case MQTTPROPERTY_TYPE_BINARY_DATA:
+	case MQTTPROPERTY_TYPE_UTF_8_ENCODED_STRING:
+		len += 2 + property->data.len;
+		break;
+	case MQTTPROPERTY_TYPE_UTF_8_STRING_PAIR:
+		len += 2 + property->data.len + 2 + property->pair.len;
+		break;
+	default:
+		len = -1;
+	}
+	return len;
+}
+
+
+/**
+  * Determines the serialized length of a set of properties, with the property length before them
+  * @param properties the properties
+  * @return the length
+  */
+int MQTTProperties_len(MQTTProperties* properties)
+{
+	return MQTTProperties_encodedLen(properties->length) + properties->length;
+}
+
+
+/**
+  * Adds a property to a set of properties.  Strings and binary data are not copied.
+  * @param properties the properties to add to
+  * @param property the property to add
+  * @return 0 if successful, -1 if the array is full or the identifier is not known
+  */
+int MQTTProperties_add(MQTTProperties* properties, const MQTTProperty* property)
+{
+	int len = 0;
+
+	if (properties->count == properties->max_count || (len = MQTTProperty_len(property)) < 0)
+		return -1;
+	properties->array[properties->count++] = *property;
+	properties->length += len;
+	return 0;
+}
+
+
+/**
+  * Writes the property length, then the properties, to an output buffer
+  * @param pptr pointer to the output buffer - incremented by the number of bytes used & returned
+  * @param properties the properties to write
+  */
+void MQTTProperties_write(unsigned char** pptr, MQTTProperties* properties)
+{
+	int i;
+
+	*pptr += MQTTPacket_encode(*pptr, properties->length);
+	for (i = 0; i < properties->count; ++i)
+	{
+		MQTTProperty* property = &properties->array[i];
+
+		writeChar(pptr, property->identifier);
+		switch (MQTTProperty_getType(property->identifier))
+		{
+		case MQTTPROPERTY_TYPE_BYTE:
+			writeChar(pptr, property->value);
+			break;
+		case MQTTPROPERTY_TYPE_TWO_BYTE_INTEGER:
+			writeInt(pptr, property->value);
+			break;
+		case MQTTPROPERTY_TYPE_FOUR_BYTE_INTEGER:
+			writeInt4(pptr, property->value);
+			break;
+		case MQTTPROPERTY_TYPE_VARIABLE_BYTE_INTEGER:
+			*pptr += MQTTPacket_encode(*pptr, property->value);
+			break;
+		case MQTTPROPERTY_TYPE_UTF_8_STRING_PAIR:
+			writeInt(pptr, property->data.len);
+			memcpy(*pptr, property->data.data, property->data.len);
+			*pptr += property->data.len;
+			writeInt(pptr, property->pair.len);
+			memcpy(*pptr, property->pair.data, property->pair.len);
+			*pptr += property->pair.len;
+			break;
+		default: /* binary data or string */
+			writeInt(pptr, property->data.len);
+			memcpy(*pptr, property->data.data, property->data.len);
+			*pptr += property->data.len;
+		}
+	}
+}
+
+
+/**
+  * Reads the property length, then the properties, from an input buffer.  Properties beyond the size
+  * of the array are checked and skipped.
+  * @param properties the properties read - count and length are returned
+  * @param pptr pointer to the input buffer - incremented by the number of bytes used & returned
+  * @param enddata pointer to the end of the data: do not read beyond
+  * @return 1 if successful, 0 if not
+  */
+int MQTTProperties_read(MQTTProperties* properties, unsigned char** pptr, unsigned char* enddata)
+{
+	unsigned char* end = NULL;
+	int rc = 0;
+	int len = 0;
+	int n = 0;
+
+	FUNC_ENTRY;
+	properties->count = properties->length = 0;
+	if ((n = MQTTPacket_decodeLen(*pptr, enddata - *pptr, &len)) <= 0 || len > enddata - *pptr - n)
+		goto exit;
+	*pptr += n;
+	end = *pptr + len;
+
+	while (*pptr < end)
+	{
+		MQTTProperty property;
+		MQTTString string = MQTTString_initializer;
+		int value = 0;
+
+		property.identifier = (unsigned char)readChar(pptr);
+		property.value = 0;
+		switch (MQTTProperty_getType(property.identifier))
+		{
+		case MQTTPROPERTY_TYPE_BYTE:
+			if (end - *pptr < 1)
+				goto exit;
+			property.value = (unsigned char)readChar(pptr);
+			break;
+		case MQTTPROPERTY_TYPE_TWO_BYTE_INTEGER:
+			if (end - *pptr < 2)
+				goto exit;
+			property.value = readInt(pptr);
+			break;
+		case MQTTPROPERTY_TYPE_FOUR_BYTE_INTEGER:
+			if (end - *pptr < 4)
+				goto exit;
+			property.value = readInt4(pptr);
+			break;
+		case MQTTPROPERTY_TYPE_VARIABLE_BYTE_INTEGER:
+			if ((n = MQTTPacket_decodeLen(*pptr, end - *pptr, &value)) <= 0)
+				goto exit;
+			*pptr += n;
+			property.value = value;
+			break;
+		case MQTTPROPERTY_TYPE_UTF_8_STRING_PAIR:
+			if (!readMQTTLenString(&string, pptr, end))
+				goto exit;
+			property.data = string.lenstring;
+			if (!readMQTTLenString(&string, pptr, end))
+				goto exit;
+			property.pair = string.lenstring;
+			break;
+		case MQTTPROPERTY_TYPE_BINARY_DATA:
+		case MQTTPROPERTY_TYPE_UTF_8_ENCODED_STRING:
+			if (!readMQTTLenString(&string, pptr, end))
+				goto exit;
+			property.data = string.lenstring;
+			break;
+		default:
+			goto exit; /* malformed */
+		}
+		if (properties->count < properties->max_count)
+			properties->array[properties->count++] = property;
+	}
+
+	properties->length = len;
+	rc = 1;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+  * Finds the value of a byte or integer property
+  * @param properties the properties to look in
+  * @param identifier the property identifier
+  * @param value the value returned
+  * @return 1 if the property was found, 0 if not
+  */
+int MQTTProperties_getNumericValue(MQTTProperties* properties, int identifier, unsigned int* value)
+{
+	int i;
+
+	for (i = 0; i < properties->count; ++i)
+	{
+		if (properties->array[i].identifier == identifier)
+		{
+			*value = properties->array[i].value;
+			return 1;
+		}
+	}
+	return 0;
+}
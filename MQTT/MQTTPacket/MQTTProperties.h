@@ -0,0 +1,129 @@
+#ifndef MQTTPROPERTIES_H_
+#define MQTTPROPERTIES_H_
+
+/** MQTT 5 property identifiers */
+enum MQTTPropertyCodes
+{
+	MQTTPROPERTY_CODE_PAYLOAD_FORMAT_INDICATOR = 1,
+	MQTTPROPERTY_CODE_MESSAGE_EXPIRY_INTERVAL = 2,
+	MQTTPROPERTY_CODE_CONTENT_TYPE = 3,
+	MQTTPROPERTY_CODE_RESPONSE_TOPIC = 8,
+	MQTTPROPERTY_CODE_CORRELATION_DATA = 9,
+	MQTTPROPERTY_CODE_SUBSCRIPTION_IDENTIFIER = 11,
+	MQTTPROPERTY_CODE_SESSION_EXPIRY_INTERVAL = 17,
+	MQTTPROPERTY_CODE_ASSIGNED_CLIENT_IDENTIFIER = 18,
+	MQTTPROPERTY_CODE_SERVER_KEEP_ALIVE = 19,
+	MQTTPROPERTY_CODE_AUTHENTICATION_METHOD = 21,
+	MQTTPROPERTY_CODE_AUTHENTICATION_DATA = 22,
+	MQTTPROPERTY_CODE_REQUEST_PROBLEM_INFORMATION = 23,
+	MQTTPROPERTY_CODE_WILL_DELAY_INTERVAL = 24,
+	MQTTPROPERTY_CODE_REQUEST_RESPONSE_INFORMATION = 25,
+	MQTTPROPERTY_CODE_RESPONSE_INFORMATION = 26,
+	MQTTPROPERTY_CODE_SERVER_REFERENCE = 28,
+	MQTTPROPERTY_CODE_REASON_STRING = 31,
+	MQTTPROPERTY_CODE_RECEIVE_MAXIMUM = 33,
+	MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM = 34,
+	MQTTPROPERTY_CODE_TOPIC_ALIAS = 35,
+	MQTTPROPERTY_CODE_MAXIMUM_QOS = 36,
+	MQTTPROPERTY_CODE_RETAIN_AVAILABLE = 37,
+	MQTTPROPERTY_CODE_USER_PROPERTY = 38,
+	MQTTPROPERTY_CODE_MAXIMUM_PACKET_SIZE = 39,
+	MQTTPROPERTY_CODE_WILDCARD_SUBSCRIPTION_AVAILABLE = 40,
+	MQTTPROPERTY_CODE_SUBSCRIPTION_IDENTIFIERS_AVAILABLE = 41,
+	MQTTPROPERTY_CODE_SHARED_SUBSCRIPTION_AVAILABLE = 42
+};
+
+/** The encodings of MQTT 5 property values */
+enum MQTTPropertyTypes
+{
+	MQTTPROPERTY_TYPE_BYTE,
+	MQTTPROPERTY_TYPE_TWO_BYTE_INTEGER,
+	MQTTPROPERTY_TYPE_FOUR_BYTE_INTEGER,
+	MQTTPROPERTY_TYPE_VARIABLE_BYTE_INTEGER,
+	MQTTPROPERTY_TYPE_BINARY_DATA,
+	MQTTPROPERTY_TYPE_UTF_8_ENCODED_STRING,
+	MQTTPROPERTY_TYPE_UTF_8_STRING_PAIR
+};
+
+/** MQTT 5 reason codes, returned in CONNACK, PUBACK, PUBREC, PUBREL, PUBCOMP, SUBACK, UNSUBACK and
+  * DISCONNECT.  Those from 0x80 on are failures. */
+enum MQTTReasonCodes
+{
+	MQTTREASONCODE_SUCCESS = 0,
+	MQTTREASONCODE_NORMAL_DISCONNECTION = 0,
+	MQTTREASONCODE_GRANTED_QOS_0 = 0,
+	MQTTREASONCODE_GRANTED_QOS_1 = 1,
+	MQTTREASONCODE_GRANTED_QOS_2 = 2,
+	MQTTREASONCODE_DISCONNECT_WITH_WILL_MESSAGE = 4,
+	MQTTREASONCODE_NO_MATCHING_SUBSCRIBERS = 16,
+	MQTTREASONCODE_NO_SUBSCRIPTION_FOUND = 17,
+	MQTTREASONCODE_UNSPECIFIED_ERROR = 0x80,
+	MQTTREASONCODE_MALFORMED_PACKET = 0x81,
+	MQTTREASONCODE_PROTOCOL_ERROR = 0x82,
+	MQTTREASONCODE_IMPLEMENTATION_SPECIFIC_ERROR = 0x83,
+	MQTTREASONCODE_UNSUPPORTED_PROTOCOL_VERSION = 0x84,
+	MQTTREASONCODE_CLIENT_IDENTIFIER_NOT_VALID = 0x85,
+	MQTTREASONCODE_BAD_USER_NAME_OR_PASSWORD = 0x86,
+	MQTTREASONCODE_NOT_AUTHORIZED = 0x87,
+	MQTTREASONCODE_SERVER_UNAVAILABLE = 0x88,
+	MQTTREASONCODE_SERVER_BUSY = 0x89,
+	MQTTREASONCODE_BANNED = 0x8A,
+	MQTTREASONCODE_SERVER_SHUTTING_DOWN = 0x8B,
+	MQTTREASONCODE_BAD_AUTHENTICATION_METHOD = 0x8C,
+	MQTTREASONCODE_KEEP_ALIVE_TIMEOUT = 0x8D,
+	MQTTREASONCODE_SESSION_TAKEN_OVER = 0x8E,
+	MQTTREASONCODE_TOPIC_FILTER_INVALID = 0x8F,
+	MQTTREASONCODE_TOPIC_NAME_INVALID = 0x90,
+	MQTTREASONCODE_PACKET_IDENTIFIER_IN_USE = 0x91,
+	MQTTREASONCODE_PACKET_IDENTIFIER_NOT_FOUND = 0x92,
+	MQTTREASONCODE_RECEIVE_MAXIMUM_EXCEEDED = 0x93,
+	MQTTREASONCODE_TOPIC_ALIAS_INVALID = 0x94,
+	MQTTREASONCODE_PACKET_TOO_LARGE = 0x95,
+	MQTTREASONCODE_MESSAGE_RATE_TOO_HIGH = 0x96,
+	MQTTREASONCODE_QUOTA_EXCEEDED = 0x97,
+	MQTTREASONCODE_ADMINISTRATIVE_ACTION = 0x98,
+	MQTTREASONCODE_PAYLOAD_FORMAT_INVALID = 0x99,
+	MQTTREASONCODE_RETAIN_NOT_SUPPORTED = 0x9A,
+	MQTTREASONCODE_QOS_NOT_SUPPORTED = 0x9B,
+	MQTTREASONCODE_USE_ANOTHER_SERVER = 0x9C,
+	MQTTREASONCODE_SERVER_MOVED = 0x9D,
+	MQTTREASONCODE_SHARED_SUBSCRIPTIONS_NOT_SUPPORTED = 0x9E,
+	MQTTREASONCODE_CONNECTION_RATE_EXCEEDED = 0x9F,
+	MQTTREASONCODE_MAXIMUM_CONNECT_TIME = 0xA0,
+	MQTTREASONCODE_SUBSCRIPTION_IDENTIFIERS_NOT_SUPPORTED = 0xA1,
+	MQTTREASONCODE_WILDCARD_SUBSCRIPTIONS_NOT_SUPPORTED = 0xA2
+};
+
+/**
+ * One MQTT 5 property.  Strings and binary data are not copied: when read, they point into the packet.
+ */
+typedef struct
+{
+	int identifier;			/**< one of MQTTPropertyCodes */
+	unsigned int value;		/**< of a byte, integer or variable byte integer property */
+	MQTTLenString data;		/**< of a string or binary data property, or the name of a user property */
+	MQTTLenString pair;		/**< the value of a user property */
+} MQTTProperty;
+
+/**
+ * The properties of a packet, in an array supplied by the caller
+ */
+typedef struct
+{
+	int count;				/**< the number of properties in array */
+	int max_count;			/**< the size of array */
+	int length;				/**< the serialized length of the properties, without the property length */
+	MQTTProperty* array;
+} MQTTProperties;
+
+#define MQTTProperties_initializer {0, 0, 0, NULL}
+
+int MQTTProperty_getType(int identifier);
+
+int MQTTProperties_len(MQTTProperties* properties);
+int MQTTProperties_add(MQTTProperties* properties, const MQTTProperty* property);
+void MQTTProperties_write(unsigned char** pptr, MQTTProperties* properties);
+int MQTTProperties_read(MQTTProperties* properties, unsigned char** pptr, unsigned char* enddata);
+int MQTTProperties_getNumericValue(MQTTProperties* properties, int identifier, unsigned int* value);
+
+#endif /* MQTTPROPERTIES_H_ */
@@ -19,10 +19,33 @@
 
 int MQTTSerialize_publish(unsigned char* buf, int buflen, unsigned char dup, int qos, unsigned char retained, unsigned short packetid,
 		MQTTString topicName, unsigned char* payload, int payloadlen);
+int MQTTSerialize_publishHeader(unsigned char* buf, int buflen, unsigned char dup, int qos, unsigned char retained, unsigned short packetid,
+		MQTTString topicName, int payloadlen);
+
+/** A topic name prepared for MQTTSerialize_preparedPublish, to publish to repeatedly */
+typedef struct
+{
+	char* topicName;	/* null-terminated, not copied */
+	int len;			/* its length, found once by MQTTSerialize_prepareTopic */
+} MQTTPreparedTopic;
+
+void MQTTSerialize_prepareTopic(MQTTPreparedTopic* topic, char* topicName);
+int MQTTSerialize_preparedPublish(unsigned char* buf, int buflen, unsigned char dup, int qos, unsigned char retained,
+		unsigned short packetid, MQTTPreparedTopic* topic, unsigned char* payload, int payloadlen);
 
 int MQTTDeserialize_publish(unsigned char* dup, int* qos, unsigned char* retained, unsigned short* packetid, MQTTString* topicName,
 		unsigned char** payload, int* payloadlen, unsigned char* buf, int len);
 
+int MQTTV5Serialize_publishLength(int qos, MQTTString topicName, MQTTProperties* properties, int payloadlen);
+int MQTTV5Serialize_publish(unsigned char* buf, int buflen, unsigned char dup, int qos, unsigned char retained, unsigned short packetid,
+		MQTTString topicName, MQTTProperties* properties, unsigned char* payload, int payloadlen);
+int MQTTV5Serialize_publishHeader(unsigned char* buf, int buflen, unsigned char dup, int qos, unsigned char retained, unsigned short packetid,
+		MQTTString topicName, MQTTProperties* properties, int payloadlen);
+int MQTTV5Deserialize_publish(unsigned char* dup, int* qos, unsigned char* retained, unsigned short* packetid, MQTTString* topicName,
+		MQTTProperties* properties, unsigned char** payload, int* payloadlen, unsigned char* buf, int len);
+int MQTTV5Deserialize_ack(unsigned char* packettype, unsigned char* dup, unsigned short* packetid, unsigned char* reasonCode,
+		MQTTProperties* properties, unsigned char* buf, int buflen);
+
 int MQTTSerialize_puback(unsigned char* buf, int buflen, unsigned short packetid);
 int MQTTSerialize_pubrel(unsigned char* buf, int buflen, unsigned char dup, unsigned short packetid);
 int MQTTSerialize_pubcomp(unsigned char* buf, int buflen, unsigned short packetid);
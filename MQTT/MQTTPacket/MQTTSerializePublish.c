@@ -29,12 +29,28 @@
   * @return the length of buffer needed to contain the serialized version of the packet
   */
 int MQTTSerialize_publishLength(int qos, MQTTString topicName, int payloadlen)
+{
+	return MQTTV5Serialize_publishLength(qos, topicName, NULL, payloadlen);
+}
+
+
+/**
+  * Determines the length of the MQTT publish packet that would be produced using the supplied parameters
+  * @param qos the MQTT QoS of the publish (packetid is omitted for QoS 0)
+  * @param topicName the topic name to be used in the publish
+  * @param properties the MQTT 5 properties of the publish, or NULL for an MQTT 3 publish
+  * @param payloadlen the length of the payload to be sent
+  * @return the length of buffer needed to contain the serialized version of the packet
+  */
+int MQTTV5Serialize_publishLength(int qos, MQTTString topicName, MQTTProperties* properties, int payloadlen)
 {
 	int len = 0;
 
 	len += 2 + MQTTstrlen(topicName) + payloadlen;
 	if (qos > 0)
 		len += 2; /* packetid */
+	if (properties)
+		len += MQTTProperties_len(properties);
 	return len;
 }
 
@@ -54,6 +70,67 @@ int MQTTSerialize_publishLength(int qos, MQTTString topicName, int payloadlen)
   */
 int MQTTSerialize_publish(unsigned char* buf, int buflen, unsigned char dup, int qos, unsigned char retained, unsigned short packetid,
 		MQTTString topicName, unsigned char* payload, int payloadlen)
+{
+	return MQTTV5Serialize_publish(buf, buflen, dup, qos, retained, packetid, topicName, NULL, payload, payloadlen);
+}
+
+
+/**
+  * Serializes the supplied publish data into the supplied buffer, as MQTTSerialize_publish, with MQTT 5 properties
+  * @param properties the MQTT 5 properties of the publish, such as its topic alias, or NULL for an MQTT 3 publish
+  * @return the length of the serialized data.  <= 0 indicates error
+  */
+int MQTTV5Serialize_publish(unsigned char* buf, int buflen, unsigned char dup, int qos, unsigned char retained, unsigned short packetid,
+		MQTTString topicName, MQTTProperties* properties, unsigned char* payload, int payloadlen)
+{
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (MQTTPacket_len(MQTTV5Serialize_publishLength(qos, topicName, properties, payloadlen)) > buflen)
+	{
+		rc = MQTTPACKET_BUFFER_TOO_SHORT;
+		goto exit;
+	}
+
+	if ((rc = MQTTV5Serialize_publishHeader(buf, buflen, dup, qos, retained, packetid, topicName, properties, payloadlen)) <= 0)
+		goto exit;
+
+	memcpy(buf + rc, payload, payloadlen);
+	rc += payloadlen;
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+  * Serializes everything of a publish packet up to the payload, so that the payload can be sent
+  * straight from where it is held rather than copied into the buffer
+  * @param buf the buffer into which the packet header will be serialized
+  * @param buflen the length in bytes of the supplied buffer
+  * @param dup integer - the MQTT dup flag
+  * @param qos integer - the MQTT QoS value
+  * @param retained integer - the MQTT retained flag
+  * @param packetid integer - the MQTT packet identifier
+  * @param topicName MQTTString - the MQTT topic in the publish
+  * @param payloadlen integer - the length of the MQTT payload which is to follow
+  * @return the length of the serialized data, to be followed by payloadlen bytes of payload.  <= 0 indicates error
+  */
+int MQTTSerialize_publishHeader(unsigned char* buf, int buflen, unsigned char dup, int qos, unsigned char retained, unsigned short packetid,
+		MQTTString topicName, int payloadlen)
+{
+	return MQTTV5Serialize_publishHeader(buf, buflen, dup, qos, retained, packetid, topicName, NULL, payloadlen);
+}
+
+
+/**
+  * Serializes everything of a publish packet up to the payload, as MQTTSerialize_publishHeader, with MQTT 5 properties
+  * @param properties the MQTT 5 properties of the publish, or NULL for an MQTT 3 publish
+  * @return the length of the serialized data, to be followed by payloadlen bytes of payload.  <= 0 indicates error
+  */
+int MQTTV5Serialize_publishHeader(unsigned char* buf, int buflen, unsigned char dup, int qos, unsigned char retained, unsigned short packetid,
+		MQTTString topicName, MQTTProperties* properties, int payloadlen)
 {
 	unsigned char *ptr = buf;
 	MQTTHeader header = {0};
@@ -61,7 +138,8 @@ int MQTTSerialize_publish(unsigned char* buf, int buflen, unsigned char dup, int
 	int rc = 0;
 
 	FUNC_ENTRY;
-	if (MQTTPacket_len(rem_len = MQTTSerialize_publishLength(qos, topicName, payloadlen)) > buflen)
+	rem_len = MQTTV5Serialize_publishLength(qos, topicName, properties, payloadlen);
+	if (MQTTPacket_len(rem_len) - payloadlen > buflen)
 	{
 		rc = MQTTPACKET_BUFFER_TOO_SHORT;
 		goto exit;
@@ -80,8 +158,8 @@ int MQTTSerialize_publish(unsigned char* buf, int buflen, unsigned char dup, int
 	if (qos > 0)
 		writeInt(&ptr, packetid);
 
-	memcpy(ptr, payload, payloadlen);
-	ptr += payloadlen;
+	if (properties)
+		MQTTProperties_write(&ptr, properties);
 
 	rc = ptr - buf;
 
@@ -91,6 +169,63 @@ exit:
 }
 
 
+/**
+  * Prepares a topic name to be published to with MQTTSerialize_preparedPublish
+  * @param topic the prepared topic to fill in
+  * @param topicName the null-terminated topic name, which must stay valid while the prepared topic is used
+  */
+void MQTTSerialize_prepareTopic(MQTTPreparedTopic* topic, char* topicName)
+{
+	topic->topicName = topicName;
+	topic->len = strlen(topicName);
+}
+
+
+/**
+  * Serializes a publish to a prepared topic into the supplied buffer, ready for sending.  The same as
+  * MQTTSerialize_publish, but the topic length is not found again for each publish, and the fixed header
+  * is written straight from the flags.
+  * @param buf the buffer into which the packet will be serialized
+  * @param buflen the length in bytes of the supplied buffer
+  * @param dup integer - the MQTT dup flag
+  * @param qos integer - the MQTT QoS value
+  * @param retained integer - the MQTT retained flag
+  * @param packetid integer - the MQTT packet identifier
+  * @param topic the topic prepared by MQTTSerialize_prepareTopic
+  * @param payload byte buffer - the MQTT publish payload
+  * @param payloadlen integer - the length of the MQTT payload
+  * @return the length of the serialized data.  <= 0 indicates error
+  */
+int MQTTSerialize_preparedPublish(unsigned char* buf, int buflen, unsigned char dup, int qos, unsigned char retained,
+		unsigned short packetid, MQTTPreparedTopic* topic, unsigned char* payload, int payloadlen)
+{
+	unsigned char *ptr = buf;
+	int rem_len = 2 + topic->len + ((qos > 0) ? 2 : 0) + payloadlen;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (MQTTPacket_len(rem_len) > buflen)
+	{
+		rc = MQTTPACKET_BUFFER_TOO_SHORT;
+		goto exit;
+	}
+
+	*ptr++ = (unsigned char)((PUBLISH << 4) | (dup ? 0x08 : 0) | (qos << 1) | (retained ? 0x01 : 0));
+	ptr += MQTTPacket_encode(ptr, rem_len);
+	writeInt(&ptr, topic->len);
+	memcpy(ptr, topic->topicName, topic->len);
+	ptr += topic->len;
+	if (qos > 0)
+		writeInt(&ptr, packetid);
+	memcpy(ptr, payload, payloadlen);
+	rc = ptr + payloadlen - buf;
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
 
 /**
   * Serializes the ack packet into the supplied buffer.
@@ -27,5 +27,11 @@ int MQTTSerialize_suback(unsigned char* buf, int buflen, unsigned short packetid
 
 int MQTTDeserialize_suback(unsigned short* packetid, int maxcount, int* count, int grantedQoSs[], unsigned char* buf, int len);
 
+int MQTTV5Serialize_subscribe(unsigned char* buf, int buflen, unsigned char dup, unsigned short packetid,
+		MQTTProperties* properties, int count, MQTTString topicFilters[], int requestedOptions[]);
+
+int MQTTV5Deserialize_suback(unsigned short* packetid, MQTTProperties* properties, int maxcount, int* count, int reasonCodes[],
+		unsigned char* buf, int len);
+
 
 #endif /* MQTTSUBSCRIBE_H_ */
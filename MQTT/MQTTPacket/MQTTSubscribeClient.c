@@ -23,13 +23,17 @@
   * Determines the length of the MQTT subscribe packet that would be produced using the supplied parameters
   * @param count the number of topic filter strings in topicFilters
   * @param topicFilters the array of topic filter strings to be used in the publish
+  * @param properties the MQTT 5 properties of the subscribe, or NULL for an MQTT 3 subscribe
   * @return the length of buffer needed to contain the serialized version of the packet
   */
-int MQTTSerialize_subscribeLength(int count, MQTTString topicFilters[])
+int MQTTSerialize_subscribeLength(int count, MQTTString topicFilters[], MQTTProperties* properties)
 {
 	int i;
 	int len = 2; /* packetid */
 
+	if (properties)
+		len += MQTTProperties_len(properties);
+
 	for (i = 0; i < count; ++i)
 		len += 2 + MQTTstrlen(topicFilters[i]) + 1; /* length + topic + req_qos */
 	return len;
@@ -49,6 +53,20 @@ int MQTTSerialize_subscribeLength(int count, MQTTString topicFilters[])
   */
 int MQTTSerialize_subscribe(unsigned char* buf, int buflen, unsigned char dup, unsigned short packetid, int count,
 		MQTTString topicFilters[], int requestedQoSs[])
+{
+	return MQTTV5Serialize_subscribe(buf, buflen, dup, packetid, NULL, count, topicFilters, requestedQoSs);
+}
+
+
+/**
+  * Serializes the supplied subscribe data into the supplied buffer, as MQTTSerialize_subscribe, with MQTT 5 properties
+  * @param properties the properties of the subscribe, or NULL for an MQTT 3 subscribe
+  * @param requestedOptions - array of MQTT 5 subscription options: the maximum QoS, in the low 2 bits, then the
+  *   no local, retain as published and, in 2 bits, retain handling options
+  * @return the length of the serialized data.  <= 0 indicates error
+  */
+int MQTTV5Serialize_subscribe(unsigned char* buf, int buflen, unsigned char dup, unsigned short packetid,
+		MQTTProperties* properties, int count, MQTTString topicFilters[], int requestedOptions[])
 {
 	unsigned char *ptr = buf;
 	MQTTHeader header = {0};
@@ -57,7 +75,7 @@ int MQTTSerialize_subscribe(unsigned char* buf, int buflen, unsigned char dup, u
 	int i = 0;
 
 	FUNC_ENTRY;
-	if (MQTTPacket_len(rem_len = MQTTSerialize_subscribeLength(count, topicFilters)) > buflen)
+	if (MQTTPacket_len(rem_len = MQTTSerialize_subscribeLength(count, topicFilters, properties)) > buflen)
 	{
 		rc = MQTTPACKET_BUFFER_TOO_SHORT;
 		goto exit;
@@ -73,10 +91,13 @@ int MQTTSerialize_subscribe(unsigned char* buf, int buflen, unsigned char dup, u
 
 	writeInt(&ptr, packetid);
 
+	if (properties)
+		MQTTProperties_write(&ptr, properties);
+
 	for (i = 0; i < count; ++i)
 	{
 		writeMQTTString(&ptr, topicFilters[i]);
-		writeChar(&ptr, requestedQoSs[i]);
+		writeChar(&ptr, requestedOptions[i]);
 	}
 
 	rc = ptr - buf;
@@ -98,6 +119,25 @@ exit:
   * @return error code.  1 is success, 0 is failure
   */
 int MQTTDeserialize_suback(unsigned short* packetid, int maxcount, int* count, int grantedQoSs[], unsigned char* buf, int buflen)
+{
+	return MQTTV5Deserialize_suback(packetid, NULL, maxcount, count, grantedQoSs, buf, buflen);
+}
+
+
+/**
+  * Deserializes the supplied (wire) buffer into MQTT 5 suback data
+  * @param packetid returned integer - the MQTT packet identifier
+  * @param properties returned - the properties of the suback, as many as fit in its array, or NULL to read an
+  *   MQTT 3 suback
+  * @param maxcount - the maximum number of members allowed in the reasonCodes array
+  * @param count returned integer - number of members in the reasonCodes array
+  * @param reasonCodes returned array of integers - the granted QoS, or from 0x80 on the reason for the failure
+  * @param buf the raw buffer data, of the correct length determined by the remaining length field
+  * @param buflen the length in bytes of the data in the supplied buffer
+  * @return error code.  1 is success, 0 is failure
+  */
+int MQTTV5Deserialize_suback(unsigned short* packetid, MQTTProperties* properties, int maxcount, int* count, int reasonCodes[],
+		unsigned char* buf, int buflen)
 {
 	MQTTHeader header = {0};
 	unsigned char* curdata = buf;
@@ -116,16 +156,21 @@ int MQTTDeserialize_suback(unsigned short* packetid, int maxcount, int* count, i
 		goto exit;
 
 	*packetid = readInt(&curdata);
+	if (properties && !MQTTProperties_read(properties, &curdata, enddata))
+	{
+		rc = 0;
+		goto exit;
+	}
 
 	*count = 0;
 	while (curdata < enddata)
 	{
-		if (*count > maxcount)
+		if (*count == maxcount)
 		{
 			rc = -1;
 			goto exit;
 		}
-		grantedQoSs[(*count)++] = readChar(&curdata);
+		reasonCodes[(*count)++] = (unsigned char)readChar(&curdata); /* 0x80 for a failure, where char is signed too */
 	}
 
 	rc = 1;
@@ -27,4 +27,10 @@ int MQTTSerialize_unsuback(unsigned char* buf, int buflen, unsigned short packet
 
 int MQTTDeserialize_unsuback(unsigned short* packetid, unsigned char* buf, int len);
 
+int MQTTV5Serialize_unsubscribe(unsigned char* buf, int buflen, unsigned char dup, unsigned short packetid,
+		MQTTProperties* properties, int count, MQTTString topicFilters[]);
+
+int MQTTV5Deserialize_unsuback(unsigned short* packetid, MQTTProperties* properties, int maxcount, int* count, int reasonCodes[],
+		unsigned char* buf, int len);
+
 #endif /* MQTTUNSUBSCRIBE_H_ */
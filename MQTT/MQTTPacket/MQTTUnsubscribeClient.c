@@ -23,13 +23,17 @@
   * Determines the length of the MQTT unsubscribe packet that would be produced using the supplied parameters
   * @param count the number of topic filter strings in topicFilters
   * @param topicFilters the array of topic filter strings to be used in the publish
+  * @param properties the MQTT 5 properties of the unsubscribe, or NULL for an MQTT 3 unsubscribe
   * @return the length of buffer needed to contain the serialized version of the packet
   */
-int MQTTSerialize_unsubscribeLength(int count, MQTTString topicFilters[])
+int MQTTSerialize_unsubscribeLength(int count, MQTTString topicFilters[], MQTTProperties* properties)
 {
 	int i;
 	int len = 2; /* packetid */
 
+	if (properties)
+		len += MQTTProperties_len(properties);
+
 	for (i = 0; i < count; ++i)
 		len += 2 + MQTTstrlen(topicFilters[i]); /* length + topic*/
 	return len;
@@ -48,6 +52,18 @@ int MQTTSerialize_unsubscribeLength(int count, MQTTString topicFilters[])
   */
 int MQTTSerialize_unsubscribe(unsigned char* buf, int buflen, unsigned char dup, unsigned short packetid,
 		int count, MQTTString topicFilters[])
+{
+	return MQTTV5Serialize_unsubscribe(buf, buflen, dup, packetid, NULL, count, topicFilters);
+}
+
+
+/**
+  * Serializes the supplied unsubscribe data into the supplied buffer, as MQTTSerialize_unsubscribe, with MQTT 5 properties
+  * @param properties the properties of the unsubscribe, or NULL for an MQTT 3 unsubscribe
+  * @return the length of the serialized data.  <= 0 indicates error
+  */
+int MQTTV5Serialize_unsubscribe(unsigned char* buf, int buflen, unsigned char dup, unsigned short packetid,
+		MQTTProperties* properties, int count, MQTTString topicFilters[])
 {
 	unsigned char *ptr = buf;
 	MQTTHeader header = {0};
@@ -56,7 +72,7 @@ int MQTTSerialize_unsubscribe(unsigned char* buf, int buflen, unsigned char dup,
 	int i = 0;
 
 	FUNC_ENTRY;
-	if (MQTTPacket_len(rem_len = MQTTSerialize_unsubscribeLength(count, topicFilters)) > buflen)
+	if (MQTTPacket_len(rem_len = MQTTSerialize_unsubscribeLength(count, topicFilters, properties)) > buflen)
 	{
 		rc = MQTTPACKET_BUFFER_TOO_SHORT;
 		goto exit;
@@ -72,6 +88,9 @@ int MQTTSerialize_unsubscribe(unsigned char* buf, int buflen, unsigned char dup,
 
 	writeInt(&ptr, packetid);
 
+	if (properties)
+		MQTTProperties_write(&ptr, properties);
+
 	for (i = 0; i < count; ++i)
 		writeMQTTString(&ptr, topicFilters[i]);
 
@@ -104,3 +123,46 @@ int MQTTDeserialize_unsuback(unsigned short* packetid, unsigned char* buf, int b
 }
 
 
+/**
+  * Deserializes the supplied (wire) buffer into MQTT 5 unsuback data
+  * @param packetid returned integer - the MQTT packet identifier
+  * @param properties returned - the properties of the unsuback, as many as fit in its array, or NULL
+  * @param maxcount - the maximum number of members allowed in the reasonCodes array
+  * @param count returned integer - number of members in the reasonCodes array
+  * @param reasonCodes returned array of integers - 0 for success, or from 0x80 on the reason for the failure
+  * @param buf the raw buffer data, of the correct length determined by the remaining length field
+  * @param buflen the length in bytes of the data in the supplied buffer
+  * @return error code.  1 is success, 0 is failure
+  */
+int MQTTV5Deserialize_unsuback(unsigned short* packetid, MQTTProperties* properties, int maxcount, int* count, int reasonCodes[],
+		unsigned char* buf, int buflen)
+{
+	MQTTHeader header = {0};
+	unsigned char* curdata = buf;
+	unsigned char* enddata = NULL;
+	int rc = 0;
+	int mylen;
+
+	FUNC_ENTRY;
+	header.byte = readChar(&curdata);
+	if (header.bits.type != UNSUBACK)
+		goto exit;
+
+	curdata += MQTTPacket_decodeBuf(curdata, &mylen); /* read remaining length */
+	enddata = curdata + mylen;
+	if (enddata - curdata < 2)
+		goto exit;
+
+	*packetid = readInt(&curdata);
+	if (properties && !MQTTProperties_read(properties, &curdata, enddata))
+		goto exit;
+
+	*count = 0;
+	while (curdata < enddata && *count < maxcount)
+		reasonCodes[(*count)++] = (unsigned char)readChar(&curdata);
+
+	rc = 1;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
@@ -0,0 +1,174 @@
+#if !defined(MQTTPUBLISHQUEUE_H)
+#define MQTTPUBLISHQUEUE_H
+
+#include "MQTTClient.h"
+#include "mbed_critical.h"
+#include <stdint.h>
+#include <string.h>
+
+namespace MQTT
+{
+
+/**
+ * @class PublishQueue
+ * @brief bounded lock-free queue of publishes from any number of threads, drained by the one thread using a Client
+ *
+ * Producers copy their message into a slot and never wait for the network, or for each other beyond a
+ * compare and swap: a message which finds the queue full is dropped and counted.  Each slot holds the
+ * flags, lengths, topic and payload ready to be handed to the client, which adds the packet id and fixed
+ * header as it sends it.  The positions and slot sequence numbers are only changed with core_util_atomic
+ * operations, as in Dmitry Vyukov's bounded queue.
+ * @param SLOTS the number of messages which can be queued, a power of 2
+ * @param MAX_RECORD the size of a slot, which the topic with its null and the payload must fit in
+ */
+template<int SLOTS = 8, int MAX_RECORD = 128>
+class PublishQueue
+{
+public:
+
+    PublishQueue()
+    {
+        for (uint32_t i = 0; i < SLOTS; ++i)
+            slots[i].sequence = i;
+        enqueue_pos = dequeue_pos = 0;
+        drops = 0;
+        held_id = 0;
+    }
+
+    /** Queue a message, from any thread
+     *  @param topicName - the topic to publish to
+     *  @param payload - the data to send, copied
+     *  @param payloadlen - the length of the data
+     *  @param qos - the QoS to send the publish at
+     *  @param retained - whether the message should be retained
+     *  @return flag - false if the message was dropped, as the queue was full or it does not fit in a slot
+     */
+    bool publish(const char* topicName, const void* payload, size_t payloadlen, enum QoS qos = QOS0, bool retained = false)
+    {
+        size_t topiclen = strlen(topicName) + 1;
+        uint32_t pos = enqueue_pos;
+        Slot* slot = 0;
+
+        if (topiclen + payloadlen > MAX_RECORD)
+            goto drop;
+        while (true)
+        {
+            slot = &slots[pos & (SLOTS - 1)];
+            int32_t dif = (int32_t)(slot->sequence - pos);
+            if (dif == 0)
+            {
+                if (core_util_atomic_cas_u32(&enqueue_pos, &pos, pos + 1))
+                    break;  // the slot is ours - else pos is now the latest position
+            }
+            else if (dif < 0)
+                goto drop;  // the slot a lap behind has not been drained yet
+            else
+                pos = enqueue_pos;
+        }
+
+        slot->qos = qos;
+        slot->retained = retained;
+        slot->topiclen = topiclen;
+        slot->payloadlen = payloadlen;
+        memcpy(slot->data, topicName, topiclen);
+        memcpy(slot->data + topiclen, payload, payloadlen);
+        core_util_atomic_incr_u32(&slot->sequence, 1);  // to pos + 1, ready to drain
+        return true;
+
+    drop:
+        core_util_atomic_incr_u32(&drops, 1);
+        return false;
+    }
+
+    /** Publish queued messages through the client, in order, from the thread which uses the client
+     *  @param client - an MQTT::Client, connected
+     *  @param max - the most messages to publish
+     *  @return the number of messages published - fewer than are queued if the client failed or is disconnected
+     */
+    template<class Client>
+    int drain(Client& client, int max = SLOTS)
+    {
+        int count = 0;
+
+        while (count < max && client.isConnected())
+        {
+            uint32_t pos = dequeue_pos;
+            Slot* slot = &slots[pos & (SLOTS - 1)];
+            unsigned short id = 0;
+
+            if ((int32_t)(slot->sequence - (pos + 1)) < 0)
+                break;  // empty
+#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+            if (held_id != 0)
+            {
+                if (client.isInflight(held_id))
+                    break;  // being sent again by the client since it reconnected
+            }
+            else
+#endif
+            if (client.publish(slot->data, slot->data + slot->topiclen, slot->payloadlen, id, slot->qos, slot->retained) != SUCCESS)
+            {
+#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+                if (id != 0 && client.isInflight(id))
+                    held_id = id;   // kept by the client to send again on reconnect, from this slot
+#endif
+                break;
+            }
+            held_id = 0;
+            dequeue_pos = pos + 1;
+            core_util_atomic_incr_u32(&slot->sequence, SLOTS - 1);   // to pos + SLOTS, free for the next lap
+            ++count;
+        }
+        return count;
+    }
+
+    /** The length of the topic with its null and the payload of the next message to drain, from the thread
+     *  which drains the queue
+     *  @return the length, or -1 if the queue is empty
+     */
+    int peekLength()
+    {
+        Slot* slot = &slots[dequeue_pos & (SLOTS - 1)];
+
+        if ((int32_t)(slot->sequence - (dequeue_pos + 1)) < 0)
+            return -1;
+        return (int)(slot->topiclen + slot->payloadlen);
+    }
+
+    /** The number of messages queued
+     */
+    int depth()
+    {
+        return (int)(enqueue_pos - dequeue_pos);
+    }
+
+    /** The number of messages dropped since the queue was constructed
+     */
+    uint32_t dropped()
+    {
+        return drops;
+    }
+
+private:
+
+    struct Slot
+    {
+        volatile uint32_t sequence; // pos when free for the producer at pos, pos + 1 when filled by it
+        enum QoS qos;
+        bool retained;
+        size_t topiclen;            // including the null
+        size_t payloadlen;
+        char data[MAX_RECORD];      // topic, then payload
+    } slots[SLOTS];
+
+    typedef char slots_power_of_2[(SLOTS & (SLOTS - 1)) == 0 ? 1 : -1];
+
+    volatile uint32_t enqueue_pos;  // next position to fill
+    volatile uint32_t dequeue_pos;  // next position to drain, only changed by the draining thread
+    volatile uint32_t drops;
+    unsigned short held_id;         // packet id of the first message, if the client kept it after failing to publish it
+};
+
+}
+
+#endif
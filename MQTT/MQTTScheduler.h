@@ -0,0 +1,228 @@
+#if !defined(MQTTSCHEDULER_H)
+#define MQTTSCHEDULER_H
+
+#include "MQTTClient.h"
+#include "MQTTPublishQueue.h"
+#include <stdint.h>
+
+namespace MQTT
+{
+
+/** Priority classes of a Scheduler with the default three, most urgent first
+ */
+enum Priority { PRIORITY_ALARM, PRIORITY_CONTROL, PRIORITY_TELEMETRY };
+
+
+/**
+ * @class Scheduler
+ * @brief rate limited outbound publishes in priority classes, in front of the one thread using a Client
+ *
+ * Each class has a PublishQueue, which any thread can publish to, and a token bucket of bytes per second
+ * with a burst size.  drain always sends the message from the most urgent class that has one queued and
+ * tokens for it, so alarms are not held behind telemetry.  It stops once the whole link's bucket, if set,
+ * has too few tokens for that message, rather than letting a less urgent class use up the link.  Costs
+ * are the topic and payload lengths plus a few bytes of header.  Tokens are added when drain or wait_ms
+ * is called, for the time since, counting no more than a minute.
+ * Pings are sent by the client's own keepalive from within each cycle, never through the scheduler, so
+ * they are never held behind queued data.
+ * @param Timer the timer class used by the Client, such as Countdown
+ * @param CLASSES the number of priority classes, 0 the most urgent
+ * @param SLOTS the number of messages which can be queued in each class, a power of 2
+ * @param MAX_RECORD the size of a slot, which the topic with its null and the payload must fit in
+ */
+template<class Timer, int CLASSES = 3, int SLOTS = 8, int MAX_RECORD = 128>
+class Scheduler
+{
+public:
+
+    Scheduler()
+    {
+        clock.countdown_ms(CLOCK_MS);
+    }
+
+    /** Limit a class.  Classes start unlimited.
+     *  @param priority - the class, 0 the most urgent
+     *  @param rate - bytes per second, or 0 for no limit
+     *  @param burst - the most bytes that can be sent at once after the class has been idle
+     */
+    void setRate(int priority, unsigned int rate, unsigned int burst)
+    {
+        classes[priority].bucket.set(rate, burst);
+    }
+
+    /** Limit all classes together, to the uplink's rate.  Unlimited to start with.
+     *  @param rate - bytes per second, or 0 for no limit
+     *  @param burst - the most bytes that can be sent at once after the link has been idle
+     */
+    void setLinkRate(unsigned int rate, unsigned int burst)
+    {
+        link.set(rate, burst);
+    }
+
+    /** Queue a message in a class, from any thread
+     *  @param priority - the class, 0 the most urgent
+     *  @return flag - false if the message was dropped, as the class's queue was full or it does not fit in a slot
+     */
+    bool publish(int priority, const char* topicName, const void* payload, size_t payloadlen, enum QoS qos = QOS0, bool retained = false)
+    {
+        return classes[priority].queue.publish(topicName, payload, payloadlen, qos, retained);
+    }
+
+    /** Publish queued messages through the client as their classes' tokens allow, most urgent first, from
+     *  the thread which uses the client
+     *  @param client - an MQTT::Client, connected
+     *  @param max - the most messages to publish
+     *  @return the number of messages published
+     */
+    template<class Client>
+    int drain(Client& client, int max = CLASSES * SLOTS)
+    {
+        int count = 0;
+
+        refill();
+        while (count < max)
+        {
+            int i = next();
+            int cost = (i < 0) ? 0 : classes[i].queue.peekLength() + HEADER;
+
+            if (i < 0 || !link.allows(cost))
+                break;
+            if (classes[i].queue.drain(client, 1) != 1)
+                break;  // the client failed or is disconnected
+            classes[i].bucket.take(cost);
+            link.take(cost);
+            ++count;
+        }
+        return count;
+    }
+
+    /** The time until drain could next publish, for an event loop to wait
+     *  @return milliseconds, 0 if a message can be published now, or -1 if none is queued
+     */
+    int wait_ms()
+    {
+        int wait = -1;
+
+        refill();
+        for (int i = 0; i < CLASSES; ++i)
+        {
+            int len = classes[i].queue.peekLength();
+            int ms;
+
+            if (len < 0)
+                continue;
+            ms = classes[i].bucket.wait_ms(len + HEADER);
+            if (link.wait_ms(len + HEADER) > ms)
+                ms = link.wait_ms(len + HEADER);
+            if (wait < 0 || ms < wait)
+                wait = ms;
+        }
+        return wait;
+    }
+
+    /** The number of messages queued in a class
+     */
+    int depth(int priority)
+    {
+        return classes[priority].queue.depth();
+    }
+
+    /** The number of messages dropped from a class since the scheduler was constructed
+     */
+    uint32_t dropped(int priority)
+    {
+        return classes[priority].queue.dropped();
+    }
+
+private:
+
+    enum { CLOCK_MS = 60000,    // the longest time counted between refills
+           HEADER = 6 };        // fixed header, topic length and packet id, near enough
+
+    // tokens are in thousandths of a byte, so that each millisecond adds rate of them
+    struct Bucket
+    {
+        Bucket()
+        {
+            set(0, 0);
+        }
+
+        void set(unsigned int aRate, unsigned int aBurst)
+        {
+            rate = aRate;
+            burst = (int32_t)aBurst * 1000;
+            tokens = burst;
+        }
+
+        void add(int ms)
+        {
+            int64_t t = tokens + (int64_t)rate * ms;
+            tokens = (t > burst) ? burst : (int32_t)t;
+        }
+
+        // a message larger than the burst needs a full bucket, and leaves it in debt
+        bool allows(int cost)
+        {
+            return rate == 0 || tokens >= need(cost);
+        }
+
+        void take(int cost)
+        {
+            if (rate != 0)
+                tokens -= cost * 1000;
+        }
+
+        int wait_ms(int cost)
+        {
+            return allows(cost) ? 0 : (int)((need(cost) - tokens + rate - 1) / rate);
+        }
+
+        int32_t need(int cost)
+        {
+            return (cost * 1000 < burst) ? cost * 1000 : burst;
+        }
+
+        unsigned int rate;  // bytes per second, 0 for no limit
+        int32_t burst;
+        int32_t tokens;
+    };
+
+    struct Class
+    {
+        PublishQueue<SLOTS, MAX_RECORD> queue;
+        Bucket bucket;
+    } classes[CLASSES];
+
+    Bucket link;
+    Timer clock;    // counting down from CLOCK_MS since the last refill
+
+    // the most urgent class with a message queued and the tokens to send it, or -1
+    int next()
+    {
+        for (int i = 0; i < CLASSES; ++i)
+        {
+            int len = classes[i].queue.peekLength();
+            if (len >= 0 && classes[i].bucket.allows(len + HEADER))
+                return i;
+        }
+        return -1;
+    }
+
+    void refill()
+    {
+        int elapsed = CLOCK_MS - clock.left_ms();
+
+        if (elapsed <= 0)
+            return;
+        if (elapsed > CLOCK_MS)
+            elapsed = CLOCK_MS;
+        clock.countdown_ms(CLOCK_MS);
+        for (int i = 0; i < CLASSES; ++i)
+            classes[i].bucket.add(elapsed);
+        link.add(elapsed);
+    }
+};
+
+}
+
+#endif
@@ -2,76 +2,92 @@
 #define MQTTSOCKET_H
 
 #include "MQTTmbed.h"
-#include <EthernetInterface.h>
-#include <Timer.h>
+#include "NetworkInterface.h"
+#include "TCPSocket.h"
 
+#if !defined(MQTTSOCKET_POLL_MS)
+    #define MQTTSOCKET_POLL_MS 50   // longest wait for a sigio before trying again, as not every stack signals data
+#endif
+
+/**
+ * A TCP socket for MQTT::Client which keeps to the timeout of each read and write.  The socket is
+ * non-blocking: while it would block, the call waits on a semaphore released by the socket's sigio,
+ * for no longer than the time left or MQTTSOCKET_POLL_MS, then tries again.  Where the stack waits for
+ * data itself, as the ISM43362 does, the socket option which sets that wait can be given, and each receive
+ * then waits there for the time left up to MQTTSOCKET_POLL_MS, so the module is not held for longer.
+ * The sigio can also be passed on to the client, to read packets when they arrive.
+ */
 class MQTTSocket
 {
 public:
-    MQTTSocket(EthernetInterface *anet)
+    /* recv_timeout_opt is the option, at level NSAPI_SOCKET, for the milliseconds the stack waits for data
+       in a receive, such as ISM43362_SOCKOPT_RECV_TIMEOUT, or 0 if it has none.
+    */
+    MQTTSocket(NetworkInterface* anet, int recv_timeout_opt = 0) : event(0, 1)
     {
         net = anet;
+        recv_opt = recv_timeout_opt;
         open = false;
     }
-    
-    int connect(char* hostname, int port, int timeout=1000)
+
+    int connect(const char* hostname, int port, int timeout=1000)
     {
         if (open)
             disconnect();
         nsapi_error_t rc = mysock.open(net);
+        if (rc != NSAPI_ERROR_OK)
+            return rc;
         open = true;
         mysock.set_blocking(true);
-        mysock.set_timeout((unsigned int)timeout);  
+        mysock.set_timeout((unsigned int)timeout);
         rc = mysock.connect(hostname, port);
-        mysock.set_blocking(false);  // blocking timeouts seem not to work
+        mysock.set_blocking(false);
+        mysock.sigio(callback(this, &MQTTSocket::signal));
         return rc;
     }
 
-    // common read/write routine, avoiding blocking timeouts
-    int common(unsigned char* buffer, int len, int timeout, bool read)
+    /* returns the number of bytes read, which could be 0 or less than len, as soon as any are available.
+       -1 if there was an error on the socket
+    */
+    int read(unsigned char* buffer, int len, int timeout)
     {
-        timer.start();
-        mysock.set_blocking(false); // blocking timeouts seem not to work
-        int bytes = 0;
-        bool first = true;
-        do 
+        Countdown timer(timeout);
+
+        while (true)
         {
-            if (first)
-                first = false;
-            else
-                wait_ms(timeout < 100 ? timeout : 100);
-            int rc;
-            if (read)
-                rc = mysock.recv((char*)buffer, len);
-            else
-                rc = mysock.send((char*)buffer, len);
-            if (rc < 0)
-            {
-                if (rc != NSAPI_ERROR_WOULD_BLOCK)
-                {
-                    bytes = -1;
-                    break;
-                }
-            } 
-            else
-                bytes += rc;
+            recvTimeout(timer.left_ms());
+            int rc = mysock.recv(buffer, len);
+            if (rc > 0)
+                return rc;
+            if (rc < 0 && rc != NSAPI_ERROR_WOULD_BLOCK)
+                return -1;
+            if (timer.expired())
+                return 0;
+            wait(timer);
         }
-        while (bytes < len && timer.read_ms() < timeout);
-        timer.stop();
-        return bytes;
     }
 
-    /* returns the number of bytes read, which could be 0.
+    /* returns the number of bytes written, less than len if the timeout expired first.
        -1 if there was an error on the socket
     */
-    int read(unsigned char* buffer, int len, int timeout)
-    {
-        return common(buffer, len, timeout, true);
-    }
-
     int write(unsigned char* buffer, int len, int timeout)
     {
-        return common(buffer, len, timeout, false);
+        Countdown timer(timeout);
+        int sent = 0;
+
+        while (sent < len)
+        {
+            int rc = mysock.send(buffer + sent, len - sent);
+            if (rc < 0 && rc != NSAPI_ERROR_WOULD_BLOCK)
+                return -1;
+            if (rc > 0)
+                sent += rc;
+            else if (timer.expired())
+                break;
+            else
+                wait(timer);
+        }
+        return sent;
     }
 
     int disconnect()
@@ -80,17 +96,48 @@ public:
         return mysock.close();
     }
 
-    /*bool is_connected()
+    /* calls method on obj from the socket's sigio, which can be in interrupt context, until obj is 0.
+       The ISM43362 driver raises it only when the link comes back, not when data arrives.
+    */
+    template<class T>
+    void sigio(T* obj, void (T::*method)())
     {
-        return mysock.is_connected();
-    }*/
+        if (obj)
+            readable = callback(obj, method);
+        else
+            readable = Callback<void()>();
+    }
 
 private:
 
     bool open;
     TCPSocket mysock;
-    EthernetInterface *net;
-    Timer timer;
+    NetworkInterface *net;
+    int recv_opt;       // the stack's receive timeout option, or 0
+    Semaphore event;    // released by sigio
+    Callback<void()> readable;  // also called by sigio
+
+    void signal()
+    {
+        event.release();
+        if (readable)
+            readable();
+    }
+
+    void wait(Countdown& timer)
+    {
+        int left = timer.left_ms();
+        event.wait((left < MQTTSOCKET_POLL_MS) ? left : MQTTSOCKET_POLL_MS);
+    }
+
+    // how long the stack may wait for data in a receive, where it does so itself
+    void recvTimeout(int left)
+    {
+        if (recv_opt == 0)
+            return;
+        int ms = (left < 1) ? 1 : (left < MQTTSOCKET_POLL_MS) ? left : MQTTSOCKET_POLL_MS;
+        mysock.setsockopt(NSAPI_SOCKET, recv_opt, &ms, sizeof(ms));
+    }
 
 };
 
@@ -0,0 +1,166 @@
+#if !defined(MQTTTOPICTRIE_H)
+#define MQTTTOPICTRIE_H
+
+#include "MQTTPacket.h"
+#include <string.h>
+
+namespace MQTT
+{
+
+/**
+ * @class TopicTrie
+ * @brief index of topic filters, by topic level, for matching topic names against them
+ *
+ * Each node is one level of one or more filters, so matching a topic name costs in proportion to
+ * its number of levels, not to the number of filters.  Filters are not copied: the nodes point into
+ * them, so they must stay valid while in the trie.  Filters are only added, so the trie is rebuilt
+ * with clear and add whenever one is removed.
+ * @param MAX_NODES the size of the node pool - one node per level not shared with another filter
+ */
+template<int MAX_NODES>
+class TopicTrie
+{
+public:
+
+    TopicTrie()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        count = 1;
+        nodes[0].level = 0;
+        nodes[0].len = 0;
+        nodes[0].child = nodes[0].sibling = nodes[0].value = -1;
+    }
+
+    /** Add a topic filter
+     *  @param topicFilter - a topic pattern which can include wildcards
+     *  @param value - the value to return from match for topic names matching this filter, >= 0
+     *  @return false if the node pool is exhausted, leaving the trie unchanged
+     */
+    bool add(const char* topicFilter, int value)
+    {
+        int first = count;
+        int node = 0;
+        const char* level = topicFilter;
+
+        while (true)
+        {
+            const char* end = strchr(level, '/');
+            int len = (end) ? end - level : strlen(level);
+            int i;
+
+            for (i = nodes[node].child; i != -1; i = nodes[i].sibling)
+            {
+                if (nodes[i].len == len && strncmp(nodes[i].level, level, len) == 0)
+                    break;
+            }
+            if (i == -1)
+            {
+                if (count == MAX_NODES)
+                {
+                    undo(first);
+                    return false;
+                }
+                i = count++;
+                nodes[i].level = level;
+                nodes[i].len = len;
+                nodes[i].child = nodes[i].value = -1;
+                nodes[i].sibling = nodes[node].child;
+                nodes[node].child = i;
+            }
+            node = i;
+            if (end == 0)
+                break;
+            level = end + 1;
+        }
+        nodes[node].value = value;
+        return true;
+    }
+
+    /** Find the filters which match a topic name, as in the MQTT 3.1.1 specification: + matches one
+     *  level, # any number of trailing levels including none, and neither matches a first level
+     *  beginning with $
+     *  @param topicName - the topic name
+     *  @param values - filled with the values of the matching filters
+     *  @param max - the size of values
+     *  @return the number of values found
+     */
+    int match(MQTTString& topicName, int* values, int max)
+    {
+        const char* name = (topicName.cstring) ? topicName.cstring : topicName.lenstring.data;
+        int len = (topicName.cstring) ? strlen(topicName.cstring) : topicName.lenstring.len;
+        int found = 0;
+
+        if (name)
+            match(0, name, name + len, values, max, found);
+        return found;
+    }
+
+private:
+
+    struct Node
+    {
+        const char* level;  // in the filter, not null-terminated
+        short len;
+        short child;        // first child, -1 if none
+        short sibling;      // next child of the same parent, -1 if none
+        short value;        // of the filter ending here, -1 if none
+    } nodes[MAX_NODES];
+    int count;
+
+    void addValue(int value, int* values, int max, int& found)
+    {
+        if (value != -1 && found < max)
+            values[found++] = value;
+    }
+
+    // match the topic name levels from level to end against the children of node
+    void match(int node, const char* level, const char* end, int* values, int max, int& found)
+    {
+        const char* next = (const char*)memchr(level, '/', end - level);
+        int len = (next) ? next - level : end - level;
+        bool wild = !(node == 0 && len > 0 && *level == '$');
+
+        for (int i = nodes[node].child; i != -1; i = nodes[i].sibling)
+        {
+            if (nodes[i].len == 1 && nodes[i].level[0] == '#')
+            {
+                if (wild)
+                    addValue(nodes[i].value, values, max, found);
+            }
+            else if ((nodes[i].len == 1 && nodes[i].level[0] == '+') ? wild :
+                     (nodes[i].len == len && strncmp(nodes[i].level, level, len) == 0))
+            {
+                if (next)
+                    match(i, next + 1, end, values, max, found);
+                else
+                {
+                    addValue(nodes[i].value, values, max, found);
+                    for (int j = nodes[i].child; j != -1; j = nodes[j].sibling)
+                    {
+                        if (nodes[j].len == 1 && nodes[j].level[0] == '#')
+                            addValue(nodes[j].value, values, max, found); // the parent level matches # too
+                    }
+                }
+            }
+        }
+    }
+
+    // remove the nodes allocated from first on by a failed add
+    void undo(int first)
+    {
+        for (int i = 0; i < first; ++i)
+        {
+            while (nodes[i].child >= first)
+                nodes[i].child = nodes[nodes[i].child].sibling;
+        }
+        count = first;
+    }
+};
+
+}
+
+#endif
@@ -2,37 +2,15 @@
 #define _MQTTNETWORK_H_
 
 #include "NetworkInterface.h"
+#include "MQTTSocket.h"
 
-class MQTTNetwork {
+// The MQTT::Client network for a NetworkInterface, such as the ISM43362.  Reads and writes keep to
+// their timeouts, waiting on the socket's events rather than blocking in the stack.  recvTimeoutOpt is
+// the stack's socket option for how long a receive waits for data, as MQTTSocket's.
+class MQTTNetwork : public MQTTSocket {
 public:
-    MQTTNetwork(NetworkInterface* aNetwork) : network(aNetwork) {
-        socket = new TCPSocket();
+    MQTTNetwork(NetworkInterface* aNetwork, int recvTimeoutOpt = 0) : MQTTSocket(aNetwork, recvTimeoutOpt) {
     }
-
-    ~MQTTNetwork() {
-        delete socket;
-    }
-
-    int read(unsigned char* buffer, int len, int timeout) {
-        return socket->recv(buffer, len);
-    }
-
-    int write(unsigned char* buffer, int len, int timeout) {
-        return socket->send(buffer, len);
-    }
-
-    int connect(const char* hostname, int port) {
-        socket->open(network);
-        return socket->connect(hostname, port);
-    }
-
-    int disconnect() {
-        return socket->close();
-    }
-
-private:
-    NetworkInterface* network;
-    TCPSocket* socket;
 };
 
 #endif // _MQTTNETWORK_H_
@@ -0,0 +1,306 @@
+#if !defined(BENCH_H)
+#define BENCH_H
+
+// Host stand-ins for the benchmarks: the rtos parts MQTT::Async uses, and a network with a broker at the
+// other end of it
+
+#include "host.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include "MQTTPacket.h"
+
+inline double seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the time of a call of f in nanoseconds, the best of several runs so that a preemption does not count
+template<class F>
+double nsPerCall(F f, long calls = 1000000)
+{
+    double best = 1e9;
+
+    for (int run = 0; run < 5; ++run)
+    {
+        double start = seconds();
+
+        for (long i = 0; i < calls; ++i)
+            f();
+        best = std::min(best, (seconds() - start) * 1e9 / calls);
+    }
+    return best;
+}
+
+// the Thread and Mutex of MQTT::Async, as rtos's
+enum { osOK = 0 };
+
+template<class T>
+std::function<void()> callback(T* obj, void (T::*method)())
+{
+    return [obj, method]() { (obj->*method)(); };
+}
+
+class Thread
+{
+public:
+    Thread() : signals(new Signals())
+    {
+    }
+
+    int start(std::function<void()> task)
+    {
+        std::shared_ptr<Signals> mine = signals;
+
+        thread = std::thread([mine, task]() {
+            current() = mine.get();
+            task();
+        });
+        return osOK;
+    }
+
+    void join()
+    {
+        thread.join();
+    }
+
+    int32_t signal_set(int32_t set)
+    {
+        std::lock_guard<std::mutex> lock(signals->mutex);
+
+        signals->flags |= set;
+        signals->changed.notify_all();
+        return signals->flags;
+    }
+
+    // wait for any of the signals, clearing them, or for ms
+    static int32_t signal_wait(int32_t wanted, uint32_t ms)
+    {
+        Signals* signals = current();
+        std::unique_lock<std::mutex> lock(signals->mutex);
+
+        signals->changed.wait_for(lock, std::chrono::milliseconds(ms), [&]() { return (signals->flags & wanted) != 0; });
+        int32_t got = signals->flags & wanted;
+        signals->flags &= ~wanted;
+        ++waits();
+        return got;
+    }
+
+    // the number of signal_waits which have returned, in all threads
+    static std::atomic<long>& waits()
+    {
+        static std::atomic<long> count(0);
+        return count;
+    }
+
+private:
+    struct Signals
+    {
+        std::mutex mutex;
+        std::condition_variable changed;
+        int32_t flags = 0;
+    };
+
+    std::thread thread;
+    std::shared_ptr<Signals> signals;
+
+    static Signals*& current()
+    {
+        static thread_local Signals* signals = 0;
+        return signals;
+    }
+};
+
+class Mutex
+{
+public:
+    void lock()
+    {
+        mutex.lock();
+    }
+
+    void unlock()
+    {
+        mutex.unlock();
+    }
+
+private:
+    std::mutex mutex;
+};
+
+// the Network of MQTT::Client, with a broker which answers a CONNECT with a CONNACK, a QoS 1 PUBLISH with
+// a PUBACK and a PINGREQ with a PINGRESP, each readable a round trip after what it answers was written.
+// If it signals, its sigio is called as each becomes readable; otherwise, as the ISM43362, never.  Only
+// the sigio is thread-safe: MQTT::Async only uses the rest with its mutex held.
+class BrokerNet
+{
+public:
+    BrokerNet(int round_trip_us = 0, bool signals = true) : round_trip(round_trip_us), signals(signals), stopping(false)
+    {
+        if (signals)
+            notifier = std::thread(&BrokerNet::notify, this);
+    }
+
+    ~BrokerNet()
+    {
+        if (signals)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+                changed.notify_all();
+            }
+            notifier.join();
+        }
+    }
+
+    template<class T>
+    void sigio(T* obj, void (T::*method)())
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (obj)
+            readable = [obj, method]() { (obj->*method)(); };
+        else
+            readable = std::function<void()>();
+    }
+
+    int read(unsigned char* buffer, int len, int timeout)
+    {
+        Clock::time_point end = Clock::now() + std::chrono::milliseconds(timeout);
+        int n = 0;
+
+        while (true)
+        {
+            Clock::time_point now = Clock::now();
+
+            while (n < len && !replies.empty() && replies.front().due <= now)
+            {
+                Reply& reply = replies.front();
+                int count = std::min(len - n, (int)(reply.bytes.size() - reply.pos));
+
+                memcpy(buffer + n, reply.bytes.data() + reply.pos, count);
+                n += count;
+                reply.pos += count;
+                if (reply.pos == reply.bytes.size())
+                    replies.pop_front();
+            }
+            if (n > 0 || now >= end)
+                return n;
+            std::this_thread::sleep_until(replies.empty() ? end : std::min(end, replies.front().due));
+        }
+    }
+
+    int write(unsigned char* buffer, int len, int timeout)
+    {
+        size_t packet;
+
+        written.insert(written.end(), buffer, buffer + len);
+        while ((packet = packetLength()) > 0)
+        {
+            received(written.data(), packet);
+            written.erase(written.begin(), written.begin() + packet);
+        }
+        return len;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Reply
+    {
+        Clock::time_point due;
+        std::vector<unsigned char> bytes;
+        size_t pos;
+    };
+
+    std::chrono::microseconds round_trip;
+    std::deque<Reply> replies;
+    std::vector<unsigned char> written;     // not yet a whole packet
+
+    bool signals;
+    std::thread notifier;
+    std::mutex mutex;                       // for the rest, shared with the notifier
+    std::condition_variable changed;
+    std::deque<Clock::time_point> due;      // of the replies, for the sigio
+    std::function<void()> readable;
+    bool stopping;
+
+    void reply(unsigned char* buf, int len)
+    {
+        Reply r = {Clock::now() + round_trip, std::vector<unsigned char>(buf, buf + len), 0};
+
+        replies.push_back(r);
+        if (signals)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            due.push_back(r.due);
+            changed.notify_all();
+        }
+    }
+
+    // call the sigio as each reply becomes readable
+    void notify()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (!stopping)
+        {
+            if (due.empty())
+                changed.wait(lock);
+            else if (Clock::now() < due.front())
+                changed.wait_until(lock, due.front());
+            else
+            {
+                due.pop_front();
+                if (readable)
+                    readable();     // with the mutex held, so not once sigio has been cleared
+            }
+        }
+    }
+
+    // the length of the first packet written, or 0 if it is not all there yet
+    size_t packetLength()
+    {
+        size_t rem_len = 0, multiplier = 1;
+
+        for (size_t n = 1; n < written.size() && n <= 4; ++n)
+        {
+            rem_len += (written[n] & 127) * multiplier;
+            multiplier *= 128;
+            if ((written[n] & 128) == 0)
+                return (1 + n + rem_len <= written.size()) ? 1 + n + rem_len : 0;
+        }
+        return 0;
+    }
+
+    void received(unsigned char* buf, int len)
+    {
+        unsigned char ack[4], pingresp[] = {PINGRESP << 4, 0};
+        unsigned char dup, retained, *payload;
+        unsigned short id;
+        int qos, payloadlen;
+        MQTTString topic;
+
+        switch (buf[0] >> 4)
+        {
+        case CONNECT:
+            reply(ack, MQTTSerialize_connack(ack, sizeof(ack), 0, 0));
+            break;
+        case PUBLISH:
+            if (MQTTDeserialize_publish(&dup, &qos, &retained, &id, &topic, &payload, &payloadlen, buf, len) == 1 &&
+                qos == 1)
+                reply(ack, MQTTSerialize_puback(ack, sizeof(ack), id));
+            break;
+        case PINGREQ:
+            reply(pingresp, sizeof(pingresp));
+            break;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,98 @@
+// QoS 1 messages per second through the blocking MQTT::Client, which waits for each PUBACK, and through
+// MQTT::Async, which keeps up to MAX_INFLIGHT_MESSAGES publishes in flight, over a range of round trips
+// to the broker.  Also how often the receive thread of an idle Async wakes to read the network, which
+// costs an AT exchange with the ISM43362.
+
+#include "bench.h"
+#include <atomic>
+#include "MQTTAsync.h"
+
+typedef MQTT::Async<BrokerNet, Countdown, Thread, Mutex> AsyncClient;
+
+static const double RUN_SECONDS = 1.0;
+static char topic[] = "bench/telemetry";
+static char payload[] = "0123456789";
+
+static double blocking(int round_trip_us)
+{
+    BrokerNet net(round_trip_us);
+    MQTT::Client<BrokerNet, Countdown> client(net);
+    MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+    long count = 0;
+
+    assert(client.connect(data) == MQTT::SUCCESS);
+    double start = seconds(), end = start + RUN_SECONDS;
+    while (seconds() < end)
+    {
+        assert(client.publish(topic, payload, sizeof(payload) - 1, MQTT::QOS1) == MQTT::SUCCESS);
+        ++count;
+    }
+    double rate = count / (seconds() - start);
+    client.disconnect();
+    return rate;
+}
+
+static void completed(AsyncClient::Result& result)
+{
+    assert(result.rc == MQTT::SUCCESS);
+    ++*(std::atomic<long>*)result.context;
+}
+
+static double async(int round_trip_us, int threads, bool signals = true)
+{
+    BrokerNet net(round_trip_us, signals);
+    AsyncClient client(net);
+    MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+    std::atomic<long> sent(0), done(0);
+    std::vector<std::thread> publishers;
+
+    assert(client.connect(data) == MQTT::SUCCESS);
+    double start = seconds(), end = start + RUN_SECONDS;
+    for (int i = 0; i < threads; ++i)
+    {
+        publishers.push_back(std::thread([&]() {
+            while (seconds() < end)
+            {
+                MQTT::Message message = {MQTT::QOS1, false, false, 0, payload, sizeof(payload) - 1};
+
+                assert(client.publish(topic, message, completed, &done) == MQTT::SUCCESS);
+                ++sent;
+            }
+        }));
+    }
+    for (int i = 0; i < threads; ++i)
+        publishers[i].join();
+    while (done < sent)     // the last acks
+        std::this_thread::yield();
+    double rate = done / (seconds() - start);
+    client.disconnect();
+    return rate;
+}
+
+// wakes per second of the receive thread of a connected Async with nothing to do
+static double idleWakes(bool signals)
+{
+    BrokerNet net(0, signals);
+    AsyncClient client(net);
+    MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+
+    assert(client.connect(data) == MQTT::SUCCESS);
+    long waits = Thread::waits();
+    wait_ms(1000 * RUN_SECONDS);
+    waits = Thread::waits() - waits;
+    client.disconnect();
+    return waits / RUN_SECONDS;
+}
+
+int main()
+{
+    int round_trips[] = {0, 100, 1000, 10000};
+
+    printf("QoS 1 publishes of %d bytes, messages per second\n", (int)sizeof(payload) - 1);
+    printf("%14s %12s %12s %12s %14s\n", "round trip us", "blocking", "async x1", "async x4", "no sigio x4");
+    for (size_t i = 0; i < sizeof(round_trips) / sizeof(round_trips[0]); ++i)
+        printf("%14d %12.0f %12.0f %12.0f %14.0f\n", round_trips[i], blocking(round_trips[i]), async(round_trips[i], 1),
+               async(round_trips[i], 4), async(round_trips[i], 4, false));
+    printf("idle receive thread wakes per second: %.0f with a sigio, %.0f without\n", idleWakes(true), idleWakes(false));
+    return 0;
+}
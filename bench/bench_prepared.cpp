@@ -0,0 +1,40 @@
+// MQTTSerialize_preparedPublish, with the topic length found once, against MQTTSerialize_publish, which
+// finds it and the packet length for every publish
+
+#include "bench.h"
+
+int main()
+{
+    const char* topics[] = {"t", "sensors/temperature", "building/3/floor/12/room/1207/sensors/temperature"};
+    int payloadlens[] = {10, 100};
+    unsigned char buf[300], prepared_buf[300], payload[100] = {0};
+
+    printf("publishes serialized, ns per call\n");
+    printf("%-52s %8s %10s %10s\n", "topic", "payload", "publish", "prepared");
+    for (size_t t = 0; t < sizeof(topics) / sizeof(topics[0]); ++t)
+    {
+        for (size_t p = 0; p < sizeof(payloadlens) / sizeof(payloadlens[0]); ++p)
+        {
+            MQTTString topic = MQTTString_initializer;
+            MQTTPreparedTopic prepared;
+            int len = payloadlens[p];
+            unsigned short id = 0;
+
+            topic.cstring = (char*)topics[t];
+            MQTTSerialize_prepareTopic(&prepared, (char*)topics[t]);
+            int n = MQTTSerialize_publish(buf, sizeof(buf), 0, 1, 0, 1, topic, payload, len);
+            assert(n > 0 && MQTTSerialize_preparedPublish(prepared_buf, sizeof(prepared_buf), 0, 1, 0, 1, &prepared,
+                                                          payload, len) == n);
+            assert(memcmp(buf, prepared_buf, n) == 0);     // the same bytes
+
+            double publish = nsPerCall([&]() {
+                MQTTSerialize_publish(buf, sizeof(buf), 0, 1, 0, ++id, topic, payload, len);
+            });
+            double preparedPublish = nsPerCall([&]() {
+                MQTTSerialize_preparedPublish(buf, sizeof(buf), 0, 1, 0, ++id, &prepared, payload, len);
+            });
+            printf("%-52s %8d %10.1f %10.1f\n", topics[t], len, publish, preparedPublish);
+        }
+    }
+    return 0;
+}
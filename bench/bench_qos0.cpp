@@ -0,0 +1,72 @@
+// Client::publishQoS0, which queues a publish in the transmit buffer, against Client::publish at QoS 0,
+// which starts a timer and sends each publish as it is made, to a network which takes all it is given
+
+#include "bench.h"
+#include "MQTTClient.h"
+
+// the Network of MQTT::Client: a CONNACK to read, and then writes counted and dropped
+struct SinkNet
+{
+    unsigned char connack[4] = {CONNACK << 4, 2, 0, 0};
+    size_t pos = 0;
+    long written = 0;
+
+    int read(unsigned char* buffer, int len, int timeout)
+    {
+        int n = std::min(len, (int)(sizeof(connack) - pos));
+
+        memcpy(buffer, connack + pos, n);
+        pos += n;
+        return n;
+    }
+
+    int write(unsigned char* buffer, int len, int timeout)
+    {
+        written += len;
+        return len;
+    }
+};
+
+int main()
+{
+    SinkNet net;
+    MQTT::Client<SinkNet, Countdown> client(net);
+    MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+    const char* names[] = {"t/1", "sensors/temperature", "building/3/floor/12/room/1207/sensors/temperature"};
+    char payload[] = "0123456789";
+    const long calls = 1000000;
+
+    assert(client.connect(data) == MQTT::SUCCESS);
+    printf("QoS 0 publishes of %d bytes, queued in %d bytes, ns per call\n", (int)sizeof(payload) - 1,
+           MQTTCLIENT_TX_BUFFER);
+    printf("%-50s %7s %10s %10s %12s %12s\n", "topic", "packet", "publish", "prepared", "publishQoS0", "prepared");
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+    {
+        char* name = (char*)names[i];
+        MQTTPreparedTopic topic;
+        const long packet = 2 + 2 + strlen(name) + sizeof(payload) - 1;
+
+        MQTTSerialize_prepareTopic(&topic, name);
+        net.written = 0;
+        double publish = nsPerCall([&]() {
+            client.publish(name, payload, sizeof(payload) - 1, MQTT::QOS0);
+        }, calls);
+        double publishPrepared = nsPerCall([&]() {
+            client.publish(topic, payload, sizeof(payload) - 1, MQTT::QOS0);
+        }, calls);
+        double publishQoS0 = nsPerCall([&]() {
+            client.publishQoS0(name, payload, sizeof(payload) - 1);
+        }, calls);
+        double publishQoS0Prepared = nsPerCall([&]() {
+            client.publishQoS0(topic, payload, sizeof(payload) - 1);
+        }, calls);
+        client.yield(1);    // the last of the queue
+        assert(net.written == 4 * 5 * calls * packet && client.isConnected());
+        printf("%-50s %7ld %10.1f %10.1f %12.1f %12.1f\n", name, packet, publish, publishPrepared, publishQoS0,
+               publishQoS0Prepared);
+    }
+    printf("a read of the host clock, which each Countdown makes: %.1f ns\n", nsPerCall([]() {
+        Countdown timer(1);
+    }));
+    return 0;
+}
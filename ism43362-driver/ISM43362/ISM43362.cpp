@@ -27,7 +27,9 @@ ISM43362::ISM43362()
 int ISM43362::get_firmware_version()
 {
     char rev;
+    _smutex.lock();
     WIFI_GetModuleFwRevision(&rev);
+    _smutex.unlock();
     return (int)rev;
 }
 
@@ -40,103 +42,227 @@ bool ISM43362::startup(int mode)
 bool ISM43362::reset(void)
 {
     // TODO: This isn't returning
-    return WIFI_ResetModule() == WIFI_STATUS_OK;
+    _smutex.lock();
+    bool ret = WIFI_ResetModule() == WIFI_STATUS_OK;
+    _smutex.unlock();
+    return ret;
 }
 
 bool ISM43362::dhcp(bool enabled)
 {
-    return WIFI_SetDhcp((uint8_t)enabled) == WIFI_STATUS_OK;;
+    _smutex.lock();
+    bool ret = WIFI_SetDhcp((uint8_t)enabled) == WIFI_STATUS_OK;
+    _smutex.unlock();
+    return ret;
+}
+
+bool ISM43362::setNetwork(const char *ip_address, const char *netmask, const char *gateway)
+{
+    SocketAddress ip(ip_address), mask(netmask), gw(gateway);
+    if (!ip || !mask || !gw) {
+        return false;
+    }
+    _smutex.lock();
+    bool ret = WIFI_SetIPConfig((uint8_t *)ip.get_ip_bytes(), (uint8_t *)mask.get_ip_bytes(),
+                                (uint8_t *)gw.get_ip_bytes()) == WIFI_STATUS_OK;
+    _smutex.unlock();
+    return ret;
+}
+
+bool ISM43362::setDNS(const char *primary, const char *secondary)
+{
+    SocketAddress dns1(primary), dns2(secondary);
+    if (!dns1 || (secondary && !dns2)) {
+        return false;
+    }
+    _smutex.lock();
+    bool ret = WIFI_SetDNS((uint8_t *)dns1.get_ip_bytes(),
+                           secondary ? (uint8_t *)dns2.get_ip_bytes() : NULL) == WIFI_STATUS_OK;
+    _smutex.unlock();
+    return ret;
 }
 
 bool ISM43362::connect(const char *ssid, const char *passPhrase, nsapi_security_t security)
 {
     WIFI_Ecn_t wifi_ecn = nsapi_security2wifi_ecn(security);
+    _smutex.lock();
     WIFI_Status_t status = WIFI_Connect(ssid, passPhrase, wifi_ecn);
+    _smutex.unlock();
     return status == WIFI_STATUS_OK;
 }
 
 bool ISM43362::disconnect(void)
 {
-    return WIFI_Disconnect() == WIFI_STATUS_OK;
+    _smutex.lock();
+    bool ret = WIFI_Disconnect() == WIFI_STATUS_OK;
+    _smutex.unlock();
+    return ret;
 }
 
 const char *ISM43362::getIPAddress(void)
 {
+    const char *ret = NULL;
+    _smutex.lock();
     if (WIFI_GetIP_Address((uint8_t *)_ip_buffer) == WIFI_STATUS_OK) {
         sprintf(_ip_buffer, "%d.%d.%d.%d", _ip_buffer[0], _ip_buffer[1], _ip_buffer[2], _ip_buffer[3]);
-        return _ip_buffer;
-    } else {
-        return NULL;
+        ret = _ip_buffer;
     }
+    _smutex.unlock();
+    return ret;
 }
 
 const char *ISM43362::getMACAddress(void)
 {
+    const char *ret = NULL;
+    _smutex.lock();
     if (WIFI_GetMAC_Address((uint8_t *)_mac_buffer) == WIFI_STATUS_OK) {
         sprintf(_mac_buffer, "%02X:%02X:%02X:%02X:%02X:%02X", _mac_buffer[0], _mac_buffer[1], _mac_buffer[2], _mac_buffer[3], _mac_buffer[4], _mac_buffer[5]);
-        return _mac_buffer;
-    } else {
-        return NULL;
+        ret = _mac_buffer;
     }
+    _smutex.unlock();
+    return ret;
 }
 
 const char *ISM43362::getGateway()
 {
+    const char *ret = NULL;
+    _smutex.lock();
     if (WIFI_GetGateway((uint8_t *)_gateway_buffer) == WIFI_STATUS_OK) {
         sprintf(_gateway_buffer, "%d.%d.%d.%d", _gateway_buffer[0], _gateway_buffer[1], _gateway_buffer[2], _gateway_buffer[3]);
-        return _gateway_buffer;
-    } else {
-        return NULL;
+        ret = _gateway_buffer;
     }
+    _smutex.unlock();
+    return ret;
 }
 
 const char *ISM43362::getNetmask()
 {
+    const char *ret = NULL;
+    _smutex.lock();
     if (WIFI_GetNetmask((uint8_t *)_netmask_buffer) == WIFI_STATUS_OK) {
         sprintf(_netmask_buffer, "%d.%d.%d.%d", _netmask_buffer[0], _netmask_buffer[1], _netmask_buffer[2], _netmask_buffer[3]);
-        return _netmask_buffer;
-    } else {
-        return NULL;
+        ret = _netmask_buffer;
     }
+    _smutex.unlock();
+    return ret;
+}
+
+const char *ISM43362::getDNS(int index)
+{
+    const char *ret = NULL;
+    uint8_t dns[2][4];
+    _smutex.lock();
+    if (WIFI_GetDNS(dns[0], dns[1]) == WIFI_STATUS_OK && (index == 0 || index == 1)
+            && (dns[index][0] | dns[index][1] | dns[index][2] | dns[index][3])) {
+        sprintf(_dns_buffer, "%d.%d.%d.%d", dns[index][0], dns[index][1], dns[index][2], dns[index][3]);
+        ret = _dns_buffer;
+    }
+    _smutex.unlock();
+    return ret;
 }
 
 int8_t ISM43362::getRSSI()
 {
     int8_t rssi;
-    if (WIFI_GetRssi(&rssi) == WIFI_STATUS_OK) {
-        return rssi;
-    } else {
-        return -1;
+    _smutex.lock();
+    if (WIFI_GetRssi(&rssi) != WIFI_STATUS_OK) {
+        rssi = -1;
     }
+    _smutex.unlock();
+    return rssi;
 }
 
 bool ISM43362::isConnected(void)
 {
-    return getIPAddress() != 0;
+    uint8_t connected = 0;
+    _smutex.lock();
+    if (WIFI_GetConnectionStatus(&connected) != WIFI_STATUS_OK) {
+        connected = 0;
+    }
+    _smutex.unlock();
+    return connected;
+}
+
+int ISM43362::scan(WiFiAccessPoint *res, unsigned limit, Callback<void(const nsapi_wifi_ap_t *)> cb)
+{
+    scan_context ctx;
+    ctx.res = res;
+    ctx.limit = limit;
+    ctx.cb = cb;
+    int ret = scan(&ctx);
+    if (ret < 0 || limit == 0) {
+        return ret;
+    }
+    return ctx.count;
+}
+
+int ISM43362::scan(Callback<void(const nsapi_wifi_ap_t *)> cb)
+{
+    scan_context ctx;
+    ctx.res = NULL;
+    ctx.limit = 0;
+    ctx.cb = cb;
+    return scan(&ctx);
 }
 
-int ISM43362::scan(WiFiAccessPoint *res, unsigned limit)
+int ISM43362::scan(scan_context *ctx)
 {
-    WIFI_APs_t *aps = (WIFI_APs_t*)malloc(sizeof(WIFI_APs_t));
-    // WIFI_APs_t apss;
-    // WIFI_APs_t *aps = &apss;
-    uint8_t count = 0;
-    WIFI_Status_t status;
-    status = WIFI_ListAccessPoints(aps, limit);
-    for (count = 0; count < aps->count; count++) {
-        nsapi_wifi_ap_t ap;
-        wifi_ap2ns_api_wifi_ap(&aps->ap[count], &ap);
-        res[count] = WiFiAccessPoint(ap);
+    ctx->ism = this;
+    ctx->count = 0;
+    ctx->total = 0;
+    _smutex.lock();
+    WIFI_Status_t status = WIFI_ScanAccessPoints(&ISM43362::scan_ap, ctx);
+    _smutex.unlock();
+    if (status != WIFI_STATUS_OK) {
+        return NSAPI_ERROR_DEVICE_ERROR;
     }
-    free(aps);
-    return count;
+    return ctx->total;
+}
+
+void ISM43362::scan_ap(void *arg, ES_WIFI_AP_t *es_wifi_ap)
+{
+    scan_context *ctx = (scan_context *)arg;
+    nsapi_wifi_ap_t ap;
+
+    memset(&ap, 0, sizeof(ap));
+    strncpy(ap.ssid, (char *)es_wifi_ap->SSID, sizeof(ap.ssid) - 1);
+    memcpy(ap.bssid, es_wifi_ap->MAC, 6);
+    ap.rssi = (int8_t) es_wifi_ap->RSSI;
+    ap.channel = es_wifi_ap->Channel;
+    ap.security = ctx->ism->wifi_ecn2nsapi_security((WIFI_Ecn_t) es_wifi_ap->Security);
+    ctx->total++;
+
+    if (ctx->cb) {
+        ctx->cb(&ap);
+    }
+    if (ctx->limit == 0) {
+        return;
+    }
+
+    // Keep the strongest APs, sorted by decreasing RSSI
+    unsigned i = ctx->count;
+    if (i == ctx->limit) {
+        if (ctx->res[i - 1].get_rssi() >= ap.rssi) {
+            return;
+        }
+        i--;
+    } else {
+        ctx->count++;
+    }
+    while (i > 0 && ctx->res[i - 1].get_rssi() < ap.rssi) {
+        ctx->res[i] = ctx->res[i - 1];
+        i--;
+    }
+    ctx->res[i] = WiFiAccessPoint(ap);
 }
 
 bool ISM43362::open(nsapi_protocol_t type, int id, const char* addr, int port)
 {
     WIFI_Protocol_t proto = nsapi_protocol2WIFI_Protocol(type);
     SocketAddress s_addr(addr, (uint16_t)port);
+    _smutex.lock();
     uint8_t status = WIFI_OpenClientConnection(id, proto, "", (uint8_t*)s_addr.get_ip_bytes(), (uint16_t)port, 0);
+    _smutex.unlock();
     //  == WIFI_STATUS_OK;
     return status == WIFI_STATUS_OK;
 }
@@ -145,35 +271,60 @@ int ISM43362::dns_lookup(const char* name, char* ip)
 {
     int ret = NSAPI_ERROR_DNS_FAILURE;
     uint8_t ipAddr[4];
+    _smutex.lock();
     if (WIFI_DNS_LookUp(name, ipAddr) == WIFI_STATUS_OK) {
         ret = NSAPI_ERROR_OK;
         sprintf(ip, "%d.%d.%d.%d", ipAddr[0], ipAddr[1], ipAddr[2], ipAddr[3]);
     }
+    _smutex.unlock();
     return ret;
 }
 
 bool ISM43362::send(int id, const void *data, uint32_t amount)
+{
+    return send(id, data, amount, timeout);
+}
+
+bool ISM43362::send(int id, const void *data, uint32_t amount, uint32_t timeout_ms)
 {
     bool status = true;
-    uint16_t totalSent = 0;
+    uint32_t totalSent = 0;
     uint16_t sent = 0;
+    _smutex.lock();
     while (totalSent < amount && status) {
-        status = WIFI_SendData((uint8_t)id, (uint8_t *)(data + totalSent), amount, &sent, timeout) == WIFI_STATUS_OK;
+        // WIFI_SendData takes a 16-bit length, and the module sends at most a payload at a time
+        uint16_t chunk = (amount - totalSent > ES_WIFI_PAYLOAD_SIZE) ? ES_WIFI_PAYLOAD_SIZE : (uint16_t)(amount - totalSent);
+        status = WIFI_SendData((uint8_t)id, (uint8_t *)data + totalSent, chunk, &sent, timeout_ms) == WIFI_STATUS_OK
+                 && sent > 0;
         totalSent += sent;
     }
+    _smutex.unlock();
     return status;
 }
 
 int32_t ISM43362::recv(int id, void *data, uint32_t amount)
 {
-    uint16_t readLength;
-    WIFI_ReceiveData((uint8_t)id, (uint8_t *)data, (uint16_t) amount, &readLength, timeout);
+    return recv(id, data, amount, timeout);
+}
+
+int32_t ISM43362::recv(int id, void *data, uint32_t amount, uint32_t timeout_ms)
+{
+    uint16_t readLength = 0;
+    if (amount > ES_WIFI_PAYLOAD_SIZE) {
+        amount = ES_WIFI_PAYLOAD_SIZE; // the module returns at most this much per read
+    }
+    _smutex.lock();
+    WIFI_ReceiveData((uint8_t)id, (uint8_t *)data, (uint16_t) amount, &readLength, timeout_ms);
+    _smutex.unlock();
     return readLength;
 }
 
 bool ISM43362::close(int id)
 {
-    return WIFI_CloseClientConnection(id);
+    _smutex.lock();
+    bool ret = WIFI_CloseClientConnection(id) == WIFI_STATUS_OK;
+    _smutex.unlock();
+    return ret;
 }
 
 void ISM43362::setTimeout(uint32_t timeout_ms)
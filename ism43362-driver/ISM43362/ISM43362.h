@@ -64,6 +64,25 @@ public:
     */
     bool dhcp(bool enabled);
 
+    /**
+    * Set the static IP configuration used when DHCP is disabled
+    *
+    * @param ip_address null-terminated representation of the IP address
+    * @param netmask null-terminated representation of the network mask
+    * @param gateway null-terminated representation of the gateway
+    * @return true only if ISM43362 accepted the configuration
+    */
+    bool setNetwork(const char *ip_address, const char *netmask, const char *gateway);
+
+    /**
+    * Set the DNS servers used by the ISM43362
+    *
+    * @param primary null-terminated representation of the primary DNS server
+    * @param secondary null-terminated representation of the secondary DNS server, or null
+    * @return true only if ISM43362 accepted the configuration
+    */
+    bool setDNS(const char *primary, const char *secondary);
+
     /**
     * Connect ISM43362 to AP
     *
@@ -109,6 +128,14 @@ public:
      */
     const char *getNetmask();
 
+    /** Get a DNS server in use
+     *
+     *  @param index    0 for the primary server, 1 for the secondary
+     *  @return         Null-terminated representation of the server
+     *                  or null if there is none
+     */
+    const char *getDNS(int index);
+
     /* Return RSSI for active connection
      *
      * @return      Measured RSSI
@@ -118,18 +145,33 @@ public:
     /**
     * Check if ISM43362 is conenected
     *
-    * @return true only if the chip has an IP address
+    * Asks the module, so a dropped link is noticed
+    *
+    * @return true only if the module reports it is connected to the AP
     */
     bool isConnected(void);
 
     /** Scan for available networks
+     *
+     * When more networks are found than fit in @a res, the strongest
+     * ones are kept, sorted by decreasing RSSI.
      *
      * @param  ap    Pointer to allocated array to store discovered AP
      * @param  limit Size of allocated @a res array, or 0 to only count available AP
+     * @param  cb    Optional function also called once per discovered AP
      * @return       Number of entries in @a res, or if @a count was 0 number of available networks, negative on error
      *               see @a nsapi_error
      */
-    int scan(WiFiAccessPoint *res, unsigned limit);
+    int scan(WiFiAccessPoint *res, unsigned limit,
+             Callback<void(const nsapi_wifi_ap_t *)> cb = Callback<void(const nsapi_wifi_ap_t *)>());
+
+    /** Scan for available networks, reporting each one as it is parsed
+     *
+     * @param  cb    Function called once per discovered AP
+     * @return       Number of available networks, negative on error
+     *               see @a nsapi_error
+     */
+    int scan(Callback<void(const nsapi_wifi_ap_t *)> cb);
 
     /**Perform a dns query
     *
@@ -161,6 +203,18 @@ public:
     */
     bool send(int id, const void *data, uint32_t amount);
 
+    /**
+    * Sends data to an open socket, waiting no longer than the given time
+    * rather than the one set by setTimeout, which other threads may change
+    *
+    * @param id id of socket to send to
+    * @param data data to be sent
+    * @param amount amount of data to be sent
+    * @param timeout_ms timeout of each write to the module
+    * @return true only if data sent successfully
+    */
+    bool send(int id, const void *data, uint32_t amount, uint32_t timeout_ms);
+
     /**
     * Receives data from an open socket
     *
@@ -171,6 +225,18 @@ public:
     */
     int32_t recv(int id, void *data, uint32_t amount);
 
+    /**
+    * Receives data from an open socket, waiting no longer than the given
+    * time rather than the one set by setTimeout
+    *
+    * @param id id to receive from
+    * @param data placeholder for returned information
+    * @param amount number of bytes to be received
+    * @param timeout_ms time the module waits for data
+    * @return the number of bytes received
+    */
+    int32_t recv(int id, void *data, uint32_t amount, uint32_t timeout_ms);
+
     /**
     * Closes a socket
     *
@@ -211,6 +277,16 @@ private:
         uint32_t len;
         // data follows
     } *_packets, **_packets_end;
+    struct scan_context {
+        ISM43362 *ism;
+        WiFiAccessPoint *res;
+        unsigned limit;
+        unsigned count;
+        unsigned total;
+        Callback<void(const nsapi_wifi_ap_t *)> cb;
+    };
+    int scan(scan_context *ctx);
+    static void scan_ap(void *arg, ES_WIFI_AP_t *es_wifi_ap);
     void wifi_ap2ns_api_wifi_ap(WIFI_AP_t *wifi_ap, nsapi_wifi_ap_t *ns_api_wifi_ap);
     nsapi_security_t wifi_ecn2nsapi_security(WIFI_Ecn_t wifi_ecn);
     WIFI_Ecn_t nsapi_security2wifi_ecn(nsapi_security_t nsapi_security);
@@ -218,9 +294,11 @@ private:
 
     char _ip_buffer[16];
     char _gateway_buffer[16];
+    char _dns_buffer[16];
     char _netmask_buffer[16];
     char _mac_buffer[18];
     uint32_t timeout;
+    Mutex _smutex; // Protect access to the module, which may be used from several threads
 };
 
 #endif
@@ -254,55 +254,79 @@ static void AT_ParseInfo(ES_WIFIObject_t *Obj,uint8_t *pdata)
 }
 
 /**
-  * @brief  Parses Access point configuration.
-  * @param  APs: Access points structure
-  * @param  ptr: pointer to string
-  * @retval None.
+  * @brief  Parses a single Access point line of the F0 response.
+  * @param  pdata: pointer to a null terminated "#idx,..." line
+  * @param  AP: Access point structure
+  * @retval 1 if all the fields were found, 0 otherwise.
   */
-static void AT_ParseAP(char *pdata, ES_WIFI_APs_t *APs)
+static uint8_t AT_ParseAP(char *pdata, ES_WIFI_AP_t *AP)
 {
-  uint8_t num = 0;
-  char *ptr;
-  APs->nbr = 0;
+  uint8_t num = 2;
+  char *ptr, *ssid;
 
-  ptr = strtok(pdata + 2, ",");
+  /* The SSID is quoted and may itself contain commas */
+  ptr = strchr(pdata, ',');
+  if ((ptr == NULL) || (ptr[1] != '"'))
+  {
+    return 0;
+  }
+  ssid = ptr + 2;
+  ptr = strstr(ssid, "\",");
+  if (ptr == NULL)
+  {
+    return 0;
+  }
+  *ptr = 0;
+  strncpy((char *)AP->SSID, ssid, ES_WIFI_MAX_SSID_NAME_SIZE);
+  AP->SSID[ES_WIFI_MAX_SSID_NAME_SIZE] = 0;
+
+  ptr = strtok(ptr + 2, ",");
 
-  while ((ptr != NULL) && (APs->nbr < ES_WIFI_MAX_DETECTED_AP)) {
+  while (ptr != NULL) {
     switch (num++) {
-    case 0: /* Ignore index */
     case 4: /* Ignore Max Rate */
     case 5: /* Ignore Network Type */
     case 7: /* Ignore Radio Band */
       break;
 
-    case 1:
-      ptr[strlen(ptr) - 1] = 0;
-      strncpy((char *)APs->AP[APs->nbr].SSID,  ptr+ 1, ES_WIFI_MAX_SSID_NAME_SIZE + 1);
-      break;
-
     case 2:
-      ParseMAC(ptr, APs->AP[APs->nbr].MAC);
+      ParseMAC(ptr, AP->MAC);
       break;
 
     case 3:
-      APs->AP[APs->nbr].RSSI = ParseNumber(ptr, NULL);
+      AP->RSSI = ParseNumber(ptr, NULL);
       break;
 
     case 6:
-      APs->AP[APs->nbr].Security = ParseSecurity(ptr);
+      AP->Security = ParseSecurity(ptr);
       break;
 
     case 8:
-      APs->AP[APs->nbr].Channel = ParseNumber(ptr, NULL);
-      APs->nbr++;
-      num = 1;
-      break;
+      AP->Channel = ParseNumber(ptr, NULL);
+      return 1;
 
     default:
       break;
     }
     ptr = strtok(NULL, ",");
   }
+  return 0;
+}
+
+/**
+  * @brief  Collects streamed Access points into an ES_WIFI_APs_t array.
+  * @param  arg: pointer to the Access points structure
+  * @param  AP: Access point just parsed
+  * @retval None.
+  */
+static void AT_CollectAP(void *arg, ES_WIFI_AP_t *AP)
+{
+  ES_WIFI_APs_t *APs = (ES_WIFI_APs_t *)arg;
+
+  if (APs->nbr < ES_WIFI_MAX_DETECTED_AP)
+  {
+    memcpy(&APs->AP[APs->nbr++], AP, sizeof(ES_WIFI_AP_t));
+  }
 }
 
 #if (ES_WIFI_USE_UART == 1)
@@ -662,6 +686,7 @@ ES_WIFI_Status_t  ES_WIFI_Init(ES_WIFIObject_t *Obj)
   ES_WIFI_Status_t ret = ES_WIFI_STATUS_ERROR;
 
   Obj->Timeout = ES_WIFI_TIMEOUT;
+  Obj->NetSettingsValid = 0;
 
   if (Obj->fops.IO_Init() == 0)
   {
@@ -792,14 +817,80 @@ ES_WIFI_Status_t  ES_WIFI_SetTimeout(ES_WIFIObject_t *Obj, uint32_t Timeout)
   */
 ES_WIFI_Status_t  ES_WIFI_ListAccessPoints(ES_WIFIObject_t *Obj, ES_WIFI_APs_t *APs)
 {
+  APs->nbr = 0;
+  return ES_WIFI_ScanAccessPoints(Obj, AT_CollectAP, APs);
+}
 
-  ES_WIFI_Status_t ret;
+/**
+  * @brief  Scan for APs and report each one as soon as its line is received.
+  *         The F0 response is read in ES_WIFI_SCAN_CHUNK_SIZE chunks, so the
+  *         number of reported APs is not limited by ES_WIFI_DATA_SIZE.
+  * @param  Obj: pointer to module handle
+  * @param  Callback: function called for every detected AP
+  * @param  arg: argument passed back to Callback
+  * @retval Operation Status.
+  */
+ES_WIFI_Status_t  ES_WIFI_ScanAccessPoints(ES_WIFIObject_t *Obj, ES_WIFI_APCallback_t Callback, void *arg)
+{
+  ES_WIFI_Status_t ret = ES_WIFI_STATUS_IO_ERROR;
+  ES_WIFI_AP_t AP;
+  char *line, *eol;
+  uint16_t len = 0;
+  int16_t n;
 
-  ret = AT_ExecuteCommand(Obj,(uint8_t*)"F0\r", Obj->CmdData);
-  if(ret == ES_WIFI_STATUS_OK)
+  if(Obj->fops.IO_Send((uint8_t*)"F0\r", 3, Obj->Timeout) <= 0)
   {
-     AT_ParseAP((char *)Obj->CmdData, APs);
+    return ES_WIFI_STATUS_IO_ERROR;
   }
+
+  do
+  {
+    n = Obj->fops.IO_Receive(Obj->CmdData + len, ES_WIFI_SCAN_CHUNK_SIZE, Obj->Timeout);
+    if(n <= 0)
+    {
+      return ES_WIFI_STATUS_IO_ERROR;
+    }
+    len += n;
+    Obj->CmdData[len] = 0;
+
+    /* Hand every complete line to the caller, keep the partial one */
+    line = (char *)Obj->CmdData;
+    while((eol = strstr(line, "\r\n")) != NULL)
+    {
+      *eol = 0;
+      if(*line == '#')
+      {
+        memset(&AP, 0, sizeof(AP));
+        if(AT_ParseAP(line, &AP))
+        {
+          Callback(arg, &AP);
+        }
+      }
+      else if(strcmp(line, "OK") == 0)
+      {
+        ret = ES_WIFI_STATUS_OK;
+      }
+      else if(strncmp(line, "ERROR", 5) == 0)
+      {
+        ret = ES_WIFI_STATUS_ERROR;
+      }
+      line = eol + 2;
+    }
+
+    /* Status line followed by the prompt: the response is complete */
+    if((ret != ES_WIFI_STATUS_IO_ERROR) && (strncmp(line, "> ", 2) == 0))
+    {
+      break;
+    }
+
+    len -= (uint8_t *)line - Obj->CmdData;
+    memmove(Obj->CmdData, line, len);
+    if(len + ES_WIFI_SCAN_CHUNK_SIZE >= ES_WIFI_DATA_SIZE)
+    {
+      len = 0; /* Drop a line that can not be an AP description */
+    }
+  } while(n >= ES_WIFI_SCAN_CHUNK_SIZE);
+
   return ret;
 }
 
@@ -815,30 +906,49 @@ ES_WIFI_Status_t ES_WIFI_Connect(ES_WIFIObject_t *Obj, const char* SSID,
                                          const char* Password,
                                          ES_WIFI_SecurityType_t SecType)
 {
-  ES_WIFI_Status_t ret;
+  ES_WIFI_Status_t ret = ES_WIFI_STATUS_OK;
 
-  sprintf((char*)Obj->CmdData,"C1=%s\r", SSID);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
-  if(ret == ES_WIFI_STATUS_OK)
+  /* Settings already held by the module are not sent again */
+  if(!Obj->NetSettingsValid || strcmp((char *)Obj->NetSettings.SSID, SSID))
+  {
+    sprintf((char*)Obj->CmdData,"C1=%s\r", SSID);
+    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    if(ret == ES_WIFI_STATUS_OK)
+    {
+      strncpy((char *)Obj->NetSettings.SSID, SSID, ES_WIFI_MAX_SSID_NAME_SIZE);
+    }
+  }
+
+  if((ret == ES_WIFI_STATUS_OK) &&
+     (!Obj->NetSettingsValid || strcmp((char *)Obj->NetSettings.pswd, Password)))
   {
     sprintf((char*)Obj->CmdData,"C2=%s\r", Password);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    if(ret == ES_WIFI_STATUS_OK)
+    {
+      strncpy((char *)Obj->NetSettings.pswd, Password, ES_WIFI_MAX_PSWD_NAME_SIZE);
+    }
+  }
 
+  if((ret == ES_WIFI_STATUS_OK) &&
+     (!Obj->NetSettingsValid || Obj->NetSettings.Security != SecType))
+  {
+    sprintf((char*)Obj->CmdData,"C3=%d\r", (uint8_t)SecType);
+    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
     if(ret == ES_WIFI_STATUS_OK)
     {
-      Obj->Security = SecType;
-      sprintf((char*)Obj->CmdData,"C3=%d\r", (uint8_t)SecType);
-      ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+      Obj->NetSettings.Security = SecType;
+    }
+  }
 
-      if(ret == ES_WIFI_STATUS_OK)
-      {
-        sprintf((char*)Obj->CmdData,"C0\r");
-        ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
-        if(ret == ES_WIFI_STATUS_OK)
-        {
-           Obj->NetSettings.IsConnected = 1;
-        }
-      }
+  if(ret == ES_WIFI_STATUS_OK)
+  {
+    Obj->Security = SecType;
+    sprintf((char*)Obj->CmdData,"C0\r");
+    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    if(ret == ES_WIFI_STATUS_OK)
+    {
+       Obj->NetSettings.IsConnected = 1;
     }
   }
   return ret;
@@ -852,6 +962,26 @@ uint8_t ES_WIFI_IsConnected(ES_WIFIObject_t *Obj)
 {
   return Obj->NetSettings.IsConnected;
 }
+
+/**
+  * @brief  Ask the module whether it is still connected to the access point,
+  *         and update NetSettings.IsConnected accordingly.
+  * @param  Obj: pointer to module handle
+  * @retval Operation Status.
+  */
+ES_WIFI_Status_t ES_WIFI_GetConnectionStatus(ES_WIFIObject_t *Obj)
+{
+  ES_WIFI_Status_t ret;
+
+  sprintf((char*)Obj->CmdData,"CS\r");
+  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  if(ret == ES_WIFI_STATUS_OK)
+  {
+    Obj->NetSettings.IsConnected = (ParseNumber((char *)Obj->CmdData + 2, NULL) == 1);
+  }
+  return ret;
+}
+
 /**
   * @brief  Disconnect from a network.
   * @param  Obj: pointer to module handle
@@ -859,8 +989,15 @@ uint8_t ES_WIFI_IsConnected(ES_WIFIObject_t *Obj)
   */
 ES_WIFI_Status_t ES_WIFI_Disconnect(ES_WIFIObject_t *Obj)
 {
+  ES_WIFI_Status_t ret;
+
   sprintf((char*)Obj->CmdData,"CD\r");
-  return  AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  if(ret == ES_WIFI_STATUS_OK)
+  {
+    Obj->NetSettings.IsConnected = 0;
+  }
+  return ret;
 }
 /**
   * @brief  Return network settings.
@@ -876,6 +1013,7 @@ ES_WIFI_Status_t ES_WIFI_GetNetworkSettings(ES_WIFIObject_t *Obj)
   if(ret == ES_WIFI_STATUS_OK)
   {
     AT_ParseConnSettings((char *)Obj->CmdData, &Obj->NetSettings);
+    Obj->NetSettingsValid = 1;
   }
   return ret;
 }
@@ -1060,6 +1198,7 @@ ES_WIFI_Status_t ES_WIFI_ResetToFactoryDefault(ES_WIFIObject_t *Obj)
 
   sprintf((char*)Obj->CmdData,"Z0\r");
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  Obj->NetSettingsValid = 0;
   return ret;
 }
 
@@ -1074,6 +1213,7 @@ ES_WIFI_Status_t ES_WIFI_ResetModule(ES_WIFIObject_t *Obj)
 
   sprintf((char*)Obj->CmdData,"ZR\r");
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  Obj->NetSettingsValid = 0;
   return ret;
 }
 
@@ -1674,8 +1814,68 @@ ES_WIFI_Status_t ES_WIFI_ReceiveData(ES_WIFIObject_t *Obj, uint8_t Socket, uint8
   */
 ES_WIFI_Status_t ES_WIFI_SetDhcp(ES_WIFIObject_t *Obj, uint8_t dhcp_enabled)
 {
-  sprintf((char*)Obj->CmdData,"C4=%d\r", dhcp_enabled);
-  return AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  ES_WIFI_Status_t ret = ES_WIFI_STATUS_OK;
+
+  if(!Obj->NetSettingsValid || Obj->NetSettings.DHCP_IsEnabled != dhcp_enabled)
+  {
+    sprintf((char*)Obj->CmdData,"C4=%d\r", dhcp_enabled);
+    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    if(ret == ES_WIFI_STATUS_OK)
+    {
+      Obj->NetSettings.DHCP_IsEnabled = dhcp_enabled;
+    }
+  }
+  return ret;
+}
+
+/**
+  * @brief  Set the static IP configuration, used when DHCP is disabled.
+  *         Only the addresses that differ from the module settings are sent,
+  *         so call it before disabling DHCP.
+  * @param  Obj: pointer to module handle
+  * @param  IP_Addr: IP address
+  * @param  IP_Mask: network mask
+  * @param  Gateway_Addr: gateway address
+  * @retval Operation Status.
+  */
+ES_WIFI_Status_t ES_WIFI_SetIPConfig(ES_WIFIObject_t *Obj, uint8_t *IP_Addr, uint8_t *IP_Mask, uint8_t *Gateway_Addr)
+{
+  ES_WIFI_Status_t ret = ES_WIFI_STATUS_OK;
+  /* With DHCP enabled NetSettings hold the leased addresses, not the static ones */
+  uint8_t known = Obj->NetSettingsValid && !Obj->NetSettings.DHCP_IsEnabled;
+
+  if(!known || memcmp(Obj->NetSettings.IP_Addr, IP_Addr, 4))
+  {
+    sprintf((char*)Obj->CmdData,"C6=%d.%d.%d.%d\r", IP_Addr[0], IP_Addr[1], IP_Addr[2], IP_Addr[3]);
+    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    if(ret == ES_WIFI_STATUS_OK)
+    {
+      memcpy(Obj->NetSettings.IP_Addr, IP_Addr, 4);
+    }
+  }
+
+  if((ret == ES_WIFI_STATUS_OK) &&
+     (!known || memcmp(Obj->NetSettings.IP_Mask, IP_Mask, 4)))
+  {
+    sprintf((char*)Obj->CmdData,"C7=%d.%d.%d.%d\r", IP_Mask[0], IP_Mask[1], IP_Mask[2], IP_Mask[3]);
+    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    if(ret == ES_WIFI_STATUS_OK)
+    {
+      memcpy(Obj->NetSettings.IP_Mask, IP_Mask, 4);
+    }
+  }
+
+  if((ret == ES_WIFI_STATUS_OK) &&
+     (!known || memcmp(Obj->NetSettings.Gateway_Addr, Gateway_Addr, 4)))
+  {
+    sprintf((char*)Obj->CmdData,"C8=%d.%d.%d.%d\r", Gateway_Addr[0], Gateway_Addr[1], Gateway_Addr[2], Gateway_Addr[3]);
+    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    if(ret == ES_WIFI_STATUS_OK)
+    {
+      memcpy(Obj->NetSettings.Gateway_Addr, Gateway_Addr, 4);
+    }
+  }
+  return ret;
 }
 
 ES_WIFI_Status_t ES_WIFI_GetRssi(ES_WIFIObject_t *Obj, int8_t *rssi)
@@ -1691,4 +1891,41 @@ ES_WIFI_Status_t ES_WIFI_GetRssi(ES_WIFIObject_t *Obj, int8_t *rssi)
   return ret;
 }
 
+/**
+  * @brief  Set the DNS servers. Only the addresses that differ from the
+  *         module settings are sent.
+  * @param  Obj: pointer to module handle
+  * @param  DNS1: primary DNS server address
+  * @param  DNS2: secondary DNS server address, or NULL to leave it unchanged
+  * @retval Operation Status.
+  */
+ES_WIFI_Status_t ES_WIFI_SetDNS(ES_WIFIObject_t *Obj, uint8_t *DNS1, uint8_t *DNS2)
+{
+  ES_WIFI_Status_t ret = ES_WIFI_STATUS_OK;
+  /* With DHCP enabled NetSettings hold the leased addresses, not the static ones */
+  uint8_t known = Obj->NetSettingsValid && !Obj->NetSettings.DHCP_IsEnabled;
+
+  if(!known || memcmp(Obj->NetSettings.DNS1, DNS1, 4))
+  {
+    sprintf((char*)Obj->CmdData,"C9=%d.%d.%d.%d\r", DNS1[0], DNS1[1], DNS1[2], DNS1[3]);
+    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    if(ret == ES_WIFI_STATUS_OK)
+    {
+      memcpy(Obj->NetSettings.DNS1, DNS1, 4);
+    }
+  }
+
+  if((ret == ES_WIFI_STATUS_OK) && (DNS2 != NULL) &&
+     (!known || memcmp(Obj->NetSettings.DNS2, DNS2, 4)))
+  {
+    sprintf((char*)Obj->CmdData,"CA=%d.%d.%d.%d\r", DNS2[0], DNS2[1], DNS2[2], DNS2[3]);
+    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    if(ret == ES_WIFI_STATUS_OK)
+    {
+      memcpy(Obj->NetSettings.DNS2, DNS2, 4);
+    }
+  }
+  return ret;
+}
+
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
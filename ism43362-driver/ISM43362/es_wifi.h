@@ -180,6 +180,8 @@ typedef struct {
 
 }ES_WIFI_APs_t;
 
+typedef void (*ES_WIFI_APCallback_t)(void *arg, ES_WIFI_AP_t *AP);
+
 typedef struct {
   uint8_t          SSID[ES_WIFI_MAX_SSID_NAME_SIZE + 1];
   uint8_t          pswd[ES_WIFI_MAX_PSWD_NAME_SIZE + 1];
@@ -236,6 +238,7 @@ typedef struct {
   uint32_t          CPU_Clock;
   ES_WIFI_SecurityType_t Security;
   ES_WIFI_Network_t NetSettings;
+  uint8_t            NetSettingsValid;   /*!< NetSettings match what the module holds */
   ES_WIFI_APSettings_t APSettings;
   ES_WIFI_IO_t       fops;
   uint8_t            CmdData[ES_WIFI_DATA_SIZE];
@@ -248,10 +251,12 @@ typedef struct {
 ES_WIFI_Status_t  ES_WIFI_Init(ES_WIFIObject_t *Obj);
 ES_WIFI_Status_t  ES_WIFI_SetTimeout(ES_WIFIObject_t *Obj, uint32_t Timeout);
 ES_WIFI_Status_t  ES_WIFI_ListAccessPoints(ES_WIFIObject_t *Obj, ES_WIFI_APs_t *APs);
+ES_WIFI_Status_t  ES_WIFI_ScanAccessPoints(ES_WIFIObject_t *Obj, ES_WIFI_APCallback_t Callback, void *arg);
 ES_WIFI_Status_t  ES_WIFI_Connect(ES_WIFIObject_t *Obj, const char* SSID, const char* Password,
                                           ES_WIFI_SecurityType_t SecType);
 ES_WIFI_Status_t  ES_WIFI_Disconnect(ES_WIFIObject_t *Obj);
 uint8_t           ES_WIFI_IsConnected(ES_WIFIObject_t *Obj);
+ES_WIFI_Status_t  ES_WIFI_GetConnectionStatus(ES_WIFIObject_t *Obj);
 ES_WIFI_Status_t  ES_WIFI_GetNetworkSettings(ES_WIFIObject_t *Obj);
 ES_WIFI_Status_t  ES_WIFI_GetMACAddress(ES_WIFIObject_t *Obj, uint8_t *mac);
 ES_WIFI_Status_t  ES_WIFI_GetIPAddress(ES_WIFIObject_t *Obj, uint8_t *ipaddr);
@@ -303,6 +308,8 @@ ES_WIFI_Status_t  ES_WIFI_RegisterBusIO(ES_WIFIObject_t *Obj, IO_Init_Func IO_In
                                                               IO_Receive_Func  IO_Receive);
 
 ES_WIFI_Status_t ES_WIFI_SetDhcp(ES_WIFIObject_t *Obj, uint8_t dhcp_enabled);
+ES_WIFI_Status_t ES_WIFI_SetIPConfig(ES_WIFIObject_t *Obj, uint8_t *IP_Addr, uint8_t *IP_Mask, uint8_t *Gateway_Addr);
+ES_WIFI_Status_t ES_WIFI_SetDNS(ES_WIFIObject_t *Obj, uint8_t *DNS1, uint8_t *DNS2);
 ES_WIFI_Status_t ES_WIFI_GetRssi(ES_WIFIObject_t *Obj, int8_t *rssi);
 
 #ifdef __cplusplus
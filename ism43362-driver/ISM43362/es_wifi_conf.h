@@ -66,6 +66,7 @@
 
 #define ES_WIFI_DATA_SIZE                           1600
 #define ES_WIFI_MAX_DETECTED_AP                     10
+#define ES_WIFI_SCAN_CHUNK_SIZE                     128
 
 #define ES_WIFI_TIMEOUT                             0xFFFFFF
 
@@ -100,6 +100,7 @@ WIFI_Status_t WIFI_ListAccessPoints(WIFI_APs_t *APs, uint8_t AP_MaxNbr)
         strncpy( (char *)APs->ap[APCount].SSID, (char *)esWifiAPs.AP[APCount].SSID, MIN (WIFI_MAX_SSID_NAME, WIFI_MAX_SSID_NAME));
         APs->ap[APCount].RSSI = esWifiAPs.AP[APCount].RSSI;
         memcpy(APs->ap[APCount].MAC, esWifiAPs.AP[APCount].MAC, 6);
+        APs->ap[APCount].Channel = esWifiAPs.AP[APCount].Channel;
       }
     }
     ret = WIFI_STATUS_OK;
@@ -107,6 +108,23 @@ WIFI_Status_t WIFI_ListAccessPoints(WIFI_APs_t *APs, uint8_t AP_MaxNbr)
   return ret;
 }
 
+/**
+  * @brief  Scan for access points, reporting each one through a callback
+  * @param  Callback : function called for every detected AP
+  * @param  arg : argument passed back to Callback
+  * @retval Operation status
+  */
+WIFI_Status_t WIFI_ScanAccessPoints(ES_WIFI_APCallback_t Callback, void *arg)
+{
+  WIFI_Status_t ret = WIFI_STATUS_ERROR;
+
+  if(ES_WIFI_ScanAccessPoints(&EsWifiObj, Callback, arg) == ES_WIFI_STATUS_OK)
+  {
+    ret = WIFI_STATUS_OK;
+  }
+  return ret;
+}
+
 /**
   * @brief  Join an Access Point
   * @param  SSID : SSID string
@@ -183,6 +201,23 @@ WIFI_Status_t WIFI_Disconnect(void)
   return ret;
 }
 
+/**
+  * @brief  Probe the module for the state of the link with the access point
+  * @param  connected : set to 1 if the module is connected, 0 otherwise
+  * @retval Operation status
+  */
+WIFI_Status_t WIFI_GetConnectionStatus(uint8_t *connected)
+{
+  WIFI_Status_t ret = WIFI_STATUS_ERROR;
+
+  if(ES_WIFI_GetConnectionStatus(&EsWifiObj) == ES_WIFI_STATUS_OK)
+  {
+    *connected = ES_WIFI_IsConnected(&EsWifiObj);
+    ret = WIFI_STATUS_OK;
+  }
+  return ret;
+}
+
 /**
   * @brief  Configure an Access Point
 
@@ -545,6 +580,17 @@ WIFI_Status_t WIFI_GetGateway(uint8_t *gateway) {
     return ret;
 }
 
+WIFI_Status_t WIFI_GetDNS(uint8_t *dns1, uint8_t *dns2) {
+    WIFI_Status_t ret = WIFI_STATUS_ERROR;
+    if(EsWifiObj.NetSettings.IsConnected)
+    {
+        memcpy(dns1, EsWifiObj.NetSettings.DNS1, 4);
+        memcpy(dns2, EsWifiObj.NetSettings.DNS2, 4);
+        ret = WIFI_STATUS_OK;
+    }
+    return ret;
+}
+
 WIFI_Status_t WIFI_GetRssi(int8_t *rssi) {
     WIFI_Status_t ret = WIFI_STATUS_ERROR;
     if(EsWifiObj.NetSettings.IsConnected)
@@ -563,6 +609,24 @@ WIFI_Status_t WIFI_SetDhcp(uint8_t dhcp_enabled)
   return ret;
 }
 
+WIFI_Status_t WIFI_SetIPConfig(uint8_t *ipaddr, uint8_t *netmask, uint8_t *gateway)
+{
+  WIFI_Status_t ret = WIFI_STATUS_ERROR;
+  if(ES_WIFI_SetIPConfig(&EsWifiObj, ipaddr, netmask, gateway) == ES_WIFI_STATUS_OK) {
+      ret = WIFI_STATUS_OK;
+  }
+  return ret;
+}
+
+WIFI_Status_t WIFI_SetDNS(uint8_t *dns1, uint8_t *dns2)
+{
+  WIFI_Status_t ret = WIFI_STATUS_ERROR;
+  if(ES_WIFI_SetDNS(&EsWifiObj, dns1, dns2) == ES_WIFI_STATUS_OK) {
+      ret = WIFI_STATUS_OK;
+  }
+  return ret;
+}
+
 WIFI_Status_t WIFI_DNS_LookUp(const char *url, uint8_t *ipaddress)
 {
     WIFI_Status_t ret = WIFI_STATUS_ERROR;
@@ -146,6 +146,7 @@ typedef struct {
 /* Exported functions ------------------------------------------------------- */
 WIFI_Status_t       WIFI_Init(void);
 WIFI_Status_t       WIFI_ListAccessPoints(WIFI_APs_t *APs, uint8_t AP_MaxNbr);
+WIFI_Status_t       WIFI_ScanAccessPoints(ES_WIFI_APCallback_t Callback, void *arg);
 WIFI_Status_t       WIFI_Connect(
                              const char* SSID,
                              const char* Password,
@@ -154,6 +155,7 @@ WIFI_Status_t       WIFI_GetIP_Address(uint8_t  *ipaddr);
 WIFI_Status_t       WIFI_GetMAC_Address(uint8_t  *mac);
 
 WIFI_Status_t       WIFI_Disconnect(void);
+WIFI_Status_t       WIFI_GetConnectionStatus(uint8_t *connected);
 WIFI_Status_t       WIFI_ConfigureAP(
                                         uint8_t *ssid,
                                         uint8_t *pass,
@@ -185,8 +187,11 @@ WIFI_Status_t       WIFI_GetModuleName(char *ModuleName);
 WIFI_Status_t       WIFI_GetCredentials(uint8_t *ssid, uint8_t *password, WIFI_Ecn_t *security);
 WIFI_Status_t       WIFI_GetNetmask(uint8_t *netmask);
 WIFI_Status_t       WIFI_GetGateway(uint8_t *gateway);
+WIFI_Status_t       WIFI_GetDNS(uint8_t *dns1, uint8_t *dns2);
 WIFI_Status_t       WIFI_GetRssi(int8_t *rssi);
 WIFI_Status_t       WIFI_SetDhcp(uint8_t dhcp_enabled);
+WIFI_Status_t       WIFI_SetIPConfig(uint8_t *ipaddr, uint8_t *netmask, uint8_t *gateway);
+WIFI_Status_t       WIFI_SetDNS(uint8_t *dns1, uint8_t *dns2);
 WIFI_Status_t       WIFI_DNS_LookUp(const char *url, uint8_t *ipaddress);
 
 #ifdef __cplusplus
@@ -32,19 +32,58 @@
 #define ISM43362_MISC_TIMEOUT    1000
 #endif
 
+// How long a DHCP lease is reused by fast rejoin
+#ifndef ISM43362_LEASE_REUSE_TIME
+#define ISM43362_LEASE_REUSE_TIME        3600000
+#endif
+
+// Link supervisor
+#ifndef ISM43362_RECONNECT_MIN_BACKOFF
+#define ISM43362_RECONNECT_MIN_BACKOFF   1000
+#endif
+#ifndef ISM43362_RECONNECT_MAX_BACKOFF
+#define ISM43362_RECONNECT_MAX_BACKOFF   60000
+#endif
+#ifndef ISM43362_SUPERVISOR_STACK_SIZE
+#define ISM43362_SUPERVISOR_STACK_SIZE   1536
+#endif
+
+// Background scanning
+#ifndef ISM43362_AP_CACHE_MAX_AGE
+#define ISM43362_AP_CACHE_MAX_AGE        60000
+#endif
+#ifndef ISM43362_SCAN_THREAD_STACK_SIZE
+#define ISM43362_SCAN_THREAD_STACK_SIZE  1536
+#endif
+
 // Firmware version
 #define ISM43362_VERSION 2
 
 // ISM43362Interface implementation
 ISM43362Interface::ISM43362Interface()
-    : _ism()
+    : _ism(), _dhcp(true), _fast_rejoin(false), _conn_status(NSAPI_STATUS_DISCONNECTED), _disconnect_requested(true),
+      _supervisor_thread(NULL), _supervisor_running(false), _supervisor_interval(0),
+      _ap_cache_count(0), _scan_thread(NULL), _scan_interval(0)
 {
     memset(_ids, 0, sizeof(_ids));
     memset(_cbs, 0, sizeof(_cbs));
+    memset(_sockets, 0, sizeof(_sockets));
+    memset(_ip_address, 0, sizeof(_ip_address));
+    memset(_netmask, 0, sizeof(_netmask));
+    memset(_gateway, 0, sizeof(_gateway));
+    memset(_dns, 0, sizeof(_dns));
+    memset(&_lease, 0, sizeof(_lease));
+    _uptime.start();
 
     _ism.attach(this, &ISM43362Interface::event);
 }
 
+ISM43362Interface::~ISM43362Interface()
+{
+    stop_background_scan();
+    stop_link_supervisor();
+}
+
 int ISM43362Interface::connect(const char *ssid, const char *pass, nsapi_security_t security,
                                         uint8_t channel)
 {
@@ -57,9 +96,50 @@ int ISM43362Interface::connect(const char *ssid, const char *pass, nsapi_securit
 }
 
 int ISM43362Interface::connect()
+{
+    _conn_mutex.lock();
+    _disconnect_requested = false;
+    set_connection_status(NSAPI_STATUS_CONNECTING);
+    int ret = join();
+    set_connection_status(ret == NSAPI_ERROR_OK ? NSAPI_STATUS_GLOBAL_UP : NSAPI_STATUS_DISCONNECTED);
+    _conn_mutex.unlock();
+    return ret;
+}
+
+int ISM43362Interface::join()
 {
     _ism.setTimeout(ISM43362_CONNECT_TIMEOUT);
 
+    if (_dns[0][0] && !_ism.setDNS(_dns[0], _dns[1][0] ? _dns[1] : NULL)) {
+        return NSAPI_ERROR_DEVICE_ERROR;
+    }
+
+    if (!_dhcp) {
+        if (!_ism.setNetwork(_ip_address, _netmask, _gateway) || !_ism.dhcp(false)) {
+            return NSAPI_ERROR_DEVICE_ERROR;
+        }
+        if (!_ism.connect(ap_ssid, ap_pass, ap_sec)) {
+            return NSAPI_ERROR_NO_CONNECTION;
+        }
+        if (!_ism.getIPAddress()) {
+            return NSAPI_ERROR_NO_ADDRESS;
+        }
+        return NSAPI_ERROR_OK;
+    }
+
+    if (lease_usable()) {
+        // Servers set by add_dns_server() take precedence over the lease's
+        bool dns = _dns[0][0] || !_lease.dns[0][0]
+                   || _ism.setDNS(_lease.dns[0], _lease.dns[1][0] ? _lease.dns[1] : NULL);
+        if (dns && _ism.setNetwork(_lease.ip, _lease.netmask, _lease.gateway) && _ism.dhcp(false)
+                && _ism.connect(ap_ssid, ap_pass, ap_sec) && _ism.getIPAddress()) {
+            return NSAPI_ERROR_OK;
+        }
+        // The cached lease did not work, leave the network and get a new one
+        _lease.ssid[0] = '\0';
+        _ism.disconnect();
+    }
+
     if (!_ism.dhcp(true)) {
         return NSAPI_ERROR_DHCP_FAILURE;
     }
@@ -69,9 +149,135 @@ int ISM43362Interface::connect()
     if (!_ism.getIPAddress()) {
         return NSAPI_ERROR_DHCP_FAILURE;
     }
+    save_lease();
+    return NSAPI_ERROR_OK;
+}
+
+int ISM43362Interface::set_network(const char *ip_address, const char *netmask, const char *gateway)
+{
+    if (!SocketAddress(ip_address) || !SocketAddress(netmask) || !SocketAddress(gateway)) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+
+    memset(_ip_address, 0, sizeof(_ip_address));
+    strncpy(_ip_address, ip_address, sizeof(_ip_address) - 1);
+    memset(_netmask, 0, sizeof(_netmask));
+    strncpy(_netmask, netmask, sizeof(_netmask) - 1);
+    memset(_gateway, 0, sizeof(_gateway));
+    strncpy(_gateway, gateway, sizeof(_gateway) - 1);
+    _dhcp = false;
+
+    return NSAPI_ERROR_OK;
+}
+
+int ISM43362Interface::set_dhcp(bool dhcp)
+{
+    if (!dhcp && !_ip_address[0]) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    _dhcp = dhcp;
+    return NSAPI_ERROR_OK;
+}
+
+int ISM43362Interface::add_dns_server(const SocketAddress &address)
+{
+    if (!address || address.get_ip_version() != NSAPI_IPv4) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+
+    // Keep the stack's own list too, for resolution done outside the module
+    int err = NetworkStack::add_dns_server(address);
+    if (err != NSAPI_ERROR_OK) {
+        return err;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (!_dns[i][0]) {
+            strncpy(_dns[i], address.get_ip_address(), sizeof(_dns[i]) - 1);
+            break;
+        }
+    }
     return NSAPI_ERROR_OK;
 }
 
+void ISM43362Interface::clear_dns_servers()
+{
+    memset(_dns, 0, sizeof(_dns));
+}
+
+void ISM43362Interface::set_fast_rejoin(bool enabled)
+{
+    _fast_rejoin = enabled;
+    if (!enabled) {
+        _lease.ssid[0] = '\0';
+    }
+}
+
+bool ISM43362Interface::get_lease(ism43362_lease_t *lease)
+{
+    // A rejoin by the supervisor may be updating the lease
+    _conn_mutex.lock();
+    if (!_lease.ssid[0]) {
+        _conn_mutex.unlock();
+        return false;
+    }
+    memset(lease, 0, sizeof(*lease));
+    strcpy(lease->ssid, _lease.ssid);
+    strcpy(lease->ip, _lease.ip);
+    strcpy(lease->netmask, _lease.netmask);
+    strcpy(lease->gateway, _lease.gateway);
+    strcpy(lease->dns[0], _lease.dns[0]);
+    strcpy(lease->dns[1], _lease.dns[1]);
+    lease->age_ms = (uint32_t)_uptime.read_ms() - _lease.obtained_ms;
+    _conn_mutex.unlock();
+    return true;
+}
+
+void ISM43362Interface::set_lease(const ism43362_lease_t *lease)
+{
+    _conn_mutex.lock();
+    memset(&_lease, 0, sizeof(_lease));
+    strncpy(_lease.ip, lease->ip, sizeof(_lease.ip) - 1);
+    strncpy(_lease.netmask, lease->netmask, sizeof(_lease.netmask) - 1);
+    strncpy(_lease.gateway, lease->gateway, sizeof(_lease.gateway) - 1);
+    strncpy(_lease.dns[0], lease->dns[0], sizeof(_lease.dns[0]) - 1);
+    strncpy(_lease.dns[1], lease->dns[1], sizeof(_lease.dns[1]) - 1);
+    if (lease->age_ms < ISM43362_LEASE_REUSE_TIME) {
+        strncpy(_lease.ssid, lease->ssid, sizeof(_lease.ssid) - 1);
+    }
+    _lease.obtained_ms = (uint32_t)_uptime.read_ms() - lease->age_ms;
+    _conn_mutex.unlock();
+}
+
+bool ISM43362Interface::lease_usable()
+{
+    return _fast_rejoin && _lease.ssid[0] && strcmp(_lease.ssid, ap_ssid) == 0
+           && (uint32_t)_uptime.read_ms() - _lease.obtained_ms < ISM43362_LEASE_REUSE_TIME;
+}
+
+void ISM43362Interface::save_lease()
+{
+    if (!_fast_rejoin) {
+        return;
+    }
+
+    const char *ip = _ism.getIPAddress();
+    const char *netmask = ip ? _ism.getNetmask() : NULL;
+    const char *gateway = netmask ? _ism.getGateway() : NULL;
+    if (!gateway) {
+        _lease.ssid[0] = '\0';
+        return;
+    }
+    strncpy(_lease.ip, ip, sizeof(_lease.ip) - 1);
+    strncpy(_lease.netmask, netmask, sizeof(_lease.netmask) - 1);
+    strncpy(_lease.gateway, gateway, sizeof(_lease.gateway) - 1);
+    for (int i = 0; i < 2; i++) {
+        const char *dns = _ism.getDNS(i);
+        strncpy(_lease.dns[i], dns ? dns : "", sizeof(_lease.dns[i]) - 1);
+    }
+    strncpy(_lease.ssid, ap_ssid, sizeof(_lease.ssid) - 1);
+    _lease.obtained_ms = _uptime.read_ms();
+}
+
 int ISM43362Interface::set_credentials(const char *ssid, const char *pass, nsapi_security_t security)
 {
     memset(ap_ssid, 0, sizeof(ap_ssid));
@@ -93,15 +299,125 @@ int ISM43362Interface::set_channel(uint8_t channel)
 
 int ISM43362Interface::disconnect()
 {
+    int ret = NSAPI_ERROR_OK;
+
+    // Waits for a rejoin by the supervisor to finish, then undoes it
+    _conn_mutex.lock();
+    _disconnect_requested = true;
     _ism.setTimeout(ISM43362_MISC_TIMEOUT);
 
     if (!_ism.disconnect()) {
-        return NSAPI_ERROR_DEVICE_ERROR;
+        ret = NSAPI_ERROR_DEVICE_ERROR;
+    } else {
+        set_connection_status(NSAPI_STATUS_DISCONNECTED);
+    }
+    _conn_mutex.unlock();
+    return ret;
+}
+
+void ISM43362Interface::attach(Callback<void(nsapi_event_t, intptr_t)> status_cb)
+{
+    _conn_status_cb = status_cb;
+}
+
+nsapi_connection_status_t ISM43362Interface::get_connection_status() const
+{
+    _conn_mutex.lock();
+    nsapi_connection_status_t status = _conn_status;
+    _conn_mutex.unlock();
+    return status;
+}
+
+// Called with _conn_mutex held
+void ISM43362Interface::set_connection_status(nsapi_connection_status_t status)
+{
+    if (_conn_status == status) {
+        return;
+    }
+    _conn_status = status;
+    if (_conn_status_cb) {
+        _conn_status_cb(NSAPI_EVENT_CONNECTION_STATUS_CHANGE, status);
+    }
+}
+
+int ISM43362Interface::start_link_supervisor(uint32_t interval_ms)
+{
+    if (interval_ms == 0) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    _supervisor_interval = interval_ms;
+    if (_supervisor_thread) {
+        return NSAPI_ERROR_OK;
     }
 
+    _supervisor_thread = new Thread(osPriorityBelowNormal, ISM43362_SUPERVISOR_STACK_SIZE);
+    if (!_supervisor_thread) {
+        return NSAPI_ERROR_NO_MEMORY;
+    }
+    _supervisor_running = true;
+    if (_supervisor_thread->start(callback(this, &ISM43362Interface::supervisor_thread)) != osOK) {
+        _supervisor_running = false;
+        delete _supervisor_thread;
+        _supervisor_thread = NULL;
+        return NSAPI_ERROR_NO_MEMORY;
+    }
     return NSAPI_ERROR_OK;
 }
 
+void ISM43362Interface::stop_link_supervisor()
+{
+    if (!_supervisor_thread) {
+        return;
+    }
+    _supervisor_running = false;
+    _supervisor_wake.release();
+    _supervisor_thread->join();
+    delete _supervisor_thread;
+    _supervisor_thread = NULL;
+}
+
+void ISM43362Interface::supervisor_thread()
+{
+    uint32_t backoff = ISM43362_RECONNECT_MIN_BACKOFF;
+
+    while (_supervisor_running) {
+        _supervisor_wake.wait(_supervisor_interval);
+        _conn_mutex.lock();
+        if (!_supervisor_running || _disconnect_requested || _conn_status != NSAPI_STATUS_GLOBAL_UP
+                || _ism.isConnected()) {
+            _conn_mutex.unlock();
+            continue;
+        }
+
+        // Link lost, rejoin until it works or the application disconnects
+        set_connection_status(NSAPI_STATUS_DISCONNECTED);
+        set_connection_status(NSAPI_STATUS_CONNECTING);
+        _conn_mutex.unlock();
+        while (_supervisor_running) {
+            // Each attempt holds the lock, so that disconnect() and connect()
+            // happen before or after it, never during
+            _conn_mutex.lock();
+            if (_disconnect_requested || _conn_status != NSAPI_STATUS_CONNECTING) {
+                _conn_mutex.unlock();
+                break;
+            }
+            bool joined = join() == NSAPI_ERROR_OK;
+            if (joined) {
+                reopen_sockets();
+                set_connection_status(NSAPI_STATUS_GLOBAL_UP);
+            }
+            _conn_mutex.unlock();
+            if (joined) {
+                event();
+                backoff = ISM43362_RECONNECT_MIN_BACKOFF;
+                break;
+            }
+            _supervisor_wake.wait(backoff);
+            backoff = backoff * 2 > ISM43362_RECONNECT_MAX_BACKOFF ? ISM43362_RECONNECT_MAX_BACKOFF : backoff * 2;
+        }
+    }
+}
+
 const char *ISM43362Interface::get_ip_address()
 {
     return _ism.getIPAddress();
@@ -129,7 +445,147 @@ int8_t ISM43362Interface::get_rssi()
 
 int ISM43362Interface::scan(WiFiAccessPoint *res, unsigned count)
 {
-    return _ism.scan(res, count);
+    return _ism.scan(res, count, callback(this, &ISM43362Interface::cache_ap));
+}
+
+int ISM43362Interface::scan(Callback<void(const nsapi_wifi_ap_t *)> cb)
+{
+    struct scan_report {
+        ISM43362Interface *iface;
+        Callback<void(const nsapi_wifi_ap_t *)> cb;
+
+        void report(const nsapi_wifi_ap_t *ap)
+        {
+            iface->cache_ap(ap);
+            if (cb) {
+                cb(ap);
+            }
+        }
+    } fwd = { this, cb };
+
+    return _ism.scan(callback(&fwd, &scan_report::report));
+}
+
+int ISM43362Interface::start_background_scan(uint32_t interval_ms)
+{
+    if (interval_ms == 0) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    _scan_interval = interval_ms;
+    if (_scan_thread) {
+        return NSAPI_ERROR_OK;
+    }
+
+    _scan_thread = new Thread(osPriorityLow, ISM43362_SCAN_THREAD_STACK_SIZE);
+    if (!_scan_thread) {
+        return NSAPI_ERROR_NO_MEMORY;
+    }
+    if (_scan_thread->start(callback(this, &ISM43362Interface::scan_thread)) != osOK) {
+        delete _scan_thread;
+        _scan_thread = NULL;
+        return NSAPI_ERROR_NO_MEMORY;
+    }
+    return NSAPI_ERROR_OK;
+}
+
+void ISM43362Interface::stop_background_scan()
+{
+    if (!_scan_thread) {
+        return;
+    }
+    _scan_stop.release();
+    _scan_thread->join();
+    delete _scan_thread;
+    _scan_thread = NULL;
+}
+
+int ISM43362Interface::get_cached_aps(WiFiAccessPoint *res, unsigned count, const char *ssid, uint32_t max_age_ms)
+{
+    unsigned found = 0;
+
+    _ap_cache_mutex.lock();
+    expire_cached_aps();
+    uint32_t now = _uptime.read_ms();
+    for (unsigned i = 0; i < _ap_cache_count; i++) {
+        const nsapi_wifi_ap_t &ap = _ap_cache[i].ap;
+        if (ssid && strcmp(ssid, ap.ssid) != 0) {
+            continue;
+        }
+        if (max_age_ms && now - _ap_cache[i].seen_ms > max_age_ms) {
+            continue;
+        }
+
+        // Insert sorted by decreasing RSSI, dropping the weakest when full
+        unsigned j = found;
+        if (j == count) {
+            if (count == 0 || res[j - 1].get_rssi() >= ap.rssi) {
+                continue;
+            }
+            j--;
+        } else {
+            found++;
+        }
+        while (j > 0 && res[j - 1].get_rssi() < ap.rssi) {
+            res[j] = res[j - 1];
+            j--;
+        }
+        res[j] = WiFiAccessPoint(ap);
+    }
+    _ap_cache_mutex.unlock();
+    return found;
+}
+
+void ISM43362Interface::cache_ap(const nsapi_wifi_ap_t *ap)
+{
+    uint32_t now = _uptime.read_ms();
+    unsigned i;
+
+    _ap_cache_mutex.lock();
+    expire_cached_aps();
+    for (i = 0; i < _ap_cache_count; i++) {
+        if (memcmp(_ap_cache[i].ap.bssid, ap->bssid, sizeof(ap->bssid)) == 0) {
+            break;
+        }
+    }
+    if (i == ISM43362_AP_CACHE_SIZE) {
+        // Cache full, replace the entry that was seen the longest time ago
+        i = 0;
+        for (unsigned j = 1; j < _ap_cache_count; j++) {
+            if (now - _ap_cache[j].seen_ms > now - _ap_cache[i].seen_ms) {
+                i = j;
+            }
+        }
+    } else if (i == _ap_cache_count) {
+        _ap_cache_count++;
+    }
+    _ap_cache[i].ap = *ap;
+    _ap_cache[i].seen_ms = now;
+    _ap_cache_mutex.unlock();
+}
+
+void ISM43362Interface::expire_cached_aps()
+{
+    uint32_t now = _uptime.read_ms();
+    unsigned i = 0;
+
+    while (i < _ap_cache_count) {
+        if (now - _ap_cache[i].seen_ms > ISM43362_AP_CACHE_MAX_AGE) {
+            _ap_cache[i] = _ap_cache[--_ap_cache_count];
+        } else {
+            i++;
+        }
+    }
+}
+
+void ISM43362Interface::scan_thread()
+{
+    while (_scan_stop.wait(_scan_interval) == 0) {
+        // A scan holds the module for seconds, leave it to the sockets
+        if (sockets_connected()) {
+            continue;
+        }
+        _ism.scan(callback(this, &ISM43362Interface::cache_ap));
+    }
 }
 
 int ISM43362Interface::gethostbyname(const char *host, SocketAddress *address, nsapi_version_t version)
@@ -146,6 +602,7 @@ struct ism43362_socket {
     nsapi_protocol_t proto;
     bool connected;
     SocketAddress addr;
+    uint32_t recv_timeout;
 };
 
 int ISM43362Interface::socket_open(void **handle, nsapi_protocol_t proto)
@@ -173,7 +630,12 @@ int ISM43362Interface::socket_open(void **handle, nsapi_protocol_t proto)
     socket->id = id;
     socket->proto = proto;
     socket->connected = false;
+    socket->recv_timeout = ISM43362_RECV_TIMEOUT;
     *handle = socket;
+
+    _sockets_mutex.lock();
+    _sockets[id] = socket;
+    _sockets_mutex.unlock();
     return 0;
 }
 
@@ -183,12 +645,15 @@ int ISM43362Interface::socket_close(void *handle)
     int err = 0;
     _ism.setTimeout(ISM43362_MISC_TIMEOUT);
 
+    _sockets_mutex.lock();
     if (socket->connected && !_ism.close(socket->id)) {
         err = NSAPI_ERROR_DEVICE_ERROR;
     }
 
     socket->connected = false;
     _ids[socket->id] = false;
+    _sockets[socket->id] = NULL;
+    _sockets_mutex.unlock();
     delete socket;
     return err;
 }
@@ -213,10 +678,45 @@ int ISM43362Interface::socket_connect(void *handle, const SocketAddress &addr)
     if (!_ism.open(socket->proto, socket->id, addr.get_ip_address(), addr.get_port())) {
         return NSAPI_ERROR_DEVICE_ERROR;
     }
+    socket->addr = addr;
     socket->connected = true;
     return 0;
 }
 
+// Whether any socket is connected, which a background scan would stall.
+bool ISM43362Interface::sockets_connected()
+{
+    bool connected = false;
+
+    _sockets_mutex.lock();
+    for (int i = 0; i < ISM43362_SOCKET_COUNT; i++) {
+        if (_sockets[i] && _sockets[i]->connected) {
+            connected = true;
+        }
+    }
+    _sockets_mutex.unlock();
+    return connected;
+}
+
+// Reopen the sockets that were connected when the link was lost.
+void ISM43362Interface::reopen_sockets()
+{
+    _ism.setTimeout(ISM43362_MISC_TIMEOUT);
+
+    _sockets_mutex.lock();
+    for (int i = 0; i < ISM43362_SOCKET_COUNT; i++) {
+        struct ism43362_socket *socket = _sockets[i];
+        if (!socket || !socket->connected) {
+            continue;
+        }
+        _ism.close(socket->id);
+        if (!_ism.open(socket->proto, socket->id, socket->addr.get_ip_address(), socket->addr.get_port())) {
+            socket->connected = false;
+        }
+    }
+    _sockets_mutex.unlock();
+}
+
 // Accepts a connection on a TCP socket.
 int ISM43362Interface::socket_accept(void *server, void **socket, SocketAddress *addr)
 {
@@ -227,9 +727,12 @@ int ISM43362Interface::socket_accept(void *server, void **socket, SocketAddress
 int ISM43362Interface::socket_send(void *handle, const void *data, unsigned size)
 {
     struct ism43362_socket *socket = (struct ism43362_socket *)handle;
-    _ism.setTimeout(ISM43362_SEND_TIMEOUT);
 
-    if (!_ism.send(socket->id, data, size)) {
+    if (!_ism.send(socket->id, data, size, ISM43362_SEND_TIMEOUT)) {
+        // May be a dropped link, let the supervisor check now
+        if (_supervisor_thread) {
+            _supervisor_wake.release();
+        }
         return NSAPI_ERROR_DEVICE_ERROR;
     }
 
@@ -240,8 +743,7 @@ int ISM43362Interface::socket_send(void *handle, const void *data, unsigned size
 int ISM43362Interface::socket_recv(void *handle, void *data, unsigned size)
 {
     struct ism43362_socket *socket = (struct ism43362_socket *)handle;
-    _ism.setTimeout(ISM43362_RECV_TIMEOUT);
-    int32_t recv = _ism.recv(socket->id, data, size);
+    int32_t recv = _ism.recv(socket->id, data, size, socket->recv_timeout);
     if (recv < 0) {
         return NSAPI_ERROR_WOULD_BLOCK;
     }
@@ -291,6 +793,21 @@ void ISM43362Interface::socket_attach(void *handle, void (*callback)(void *), vo
     _cbs[socket->id].data = data;
 }
 
+// Set the time a receive waits in the module, which is sent with every receive anyway.
+nsapi_error_t ISM43362Interface::setsockopt(nsapi_socket_t handle, int level, int optname, const void *optval, unsigned optlen)
+{
+    struct ism43362_socket *socket = (struct ism43362_socket *)handle;
+
+    if (level != NSAPI_SOCKET || optname != ISM43362_SOCKOPT_RECV_TIMEOUT) {
+        return NSAPI_ERROR_UNSUPPORTED;
+    }
+    if (optlen != sizeof(int) || *(const int *)optval < 1) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    socket->recv_timeout = *(const int *)optval;
+    return NSAPI_ERROR_OK;
+}
+
 void ISM43362Interface::event() {
     for (int i = 0; i < ISM43362_SOCKET_COUNT; i++) {
         if (_cbs[i].callback) {
@@ -22,6 +22,29 @@
 
 #define ISM43362_SOCKET_COUNT 4
 
+/** Socket option, at level NSAPI_SOCKET, for the most time in milliseconds that a receive
+ *  waits in the module for data, as an int
+ */
+#define ISM43362_SOCKOPT_RECV_TIMEOUT 0x4301
+
+struct ism43362_socket;
+
+#ifndef ISM43362_AP_CACHE_SIZE
+#define ISM43362_AP_CACHE_SIZE 16
+#endif
+
+/** A DHCP lease as reused by fast rejoin, which an application can keep in
+ *  persistent storage with ISM43362Interface::get_lease() and set_lease()
+ */
+typedef struct {
+    char ssid[33];      /* Network the lease was obtained on */
+    char ip[16];
+    char netmask[16];
+    char gateway[16];
+    char dns[2][16];    /* Empty when the network gave none */
+    uint32_t age_ms;    /* Time since the lease was obtained */
+} ism43362_lease_t;
+
 /** ISM43362Interface class
  *  Implementation of the NetworkStack for the ISM43362
  */
@@ -32,6 +55,10 @@ public:
      */
     ISM43362Interface();
 
+    /** Stops the background scanner and the link supervisor, if started
+     */
+    virtual ~ISM43362Interface();
+
     /** Start the interface
      *
      *  Attempts to connect to a WiFi network. Requires ssid and passphrase to be set.
@@ -73,11 +100,79 @@ public:
      */
     virtual int set_channel(uint8_t channel);
 
+    /** Enable or disable fast rejoin
+     *
+     *  When enabled, connecting again to the network that was last joined
+     *  reuses the address and DNS servers obtained from DHCP as a static
+     *  configuration, skipping the DHCP exchange. A lease is reused for at
+     *  most ISM43362_LEASE_REUSE_TIME milliseconds after it was obtained,
+     *  and DHCP is used again if joining with it fails.
+     *
+     *  The lease is only kept in RAM, so by itself this speeds up rejoins
+     *  without a reset. To rejoin quickly after a reset or power cycle as
+     *  well, save the lease with get_lease() and restore it with set_lease().
+     *
+     *  @param enabled   true to enable fast rejoin
+     */
+    void set_fast_rejoin(bool enabled);
+
+    /** Get the lease kept for fast rejoin
+     *
+     *  @param lease     Destination for the lease
+     *  @return          true, or false if no lease is kept
+     */
+    bool get_lease(ism43362_lease_t *lease);
+
+    /** Restore a lease saved with get_lease(), for the next connect
+     *
+     *  Add the time the device was off to @a lease->age_ms before restoring
+     *  it. When that time is unknown, a lease which has expired may be
+     *  tried, which costs a failed join before DHCP is used.
+     *
+     *  @param lease     The lease to reuse if fast rejoin is enabled
+     */
+    void set_lease(const ism43362_lease_t *lease);
+
     /** Stop the interface
      *  @return             0 on success, negative on failure
      */
     virtual int disconnect();
 
+    /** Register callback for status reporting
+     *
+     *  The callback is called with NSAPI_EVENT_CONNECTION_STATUS_CHANGE
+     *  and the new nsapi_connection_status_t on every status change,
+     *  including the ones caused by the link supervisor.
+     *
+     *  @param status_cb The callback for status changes
+     */
+    virtual void attach(Callback<void(nsapi_event_t, intptr_t)> status_cb);
+
+    /** Get the connection status
+     *
+     *  @return         The connection status according to nsapi_connection_status_t
+     */
+    virtual nsapi_connection_status_t get_connection_status() const;
+
+    /** Start supervising the link with the access point
+     *
+     *  A thread probes the module every @a interval_ms while the interface
+     *  is connected. When the link is lost, it reconnects with exponential
+     *  backoff between ISM43362_RECONNECT_MIN_BACKOFF and
+     *  ISM43362_RECONNECT_MAX_BACKOFF milliseconds, then reopens the
+     *  sockets that were connected. After disconnect() it does not rejoin
+     *  until connect() is called again.
+     *
+     *  @param interval_ms  Time between two probes in milliseconds, not 0
+     *  @return             0 on success, NSAPI_ERROR_PARAMETER for an
+     *                      interval of 0, or another negative error code
+     */
+    int start_link_supervisor(uint32_t interval_ms);
+
+    /** Stop the link supervisor started by start_link_supervisor()
+     */
+    void stop_link_supervisor();
+
     /** Get the internally stored IP address
      *  @return             IP address of the interface or null if not yet connected
      */
@@ -120,6 +215,51 @@ public:
      */
     virtual int scan(WiFiAccessPoint *res, unsigned count);
 
+    /** Scan for available networks, reporting each one as it is received
+     *
+     * This function will block. Unlike scan(WiFiAccessPoint *, unsigned),
+     * the number of reported networks is not limited by a result array.
+     *
+     * @param  cb       Function called once per discovered AP
+     * @return          Number of available networks, negative on error
+     *                  see @a nsapi_error
+     */
+    int scan(Callback<void(const nsapi_wifi_ap_t *)> cb);
+
+    /** Start scanning for networks in the background
+     *
+     *  A low priority thread scans every @a interval_ms and records the
+     *  access points it sees in a cache, which get_cached_aps() reads
+     *  without talking to the module. Foreground scans refresh it as well.
+     *
+     *  The module serves no other command during a scan, which takes a few
+     *  seconds, so the thread skips its scans while any socket is connected
+     *  rather than stall it. A socket connected during a scan waits for it.
+     *
+     *  @param interval_ms  Time between two scans in milliseconds, not 0
+     *  @return             0 on success, NSAPI_ERROR_PARAMETER for an
+     *                      interval of 0, or another negative error code
+     */
+    int start_background_scan(uint32_t interval_ms);
+
+    /** Stop the background scanner started by start_background_scan()
+     */
+    void stop_background_scan();
+
+    /** Read the access point cache
+     *
+     *  Entries are returned strongest first. Access points not seen for
+     *  ISM43362_AP_CACHE_MAX_AGE milliseconds are dropped from the cache.
+     *
+     *  @param res          Array to store the cached AP
+     *  @param count        Size of @a res
+     *  @param ssid         Only return AP with this name, or null for all
+     *  @param max_age_ms   Only return AP seen in the last @a max_age_ms
+     *                      milliseconds, or 0 for any cached AP
+     *  @return             Number of entries in @a res
+     */
+    int get_cached_aps(WiFiAccessPoint *res, unsigned count, const char *ssid = NULL, uint32_t max_age_ms = 0);
+
     /** Translates a hostname to an IP address with specific version
      *
      *  The hostname may be either a domain name or an IP address. If the
@@ -138,11 +278,47 @@ public:
     virtual int gethostbyname(const char *host, SocketAddress *address, nsapi_version_t version=NSAPI_UNSPEC);
 
     /** Add a domain name server to list of servers to query
+     *
+     *  The server is added to the stack's list, and the first two added
+     *  are programmed into the module as primary and secondary DNS on
+     *  the next connect.
      *
      *  @param addr     Destination for the host address
      *  @return         0 on success, negative error code on failure
      */
-    using NetworkInterface::add_dns_server;
+    virtual int add_dns_server(const SocketAddress &address);
+
+    /** Forget the DNS servers to program into the module
+     *
+     *  From the next connect the module uses the servers given by DHCP.
+     *  With a static address it keeps those it was last given, until
+     *  others are added. The stack's own list is not changed.
+     */
+    void clear_dns_servers();
+
+    /** Set a static IP address
+     *
+     *  Configures this network interface to use a static IP address.
+     *  Implicitly disables DHCP, which can be enabled in set_dhcp.
+     *  Takes effect on the next connect.
+     *
+     *  @param ip_address Null-terminated representation of the local IP address
+     *  @param netmask    Null-terminated representation of the local network mask
+     *  @param gateway    Null-terminated representation of the local gateway
+     *  @return           0 on success, negative error code on failure
+     */
+    virtual int set_network(const char *ip_address, const char *netmask, const char *gateway);
+
+    /** Enable or disable DHCP on the network
+     *
+     *  DHCP is enabled by default, and disabled by set_network.
+     *  Takes effect on the next connect.
+     *
+     *  @param dhcp     True to enable DHCP
+     *  @return         0 on success, NSAPI_ERROR_PARAMETER when disabling
+     *                  DHCP before set_network gave an address
+     */
+    virtual int set_dhcp(bool dhcp);
 
 protected:
     /** Open a socket
@@ -243,6 +419,16 @@ protected:
      */
     virtual void socket_attach(void *handle, void (*callback)(void *), void *data);
 
+    /** Set a socket option
+     *  @param handle       Socket handle
+     *  @param level        Option level, NSAPI_SOCKET
+     *  @param optname      ISM43362_SOCKOPT_RECV_TIMEOUT, the only option supported
+     *  @param optval       Option value
+     *  @param optlen       Length of the option value
+     *  @return             0 on success, negative error code on failure
+     */
+    virtual nsapi_error_t setsockopt(nsapi_socket_t handle, int level, int optname, const void *optval, unsigned optlen);
+
     /** Provide access to the NetworkStack object
      *
      *  @return The underlying NetworkStack object
@@ -261,8 +447,64 @@ private:
     uint8_t ap_ch;
     char ap_pass[64]; /* The longest allowed passphrase */
 
+    bool _dhcp;
+    char _ip_address[16];
+    char _netmask[16];
+    char _gateway[16];
+    char _dns[2][16];
+
+    bool _fast_rejoin;
+    struct {
+        char ssid[33]; /* Empty when no lease is cached */
+        char ip[16];
+        char netmask[16];
+        char gateway[16];
+        char dns[2][16];
+        uint32_t obtained_ms;
+    } _lease;
+
+    bool lease_usable();
+    void save_lease();
+
+    int join();
+
+    // _conn_status and _disconnect_requested are guarded by _conn_mutex,
+    // which is held through connect(), disconnect() and each rejoin
+    nsapi_connection_status_t _conn_status;
+    bool _disconnect_requested;
+    mutable Mutex _conn_mutex;
+    Callback<void(nsapi_event_t, intptr_t)> _conn_status_cb;
+    void set_connection_status(nsapi_connection_status_t status);
+
+    struct ism43362_socket *_sockets[ISM43362_SOCKET_COUNT];
+    Mutex _sockets_mutex;
+    void reopen_sockets();
+
+    Thread *_supervisor_thread;
+    Semaphore _supervisor_wake;
+    volatile bool _supervisor_running;
+    uint32_t _supervisor_interval;
+    void supervisor_thread();
+
     void event();
 
+    struct {
+        nsapi_wifi_ap_t ap;
+        uint32_t seen_ms;
+    } _ap_cache[ISM43362_AP_CACHE_SIZE];
+    unsigned _ap_cache_count;
+    Mutex _ap_cache_mutex;
+    Timer _uptime;
+
+    Thread *_scan_thread;
+    Semaphore _scan_stop;
+    uint32_t _scan_interval;
+
+    bool sockets_connected();
+    void cache_ap(const nsapi_wifi_ap_t *ap);
+    void expire_cached_aps();
+    void scan_thread();
+
     struct {
         void (*callback)(void *);
         void *data;
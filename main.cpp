@@ -309,7 +309,7 @@ void mqttDemo() {
 
     logMessage("HelloMQTT: version is %.2f\r\n", version);
 
-    MQTTNetwork mqttNetwork(&wifi);
+    MQTTNetwork mqttNetwork(&wifi, ISM43362_SOCKOPT_RECV_TIMEOUT);
 
     MQTT::Client<MQTTNetwork, Countdown> client(mqttNetwork);
 
@@ -320,6 +320,11 @@ void mqttDemo() {
     int rc = mqttNetwork.connect(hostname, port);
     if (rc != 0)
         logMessage("rc from TCP connect is %d\r\n", rc);
+    // seed the reconnect delays from the MAC address, as every device has the same client id here
+    unsigned int seed = 0;
+    for (const char* mac = wifi.get_mac_address(); mac && *mac; ++mac)
+        seed = seed * 31 + *mac;
+    client.setAutoReconnect(hostname, port, seed);
 
     MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
     data.MQTTVersion = 3;
@@ -0,0 +1,90 @@
+#if !defined(HOST_H)
+#define HOST_H
+
+// Stand-ins for the mbed parts the MQTT client uses, so that it can be tested on a host
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+
+// the Timer of MQTT::Client
+class Countdown
+{
+public:
+    Countdown()
+    {
+        end = Clock::now();
+    }
+
+    Countdown(int ms)
+    {
+        countdown_ms(ms);
+    }
+
+    bool expired()
+    {
+        return Clock::now() >= end;
+    }
+
+    void countdown_ms(unsigned long ms)
+    {
+        end = Clock::now() + std::chrono::milliseconds(ms);
+    }
+
+    void countdown(int seconds)
+    {
+        countdown_ms(seconds * 1000L);
+    }
+
+    int left_ms()
+    {
+        long long left = std::chrono::duration_cast<std::chrono::milliseconds>(end - Clock::now()).count();
+        return (left < 0) ? 0 : (int)left;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point end;
+};
+
+// the Network of MQTT::Client: reads what the test has pushed, and records what is written
+struct FakeNet
+{
+    std::vector<unsigned char> in;
+    size_t pos = 0;
+    std::vector<unsigned char> out;
+
+    void push(const std::vector<unsigned char>& bytes)
+    {
+        in.insert(in.end(), bytes.begin(), bytes.end());
+    }
+
+    int read(unsigned char* buffer, int len, int timeout)
+    {
+        int n = (int)(in.size() - pos);
+
+        if (n > len)
+            n = len;
+        memcpy(buffer, in.data() + pos, n);
+        pos += n;
+        return n;
+    }
+
+    int write(unsigned char* buffer, int len, int timeout)
+    {
+        out.insert(out.end(), buffer, buffer + len);
+        return len;
+    }
+};
+
+inline void wait_ms(int ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+#endif
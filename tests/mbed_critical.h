@@ -0,0 +1,23 @@
+#if !defined(MBED_CRITICAL_H)
+#define MBED_CRITICAL_H
+
+// the atomics of mbed's platform/mbed_critical.h, which MQTTPublishQueue.h uses, for a host build
+
+#include <stdint.h>
+
+static inline bool core_util_atomic_cas_u32(volatile uint32_t* ptr, uint32_t* expected, uint32_t desired)
+{
+    return __atomic_compare_exchange_n(ptr, expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t core_util_atomic_incr_u32(volatile uint32_t* ptr, uint32_t delta)
+{
+    return __atomic_add_fetch(ptr, delta, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t core_util_atomic_decr_u32(volatile uint32_t* ptr, uint32_t delta)
+{
+    return __atomic_sub_fetch(ptr, delta, __ATOMIC_SEQ_CST);
+}
+
+#endif
@@ -0,0 +1,309 @@
+// MQTT::OfflineQueue: its record format in RAM and in the spill file, refilling from the file, the
+// window of publishes handed to the client, and compacting the file
+
+#include "host.h"
+#include <functional>
+#include <map>
+#include <set>
+
+#define MQTTCLIENT_QOS2 1
+#define private public      // for the file positions and the window
+#include "MQTTOfflineQueue.h"
+#undef private
+
+typedef std::vector<unsigned char> Bytes;
+
+// a client which records what it is given to publish, and completes the publishes when told to
+struct FakeClient
+{
+    bool connected = false;
+    bool ack_at_once = true;    // complete each publish as it is sent
+    int fail = 0;               // publishes to fail, each dropping the connection
+    bool keep = false;          // whether a failed publish is kept in flight, to be sent again by the client
+    unsigned short next_id = 0;
+    std::set<unsigned short> inflight;
+    std::vector<std::string> sent;  // "topic:payload:qos", with "r" if retained
+    std::map<unsigned short, std::function<void(MQTT::publishData&)> > pending;
+
+    bool isConnected()
+    {
+        return connected;
+    }
+
+    bool isInflight(unsigned short id)
+    {
+        return inflight.count(id) != 0;
+    }
+
+    int yield(unsigned long)
+    {
+        return MQTT::SUCCESS;
+    }
+
+    template<class T>
+    int publishAsync(const char* topic, const void* payload, size_t len, unsigned short& id, MQTT::QoS qos,
+                     bool retained, T* item, void (T::*method)(MQTT::publishData&))
+    {
+        if (qos != MQTT::QOS0)
+            id = ++next_id;
+        if (fail > 0)
+        {
+            --fail;
+            connected = false;
+            if (keep && qos != MQTT::QOS0)
+                inflight.insert(id);
+            return MQTT::FAILURE;
+        }
+        sent.push_back(std::string(topic) + ":" + std::string((const char*)payload, len) + ":" + char('0' + qos) +
+                       (retained ? "r" : ""));
+        std::function<void(MQTT::publishData&)> completed = [item, method](MQTT::publishData& data) { (item->*method)(data); };
+        if (qos == MQTT::QOS0 || ack_at_once)
+        {
+            MQTT::publishData data = {id, MQTT::SUCCESS};
+            completed(data);
+        }
+        else
+            pending[id] = completed;
+        return MQTT::SUCCESS;
+    }
+
+    void complete(unsigned short id, int rc)
+    {
+        MQTT::publishData data = {id, rc};
+        std::function<void(MQTT::publishData&)> completed = pending[id];
+
+        pending.erase(id);
+        completed(data);
+    }
+
+    void completeAll()
+    {
+        while (!pending.empty())
+            complete(pending.begin()->first, MQTT::SUCCESS);
+    }
+};
+
+typedef MQTT::OfflineQueue<FakeClient, 64> Queue;
+typedef MQTT::OfflineQueue<FakeClient, 16> SmallQueue;
+
+static long fileSize(FILE* file)
+{
+    fseek(file, 0, SEEK_END);
+    return ftell(file);
+}
+
+static std::string record(const char* topic, int i, int qos, bool retained)
+{
+    char buf[40];
+
+    sprintf(buf, "%s:m%d:%d%s", topic, i, qos, retained ? "r" : "");
+    return buf;
+}
+
+// fill RAM and the file while disconnected, then publish in order what survives a restart
+static void spill_and_restart(FILE* file)
+{
+    FakeClient client;
+    int queued = 0;
+
+    {
+        Queue queue(client, file, 300);
+        char payload[16];
+
+        for (int i = 0; ; ++i)
+        {
+            sprintf(payload, "m%d", i);
+            int rc = queue.publish("t/x", payload, strlen(payload), (MQTT::QoS)(i % 3), i % 2);
+            if (rc != MQTT::SUCCESS)
+            {
+                assert(rc == MQTT::BUFFER_OVERFLOW);
+                break;
+            }
+            queued++;
+        }
+        assert(queue.count() == queued && queued > 20 && fileSize(file) <= 300);
+
+        char big[80] = {0};
+        assert(queue.publish("t", big, 70) == MQTT::BUFFER_OVERFLOW);   // larger than RAM
+    }
+
+    Queue queue(client, file, 300);    // only the records in the file survive
+    int stored = queue.count();
+    assert(stored > 10 && stored < queued);
+    client.connected = true;
+    assert(queue.drain() == MQTT::SUCCESS && queue.count() == 0 && (int)client.sent.size() == stored);
+    for (int i = 0; i < stored; ++i)
+    {
+        int k = queued - stored + i;
+        assert(client.sent[i] == record("t/x", k, k % 3, k % 2));
+    }
+    assert(queue.head == Queue::HEADER_LEN && queue.tail == Queue::HEADER_LEN);  // the file started again
+}
+
+// up to MAX_INFLIGHT_MESSAGES outstanding, each record removed when its publish completes
+static void window(FILE* file)
+{
+    FakeClient client;
+    Queue queue(client, file, 300);
+    char payload[16];
+
+    assert(queue.count() == 0);
+    for (int i = 0; i < 30; ++i)
+    {
+        sprintf(payload, "%d", i);
+        assert(queue.publish("a", payload, strlen(payload), MQTT::QOS1) == MQTT::SUCCESS);
+    }
+
+    // the first is kept by the client, to send again itself
+    client.connected = true;
+    client.fail = 1;
+    client.keep = true;
+    assert(queue.drain() == MQTT::FAILURE && client.sent.empty());
+    assert(queue.window[0].id == 1 && queue.window[0].state == Queue::SENT);
+
+    client.connected = true;
+    client.ack_at_once = false;
+    assert(queue.drain() == MQTT::SUCCESS && client.sent.size() == 3 && queue.window_count == MAX_INFLIGHT_MESSAGES);
+    client.complete(3, MQTT::SUCCESS);
+    assert(queue.drain() == MQTT::SUCCESS && client.sent.size() == 3);     // the first is still outstanding
+
+    client.inflight.clear();
+    client.connected = false;
+    client.complete(2, MQTT::FAILURE);      // dropped with the session, so sent again
+    client.connected = true;
+    client.complete(4, MQTT::FAILURE);      // refused, so dropped
+    MQTT::publishData first = {1, MQTT::SUCCESS};
+    queue.completed(first);                 // as by the client's resend
+    assert(queue.drain() == MQTT::SUCCESS && client.sent.size() == 5);
+    assert(client.sent[3] == "a:1:1" && client.sent[4] == "a:4:1");
+
+    client.ack_at_once = true;
+    client.completeAll();
+    assert(queue.drain() == MQTT::SUCCESS && queue.count() == 0);
+    assert(client.sent.size() == 30 && client.sent[29] == "a:29:1");
+
+    // one the client did not keep is sent again by the queue once connected
+    client.sent.clear();
+    client.keep = false;
+    client.fail = 1;
+    queue.publish("b", "x", 1, MQTT::QOS1);
+    assert(queue.count() == 1 && !client.connected);
+    client.connected = true;
+    queue.yield(1);
+    assert(queue.count() == 0 && client.sent.size() == 1);
+}
+
+// records are committed by their flags byte, and the header is only written when a batch is published
+static void commit_and_header()
+{
+    FILE* file = tmpfile();
+    FakeClient client;
+
+    {
+        SmallQueue queue(client, file, 400);
+        for (int i = 0; i < 6; ++i)
+            assert(queue.publish("abc", "0123", 4, MQTT::QOS1) == MQTT::SUCCESS);
+        assert(queue.stored == 5);  // the first is in RAM
+
+        // a record cut short by a reset, before its flags byte was written
+        unsigned char partial[] = {3, 2, 'z', 'z', 0};
+        fseek(file, queue.tail + 1, SEEK_SET);
+        fwrite(partial, 1, sizeof(partial), file);
+        fflush(file);
+    }
+    {
+        SmallQueue queue(client, file, 400);
+        assert(queue.count() == 5);
+
+        client.connected = true;
+        client.ack_at_once = false;
+        assert(queue.drain() == MQTT::SUCCESS && client.sent.size() == 1);    // a record at a time fits
+        client.complete(1, MQTT::SUCCESS);
+        queue.drain();
+        assert(queue.head > SmallQueue::HEADER_LEN && queue.stored == 4);
+
+        unsigned char header[SmallQueue::HEADER_LEN];
+        fseek(file, 0, SEEK_SET);
+        assert(fread(header, 1, sizeof(header), file) == sizeof(header));
+        assert(memcmp(header, "MQOQ", 4) == 0 && header[4] == queue.head);
+        client.connected = false;
+    }
+    SmallQueue queue(client, file, 400);
+    assert(queue.count() == 4);     // including the one sent but not yet acknowledged
+    fclose(file);
+}
+
+// a full file moves the records left to its start when they take less than the space before them
+static void compaction()
+{
+    FILE* file = tmpfile();
+    FakeClient client;
+    SmallQueue queue(client, file, 120);
+    char payload[16];
+    int queued = 0;
+
+    while (sprintf(payload, "%03d", queued), queue.publish("ab", payload, 3, MQTT::QOS1) == MQTT::SUCCESS)
+        ++queued;
+    assert(queued > 10 && fileSize(file) <= 120);
+    long full = queue.tail;
+
+    client.connected = true;
+    client.ack_at_once = false;
+    while (queue.count() > 3)
+    {
+        assert(queue.drain() == MQTT::SUCCESS);
+        client.completeAll();
+    }
+    assert(queue.head > 60);
+
+    client.connected = false;
+    int more = queued;
+    while (sprintf(payload, "%03d", more), queue.publish("ab", payload, 3, MQTT::QOS1) == MQTT::SUCCESS)
+        ++more;
+    assert(more - queued > 5 && queue.head == SmallQueue::HEADER_LEN && queue.tail <= full && fileSize(file) <= 120);
+
+    client.connected = true;
+    client.ack_at_once = true;
+    client.sent.clear();
+    queue.release();
+    int left = queue.count();
+    assert(queue.drain() == MQTT::SUCCESS && queue.count() == 0 && (int)client.sent.size() == left);
+    for (int i = 0; i < left; ++i)
+    {
+        char expected[24];
+        sprintf(expected, "ab:%03d:1", more - left + i);
+        assert(client.sent[i] == expected);
+    }
+    fclose(file);
+}
+
+// through the real client
+static void with_client()
+{
+    FakeNet net;
+    MQTT::Client<FakeNet, Countdown> client(net, 100);
+    MQTT::OfflineQueue<MQTT::Client<FakeNet, Countdown> > queue(client);
+    MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+    unsigned char connack[] = {0x20, 2, 0, 0};
+
+    assert(queue.publish("t", "hi", 2, MQTT::QOS0) == MQTT::SUCCESS && queue.count() == 1);
+    net.push(Bytes(connack, connack + sizeof(connack)));
+    assert(client.connect(data) == MQTT::SUCCESS);
+    net.out.clear();
+    queue.yield(1);
+    assert(queue.count() == 0 && net.out.size() == 2 + 3 + 2);
+}
+
+int main()
+{
+    FILE* file = tmpfile();
+
+    spill_and_restart(file);
+    window(file);
+    fclose(file);
+    commit_and_header();
+    compaction();
+    with_client();
+    puts("OK");
+    return 0;
+}
@@ -0,0 +1,191 @@
+// The MQTT 5 property codec, the packets which carry properties, and the client's use of those from
+// the server
+
+#include "host.h"
+
+#define MQTTCLIENT_QOS2 1
+#define private public      // for the limits read from the CONNACK
+#include "MQTTClient.h"
+#undef private
+
+typedef std::vector<unsigned char> Bytes;
+
+static Bytes write(MQTTProperties& properties)
+{
+    Bytes buf(MQTTProperties_len(&properties));
+    unsigned char* ptr = buf.data();
+
+    MQTTProperties_write(&ptr, &properties);
+    assert(ptr == buf.data() + buf.size());
+    return buf;
+}
+
+// one property of each type, written and read back
+static void round_trip()
+{
+    MQTTProperty array[8];
+    MQTTProperties properties = {0, 8, 0, array};
+    MQTTProperty each[] = {
+        {MQTTPROPERTY_CODE_PAYLOAD_FORMAT_INDICATOR, 1},
+        {MQTTPROPERTY_CODE_RECEIVE_MAXIMUM, 0x1234},
+        {MQTTPROPERTY_CODE_MESSAGE_EXPIRY_INTERVAL, 0x12345678},
+        {MQTTPROPERTY_CODE_SUBSCRIPTION_IDENTIFIER, 16384},     // 3 bytes
+        {MQTTPROPERTY_CODE_CORRELATION_DATA, 0, {3, (char*)"\x00\x01\x02"}},
+        {MQTTPROPERTY_CODE_CONTENT_TYPE, 0, {4, (char*)"text"}},
+        {MQTTPROPERTY_CODE_USER_PROPERTY, 0, {3, (char*)"key"}, {5, (char*)"value"}},
+    };
+    const int count = sizeof(each) / sizeof(each[0]);
+
+    for (int i = 0; i < count; ++i)
+        assert(MQTTProperties_add(&properties, &each[i]) == 0);
+    assert(properties.length == 2 + 3 + 5 + 4 + 6 + 7 + 13);
+    Bytes buf = write(properties);
+    assert(buf.size() == 1 + 40 && buf[0] == 40);
+    assert(buf[1 + 2 + 3 + 5] == 11 && buf[1 + 2 + 3 + 5 + 1] == 0x80 && buf[1 + 2 + 3 + 5 + 3] == 0x01);
+
+    MQTTProperty read_array[8];
+    MQTTProperties read = {0, 8, 0, read_array};
+    unsigned char* ptr = buf.data();
+    assert(MQTTProperties_read(&read, &ptr, buf.data() + buf.size()) == 1);
+    assert(ptr == buf.data() + buf.size() && read.count == count && read.length == 40);
+    for (int i = 0; i < count; ++i)
+    {
+        assert(read.array[i].identifier == each[i].identifier && read.array[i].value == each[i].value);
+        assert(read.array[i].data.len == each[i].data.len && read.array[i].pair.len == each[i].pair.len);
+        assert(each[i].data.len == 0 || memcmp(read.array[i].data.data, each[i].data.data, each[i].data.len) == 0);
+        assert(each[i].pair.len == 0 || memcmp(read.array[i].pair.data, each[i].pair.data, each[i].pair.len) == 0);
+    }
+    unsigned int value = 0;
+    assert(MQTTProperties_getNumericValue(&read, MQTTPROPERTY_CODE_MESSAGE_EXPIRY_INTERVAL, &value) && value == 0x12345678);
+    assert(!MQTTProperties_getNumericValue(&read, MQTTPROPERTY_CODE_TOPIC_ALIAS, &value));
+
+    // beyond the array, properties are checked and skipped
+    MQTTProperty two[2];
+    MQTTProperties few = {0, 2, 0, two};
+    ptr = buf.data();
+    assert(MQTTProperties_read(&few, &ptr, buf.data() + buf.size()) == 1 && few.count == 2 && few.length == 40);
+
+    // every truncation fails, without reading past the end
+    for (size_t len = 1; len < buf.size(); ++len)
+    {
+        Bytes part(buf.begin(), buf.begin() + len);
+        ptr = part.data();
+        assert(MQTTProperties_read(&read, &ptr, part.data() + len) == 0);
+    }
+}
+
+static void malformed()
+{
+    MQTTProperty array[2];
+    MQTTProperties properties = {0, 2, 0, array};
+    MQTTProperty unknown = {99, 1};
+    unsigned char bad_id[] = {2, 99, 1};
+    unsigned char short_string[] = {4, 3, 0, 5, 'a'};
+    unsigned char* ptr = bad_id;
+
+    assert(MQTTProperties_add(&properties, &unknown) == -1 && properties.count == 0);
+    assert(MQTTProperties_read(&properties, &ptr, bad_id + sizeof(bad_id)) == 0);
+    ptr = short_string;
+    assert(MQTTProperties_read(&properties, &ptr, short_string + sizeof(short_string)) == 0);
+}
+
+static void packets()
+{
+    unsigned char buf[200];
+    MQTTProperty array[4];
+    MQTTProperties properties = {0, 4, 0, array};
+    MQTTProperty alias = {MQTTPROPERTY_CODE_TOPIC_ALIAS, 3};
+    MQTTProperty user = {MQTTPROPERTY_CODE_USER_PROPERTY, 0, {3, (char*)"key"}, {5, (char*)"value"}};
+    MQTTString topic = MQTTString_initializer;
+
+    assert(MQTTProperties_add(&properties, &alias) == 0 && MQTTProperties_add(&properties, &user) == 0);
+    topic.cstring = (char*)"a/b";
+    int len = MQTTV5Serialize_publish(buf, sizeof(buf), 0, 1, 0, 7, topic, &properties, (unsigned char*)"hello", 5);
+    assert(len == 2 + 5 + 2 + 1 + 3 + 13 + 5);
+
+    MQTTProperty read_array[4];
+    MQTTProperties read = {0, 4, 0, read_array};
+    unsigned char dup, retained, *payload;
+    int qos, payloadlen;
+    unsigned short id;
+    MQTTString name;
+    assert(MQTTV5Deserialize_publish(&dup, &qos, &retained, &id, &name, &read, &payload, &payloadlen, buf, len) == 1);
+    assert(qos == 1 && id == 7 && name.lenstring.len == 3 && read.count == 2);
+    assert(payloadlen == 5 && memcmp(payload, "hello", 5) == 0);
+    // a remaining length which stops short of the payload fails, without reading past it
+    for (int rem = 0; rem < len - 2 - 5; ++rem)
+    {
+        Bytes part(buf, buf + 2 + rem);
+        part[1] = rem;
+        assert(MQTTV5Deserialize_publish(&dup, &qos, &retained, &id, &name, &read, &payload, &payloadlen,
+                                         part.data(), part.size()) != 1);
+    }
+
+    // MQTT 3 is unchanged, and MQTT 5 adds the version and the property length
+    MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+    data.clientID.cstring = (char*)"c";
+    assert(MQTTSerialize_connect(buf, sizeof(buf), &data) == 15 && buf[8] == 4);
+    data.MQTTVersion = 5;
+    assert(MQTTSerialize_connect(buf, sizeof(buf), &data) == 16 && buf[8] == 5 && buf[12] == 0);
+}
+
+static int phrc = 1;
+
+static void published(MQTT::publishData& data)
+{
+    phrc = data.rc;
+}
+
+// the limits in the CONNACK, and reason codes in the acks
+static void client()
+{
+    FakeNet net;
+    MQTT::Client<FakeNet, Countdown> client(net, 100);
+    MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+    unsigned char connack[] = {0x20, 11, 0, 0, 8, 34, 0, 2, 39, 0, 0, 0, 30};    // topic alias max 2, max packet 30
+    MQTTPreparedTopic topic;
+
+    data.MQTTVersion = 5;
+    net.push(Bytes(connack, connack + sizeof(connack)));
+    assert(client.connect(data) == MQTT::SUCCESS);
+    assert(client.topic_alias_max == 2 && client.max_packet_size == 30 && client.receive_max == 65535);
+
+    // the first publish to a prepared topic sets an alias, the next sends it alone
+    MQTTSerialize_prepareTopic(&topic, (char*)"long/topic/name");
+    net.out.clear();
+    assert(client.publish(topic, (void*)"x", 1) == MQTT::SUCCESS);
+    assert(net.out[0] == 0x30 && net.out[1] == 2 + 15 + 4 + 1 && net.out[19] == 3 && net.out[20] == 35 && net.out[22] == 1);
+    net.out.clear();
+    assert(client.publish(topic, (void*)"x", 1) == MQTT::SUCCESS);
+    unsigned char aliased[] = {0x30, 7, 0, 0, 3, 35, 0, 1, 'x'};
+    assert(net.out.size() == sizeof(aliased) && memcmp(net.out.data(), aliased, sizeof(aliased)) == 0);
+
+    // larger than the server's maximum packet size
+    char big[30] = {0};
+    net.out.clear();
+    assert(client.publish("q", big, sizeof(big)) == MQTT::FAILURE && net.out.empty() && client.isConnected());
+
+    // a PUBACK with a failure reason code
+    unsigned short id = 0;
+    assert(client.publishAsync("q", (void*)"1", 1, id, MQTT::QOS1, false, published) == MQTT::SUCCESS);
+    unsigned char puback[] = {0x40, 3, (unsigned char)(id >> 8), (unsigned char)id, 0x97};
+    net.push(Bytes(puback, puback + sizeof(puback)));
+    client.yield(10);
+    assert(phrc == MQTT::FAILURE && client.isConnected());
+
+    // a DISCONNECT from the server
+    unsigned char disconnect[] = {0xE0, 2, 0x8B, 0};
+    net.push(Bytes(disconnect, disconnect + sizeof(disconnect)));
+    client.yield(10);
+    assert(!client.isConnected());
+}
+
+int main()
+{
+    round_trip();
+    malformed();
+    packets();
+    client();
+    puts("OK");
+    return 0;
+}
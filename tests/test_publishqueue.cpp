@@ -0,0 +1,130 @@
+// MQTT::PublishQueue: several producer threads against the draining thread, the full queue, and a
+// publish the client keeps to send again
+
+#include "host.h"
+#include <atomic>
+#include <set>
+
+#define MQTTCLIENT_QOS2 1
+#include "MQTTPublishQueue.h"
+
+// a client which records what it is given to publish
+struct FakeClient
+{
+    bool connected = true;
+    int fail = 0;               // publishes to fail, each kept in flight by the client
+    unsigned short next_id = 0;
+    std::set<unsigned short> inflight;
+    std::vector<std::string> sent;  // "topic|payload"
+
+    bool isConnected()
+    {
+        return connected;
+    }
+
+    bool isInflight(unsigned short id)
+    {
+        return inflight.count(id) != 0;
+    }
+
+    int publish(const char* topic, void* payload, size_t len, unsigned short& id, MQTT::QoS qos, bool retained)
+    {
+        if (qos != MQTT::QOS0)
+            id = ++next_id;
+        if (fail > 0)
+        {
+            --fail;
+            inflight.insert(id);
+            return MQTT::FAILURE;
+        }
+        sent.push_back(std::string(topic) + "|" + std::string((char*)payload, len));
+        return MQTT::SUCCESS;
+    }
+};
+
+// each producer's messages arrive in the order it queued them, and none is lost while there is room
+static void producers()
+{
+    static MQTT::PublishQueue<16, 64> queue;
+    const int PRODUCERS = 4, MESSAGES = 20000;
+    std::atomic<int> queued(0);
+    std::atomic<bool> stop(false);
+    FakeClient client;
+
+    std::thread consumer([&]() {
+        while (!stop || queue.depth() > 0)
+            queue.drain(client);
+    });
+    std::vector<std::thread> threads;
+    for (int p = 0; p < PRODUCERS; ++p)
+    {
+        threads.push_back(std::thread([&, p]() {
+            char topic[2] = {char('a' + p), 0};
+            char payload[16];
+
+            for (int i = 0; i < MESSAGES; ++i)
+            {
+                sprintf(payload, "%d", i);
+                while (!queue.publish(topic, payload, strlen(payload)))
+                    std::this_thread::yield();  // full: dropped, so try again
+                queued++;
+            }
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+    stop = true;
+    consumer.join();
+
+    assert(queued == PRODUCERS * MESSAGES && (int)client.sent.size() == queued && queue.depth() == 0);
+    int last[PRODUCERS] = {-1, -1, -1, -1};
+    for (size_t i = 0; i < client.sent.size(); ++i)
+    {
+        int p = client.sent[i][0] - 'a';
+        int n = atoi(client.sent[i].c_str() + 2);
+        assert(n > last[p]);
+        last[p] = n;
+    }
+}
+
+static void full()
+{
+    MQTT::PublishQueue<4, 32> queue;
+    FakeClient client;
+    char big[40] = {0};
+
+    assert(!queue.publish("t", big, sizeof(big)) && queue.dropped() == 1);     // larger than a slot
+    assert(queue.peekLength() == -1);
+    for (int i = 0; i < 4; ++i)
+        assert(queue.publish("t", "abc", 3));
+    assert(!queue.publish("t", "abc", 3) && queue.dropped() == 2 && queue.depth() == 4);
+    assert(queue.peekLength() == 2 + 3);
+    assert(queue.drain(client, 3) == 3 && queue.depth() == 1);
+    assert(queue.publish("t", "abc", 3) && queue.drain(client) == 2 && client.sent.size() == 5);
+}
+
+// a failed publish kept by the client holds its slot until the client has sent it again
+static void held()
+{
+    MQTT::PublishQueue<4, 32> queue;
+    FakeClient client;
+
+    assert(queue.publish("t", "1", 1, MQTT::QOS1) && queue.publish("t", "2", 1, MQTT::QOS1));
+    client.fail = 1;
+    assert(queue.drain(client) == 0 && queue.depth() == 2);
+    assert(queue.drain(client) == 0);       // still in flight
+    client.inflight.clear();                // sent again by the client on reconnect
+    assert(queue.drain(client) == 2 && client.sent.size() == 1 && client.sent[0] == "t|2");
+
+    client.connected = false;
+    assert(queue.publish("t", "3", 1) && queue.drain(client) == 0 && queue.depth() == 1);
+}
+
+int main()
+{
+    producers();
+    full();
+    held();
+    puts("OK");
+    return 0;
+}
@@ -0,0 +1,124 @@
+// The client's set of incoming QoS 2 packet ids, and what happens when it is full
+
+#include "host.h"
+#include <set>
+
+#define MQTTCLIENT_QOS2 1
+#define MAX_INCOMING_QOS2_MESSAGES 7
+#define private public      // for the id set itself
+#include "MQTTClient.h"
+#undef private
+
+typedef std::vector<unsigned char> Bytes;
+typedef MQTT::Client<FakeNet, Countdown> Client;
+
+static int delivered;
+
+static void handler(MQTT::MessageData&)
+{
+    delivered++;
+}
+
+static Bytes ack(int type, unsigned short id)
+{
+    unsigned char buf[4];
+    return Bytes(buf, buf + MQTTSerialize_ack(buf, sizeof(buf), type, 0, id));
+}
+
+static Bytes publish(unsigned short id, int version)
+{
+    unsigned char buf[30];
+    MQTTString topic = MQTTString_initializer;
+    MQTTProperties properties = MQTTProperties_initializer;
+
+    topic.cstring = (char*)"q";
+    int len = MQTTV5Serialize_publish(buf, sizeof(buf), 0, 2, 0, id, topic, (version == 5) ? &properties : 0,
+                                      (unsigned char*)"p", 1);
+    return Bytes(buf, buf + len);
+}
+
+// random use and free against std::set
+static void id_set(Client& client)
+{
+    std::set<unsigned short> expected;
+
+    srand(3);
+    for (int i = 0; i < 200000; ++i)
+    {
+        unsigned short id = 1 + rand() % 40;
+
+        if (rand() % 2)
+        {
+            bool room = expected.count(id) || expected.size() < MAX_INCOMING_QOS2_MESSAGES;
+            assert(client.useQoS2msgid(id) == room);
+            if (room)
+                expected.insert(id);
+        }
+        else
+        {
+            client.freeQoS2msgid(id);
+            expected.erase(id);
+        }
+        for (unsigned short k = 1; k <= 40; ++k)
+            assert(client.isQoS2msgidFree(k) == (expected.count(k) == 0));
+        assert(client.incomingQoS2count == (int)expected.size());
+    }
+    client.cleanSession();
+}
+
+// MQTT 3: beyond the window a message is delivered and acknowledged without its id recorded
+static void window_full_v3(FakeNet& net, Client& client)
+{
+    MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+    unsigned char connack[] = {0x20, 2, 0, 0};
+
+    net.push(Bytes(connack, connack + sizeof(connack)));
+    assert(client.connect(data) == MQTT::SUCCESS);
+    client.setMessageHandler("q", handler);
+    for (int i = 1; i <= 8; ++i)
+        net.push(publish(i, 3));
+    net.out.clear();
+    client.yield(10);
+    assert(delivered == 8 && net.out.size() == 8 * 4);     // 8 PUBRECs
+    assert(client.isQoS2WindowFull() && client.isQoS2msgidFree(8));
+
+    net.push(ack(PUBREL, 3));
+    net.push(publish(9, 3));
+    client.yield(10);
+    assert(delivered == 9 && client.isQoS2WindowFull() && !client.isQoS2msgidFree(9));
+    client.disconnect();
+}
+
+// MQTT 5: the CONNECT sets Receive Maximum to the window, and a server exceeding it is disconnected
+static void window_full_v5(FakeNet& net, Client& client)
+{
+    MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+    unsigned char connack[] = {0x20, 3, 0, 0, 0};
+
+    delivered = 0;
+    data.MQTTVersion = 5;
+    net.push(Bytes(connack, connack + sizeof(connack)));
+    net.out.clear();
+    assert(client.connect(data) == MQTT::SUCCESS);
+    assert(net.out[12] == 3 && net.out[13] == 33 && net.out[14] == 0 && net.out[15] == MAX_INCOMING_QOS2_MESSAGES);
+
+    client.setMessageHandler("q", handler);
+    for (int i = 1; i <= 8; ++i)
+        net.push(publish(i, 5));
+    net.out.clear();
+    client.yield(10);
+    assert(delivered == 7 && !client.isConnected());
+    assert(net.out.size() == 7 * 4 + 3 && net.out[28] == 0xE0 && net.out[30] == 0x93);   // DISCONNECT, 0x93
+}
+
+int main()
+{
+    FakeNet net;
+    Client client(net, 100);
+
+    id_set(client);
+    window_full_v3(net, client);
+    window_full_v5(net, client);
+    puts("OK");
+    return 0;
+}
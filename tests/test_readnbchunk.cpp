@@ -0,0 +1,118 @@
+// MQTTPacket_readnbChunk: a stream of packets split into chunks of every size, a callback which stops
+// the parse, and the errors
+
+#include "host.h"
+#include <algorithm>
+#include "MQTTPacket.h"
+
+typedef std::vector<unsigned char> Bytes;
+
+static std::vector<Bytes> got;
+static int stop_at = -1;    // the number of packets after which the callback stops the parse
+
+extern "C" int packet(void*, unsigned char* buf, int len)
+{
+    got.push_back(Bytes(buf, buf + len));
+    return (int)got.size() == stop_at;
+}
+
+static int read(unsigned char* buf, int buflen, MQTTTransport& trp, Bytes& data, size_t pos, size_t len)
+{
+    Bytes chunk(data.begin() + pos, data.begin() + pos + len);     // exactly the chunk, for the sanitizers
+
+    return MQTTPacket_readnbChunk(buf, buflen, &trp, chunk.data(), len, packet);
+}
+
+// acks, pings and publishes of up to 300 bytes, so with one and two byte remaining lengths
+static std::vector<Bytes> packets()
+{
+    std::vector<Bytes> result;
+    unsigned char buf[400], payload[300];
+    MQTTString topic = MQTTString_initializer;
+
+    topic.cstring = (char*)"a/b";
+    for (int i = 0; i < 40; ++i)
+    {
+        int len;
+
+        if (i % 3 == 0)
+            len = MQTTSerialize_ack(buf, sizeof(buf), PUBACK, 0, i);
+        else if (i % 3 == 1)
+            len = MQTTSerialize_pingreq(buf, sizeof(buf));
+        else
+        {
+            memset(payload, i, sizeof(payload));
+            len = MQTTSerialize_publish(buf, sizeof(buf), 0, 0, 0, 0, topic, payload, (i * 37) % 300);
+        }
+        result.push_back(Bytes(buf, buf + len));
+    }
+    return result;
+}
+
+static void chunks(const std::vector<Bytes>& expected, Bytes& stream)
+{
+    srand(5);
+    for (int round = 0; round < 2000; ++round)
+    {
+        MQTTTransport trp = {0};
+        unsigned char buf[400];
+        size_t pos = 0;
+
+        got.clear();
+        while (pos < stream.size())
+        {
+            size_t len = (round == 0) ? 1 : 1 + rand() % ((round % 2) ? 8 : 300);
+
+            len = std::min(len, stream.size() - pos);
+            assert(read(buf, sizeof(buf), trp, stream, pos, len) == (int)len);
+            pos += len;
+        }
+        assert(got == expected && trp.state == 0);
+    }
+}
+
+// the callback stops the parse after the third packet, and it resumes with the rest
+static void stop_and_resume(const std::vector<Bytes>& expected, Bytes& stream)
+{
+    MQTTTransport trp = {0};
+    unsigned char buf[400];
+    size_t first = expected[0].size() + expected[1].size() + expected[2].size();
+
+    got.clear();
+    stop_at = 3;
+    assert(read(buf, sizeof(buf), trp, stream, 0, stream.size()) == (int)first && got.size() == 3);
+    stop_at = -1;
+    assert(read(buf, sizeof(buf), trp, stream, first, stream.size() - first) == (int)(stream.size() - first));
+    assert(got == expected);
+}
+
+static void errors(const std::vector<Bytes>& expected)
+{
+    MQTTTransport trp = {0};
+    unsigned char buf[20];
+    Bytes big, bad = {0x30, 0xff, 0xff, 0xff, 0xff, 1};   // five remaining length bytes
+
+    for (size_t i = 0; big.empty(); ++i)
+        if (expected[i].size() > sizeof(buf))
+            big = expected[i];
+    got.clear();
+    assert(read(buf, sizeof(buf), trp, big, 0, 10) == -1 && trp.state == 0 && got.empty());   // too large for buf
+
+    assert(read(buf, sizeof(buf), trp, bad, 0, bad.size()) == -1);
+    assert(read(buf, sizeof(buf), trp, bad, 0, 3) == 3);       // split within the remaining length
+    assert(read(buf, sizeof(buf), trp, bad, 3, 3) == -1 && got.empty());
+}
+
+int main()
+{
+    std::vector<Bytes> expected = packets();
+    Bytes stream;
+
+    for (size_t i = 0; i < expected.size(); ++i)
+        stream.insert(stream.end(), expected[i].begin(), expected[i].end());
+    chunks(expected, stream);
+    stop_and_resume(expected, stream);
+    errors(expected);
+    puts("OK");
+    return 0;
+}
@@ -0,0 +1,220 @@
+// MQTT::TopicTrie against a plain implementation of the MQTT topic matching rules, and the client's
+// dispatch through it
+
+#include "host.h"
+#include <set>
+#include <algorithm>
+#include "MQTTClient.h"
+
+typedef std::vector<unsigned char> Bytes;
+
+static std::vector<std::string> levels(const std::string& topic)
+{
+    std::vector<std::string> result;
+    size_t start = 0;
+
+    while (true)
+    {
+        size_t end = topic.find('/', start);
+        result.push_back(topic.substr(start, (end == std::string::npos) ? std::string::npos : end - start));
+        if (end == std::string::npos)
+            return result;
+        start = end + 1;
+    }
+}
+
+// the matching rules of the MQTT specification, section 4.7
+static bool matches(const std::string& filter, const std::string& topic)
+{
+    std::vector<std::string> f = levels(filter), t = levels(topic);
+
+    if (topic[0] == '$' && (f[0] == "+" || f[0] == "#"))
+        return false;
+    for (size_t i = 0; i < f.size(); ++i)
+    {
+        if (f[i] == "#")
+            return true;
+        if (i >= t.size() || (f[i] != "+" && f[i] != t[i]))
+            return false;
+    }
+    return f.size() == t.size();
+}
+
+static std::set<int> match(MQTT::TopicTrie<200>& trie, const std::string& topic)
+{
+    MQTTString name = MQTTString_initializer;
+    int values[50];
+
+    name.lenstring.data = (char*)topic.data();
+    name.lenstring.len = topic.size();
+    int count = trie.match(name, values, 50);
+    std::set<int> result(values, values + count);
+    assert((int)result.size() == count);
+    return result;
+}
+
+static void random_filters()
+{
+    const char* words[] = {"a", "b", "c", "", "$SYS"};
+
+    srand(1);
+    for (int round = 0; round < 3000; ++round)
+    {
+        MQTT::TopicTrie<200> trie;
+        std::vector<std::string> filters;
+
+        for (int i = rand() % 12; i > 0; --i)
+        {
+            std::string filter;
+            int depth = 1 + rand() % 4;
+
+            for (int k = 0; k < depth; ++k)
+            {
+                int r = rand() % 7;
+                if (k > 0)
+                    filter += "/";
+                if (r == 5)
+                    filter += "+";
+                else if (r == 6 && k == depth - 1)
+                    filter += "#";
+                else
+                    filter += words[(r % 5 == 4 && k > 0) ? 0 : r % 5];   // $ only at the start
+            }
+            if (std::find(filters.begin(), filters.end(), filter) == filters.end())
+                filters.push_back(filter);
+        }
+        for (size_t i = 0; i < filters.size(); ++i)
+            assert(trie.add(filters[i].c_str(), i));
+
+        for (int i = 0; i < 20; ++i)
+        {
+            std::string topic;
+            std::set<int> expected;
+            int depth = 1 + rand() % 4;
+
+            for (int k = 0; k < depth; ++k)
+                topic += std::string((k > 0) ? "/" : "") + words[rand() % 5];
+            for (size_t j = 0; j < filters.size(); ++j)
+                if (matches(filters[j], topic))
+                    expected.insert(j);
+            assert(match(trie, topic) == expected);
+        }
+    }
+}
+
+static void pool_exhausted()
+{
+    MQTT::TopicTrie<4> trie;
+    MQTTString name = MQTTString_initializer;
+    int values[4];
+
+    assert(trie.add("a/b", 0));
+    assert(!trie.add("c/d/e", 1));  // unchanged by the failure
+    assert(trie.add("a/c", 2));
+    name.cstring = (char*)"a/c";
+    assert(trie.match(name, values, 4) == 1 && values[0] == 2);
+}
+
+static int hits[2];
+
+static void handler0(MQTT::MessageData&)
+{
+    hits[0]++;
+}
+
+static void handler1(MQTT::MessageData&)
+{
+    hits[1]++;
+}
+
+static Bytes publish(const char* topic)
+{
+    unsigned char buf[100];
+    MQTTString name = MQTTString_initializer;
+
+    name.cstring = (char*)topic;
+    int len = MQTTSerialize_publish(buf, sizeof(buf), 0, 0, 0, 0, name, (unsigned char*)"p", 1);
+    return Bytes(buf, buf + len);
+}
+
+static void client_dispatch()
+{
+    FakeNet net;
+    MQTT::Client<FakeNet, Countdown, 100, 40> client(net, 100);
+    MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+    unsigned char connack[4];
+    static char filters[40][16];
+
+    for (int i = 0; i < 40; ++i)
+    {
+        sprintf(filters[i], "dev/%d/cmd", i);
+        assert(client.setMessageHandler(filters[i], handler1) == MQTT::SUCCESS);
+    }
+    assert(client.setMessageHandler("dev/+/cmd", handler0) == MQTT::FAILURE);     // table full
+    assert(client.setMessageHandler(filters[3], 0) == MQTT::SUCCESS);
+    assert(client.setMessageHandler("dev/+/cmd", handler0) == MQTT::SUCCESS);
+
+    net.push(Bytes(connack, connack + MQTTSerialize_connack(connack, sizeof(connack), 0, 0)));
+    assert(client.connect(data) == MQTT::SUCCESS);
+    net.push(publish("dev/3/cmd"));
+    net.push(publish("dev/5/cmd"));
+    net.push(publish("dev/5/x"));
+    client.yield(20);
+    assert(hits[0] == 2 && hits[1] == 1);
+
+    // the handlers share the node pool, of MQTTCLIENT_TOPIC_LEVELS (8) for each of the 5
+    MQTT::Client<FakeNet, Countdown> small(net, 100);
+    assert(small.setMessageHandler("a/b/c/d/e/f/g/h/i/j/k/l/m/n/o/p/q/r/s/t", handler0) == MQTT::SUCCESS);
+    assert(small.setMessageHandler("A/B/C/D/E/F/G/H/I/J/K/L/M/N/O/P/Q/R/S/T", handler0) == MQTT::SUCCESS);
+    assert(small.setMessageHandler("u/v", handler0) == MQTT::FAILURE);
+    assert(small.setMessageHandler("a/b/c/d/e/f/g/h/i/j/k/l/m/n/o/p/q/r/s/t", 0) == MQTT::SUCCESS);
+    assert(small.setMessageHandler("u/v", handler0) == MQTT::SUCCESS);
+}
+
+static Bytes suback(unsigned short id)
+{
+    unsigned char buf[5];
+    int granted = 1;
+
+    return Bytes(buf, buf + MQTTSerialize_suback(buf, sizeof(buf), id, 1, &granted));
+}
+
+// a subscribe with no room in the topic index for its handler fails before anything is sent
+static void subscribe_full()
+{
+    FakeNet net;
+    MQTT::Client<FakeNet, Countdown> client(net, 100);
+    MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+    unsigned char connack[] = {0x20, 2, 0, 0};
+    static char filters[5][24];
+
+    net.push(Bytes(connack, connack + sizeof(connack)));
+    assert(client.connect(data) == MQTT::SUCCESS);
+    for (int i = 0; i < 5; ++i)
+        sprintf(filters[i], "%d/b/c/d/e/f/g/h/i", i);  // 9 levels, none shared
+    for (int i = 0; i < 4; ++i)
+    {
+        net.push(suback(i + 1));
+        assert(client.subscribe(filters[i], MQTT::QOS1, handler0) == MQTT::SUCCESS);
+    }
+    net.out.clear();
+    assert(client.subscribe(filters[4], MQTT::QOS1, handler0) == MQTT::FAILURE);
+    const char* both[] = {filters[0], filters[4]};
+    MQTT::QoS qos[] = {MQTT::QOS1, MQTT::QOS1};
+    MQTT::Client<FakeNet, Countdown>::messageHandler mhs[] = {handler1, handler1};
+    assert(client.subscribe(2, both, qos, mhs) == MQTT::FAILURE);
+    assert(net.out.empty() && client.isConnected());
+
+    net.push(suback(5));
+    assert(client.subscribe(filters[0], MQTT::QOS0, handler1) == MQTT::SUCCESS);  // a new handler fits
+}
+
+int main()
+{
+    random_filters();
+    pool_exhausted();
+    client_dispatch();
+    subscribe_full();
+    puts("OK");
+    return 0;
+}